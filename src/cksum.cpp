@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/digest.hpp"
+#include "details/output_buffer.hpp"
+#include "details/split.hpp"
+#include "details/thread_pool.hpp"
+
+using namespace std::string_view_literals;
+
+#ifdef SHA256SUM
+  #define COREUTILS_IS_SHA256SUM true
+#else
+  #define COREUTILS_IS_SHA256SUM false
+#endif
+
+void usage(std::string_view argv0) {
+  if constexpr (COREUTILS_IS_SHA256SUM) {
+    fmt::format_to(
+      std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] [FILES...]
+   or: {0} --help
+Prints the SHA-256 digest of each FILE. With no FILES, or when FILE is -,
+reads standard input.
+
+Options:
+  -b, --binary  mark each file as read in binary mode (*)
+  -t, --text    mark each file as read in text mode (the default)
+  -c, --check   read digests from the FILES and check them
+  --tag         print BSD-style lines: SHA256 (FILE) = DIGEST
+  -z, --zero    end each output line with NUL, not newline, and do not
+                escape file names
+
+Options for --check:
+  --quiet       do not print OK for each file that matches
+  --status      print nothing; the exit status shows the result
+  --strict      fail if any line is improperly formatted
+  -w, --warn    warn about each improperly formatted line
+
+  --help        print this help page and exit
+)msg"sv.substr(1),
+      argv0);
+  }
+  else {
+    fmt::format_to(
+      std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] [FILES...]
+   or: {0} --help
+Prints the checksum and size of each FILE. With no FILES, or when FILE is -,
+reads standard input.
+
+Options:
+  -a, --algorithm ALGO
+                use ALGO, one of crc (the default) and sha256
+  -c, --check   read SHA-256 digests from the FILES and check them
+  --tag         print BSD-style lines: SHA256 (FILE) = DIGEST (the default)
+  --untagged    print lines as DIGEST  FILE
+  -z, --zero    end each output line with NUL, not newline, and do not
+                escape file names
+
+Options for --check:
+  --quiet       do not print OK for each file that matches
+  --status      print nothing; the exit status shows the result
+  --strict      fail if any line is improperly formatted
+  -w, --warn    warn about each improperly formatted line
+
+  --help        print this help page and exit
+)msg"sv.substr(1),
+      argv0);
+  }
+}
+
+struct option_data {
+  enum class algorithm { crc, sha256 };
+
+  std::vector<std::string> paths;
+  algorithm algo =
+    COREUTILS_IS_SHA256SUM ? algorithm::sha256 : algorithm::crc;
+
+  bool check : 1    = false;
+  bool tagged : 1   = !COREUTILS_IS_SHA256SUM;
+  bool binary : 1   = false;
+  bool zero : 1     = false;
+  bool quiet : 1    = false;
+  bool status : 1   = false;
+  bool strict : 1   = false;
+  bool warn : 1     = false;
+  bool implicit : 1 = false;
+  bool chosen : 1   = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  using algorithm = option_data::algorithm;
+  option_data data;
+
+  auto set_algorithm = [&](std::string_view arg) {
+    if constexpr (COREUTILS_IS_SHA256SUM)
+      fail(argv[0], "the algorithm cannot be changed");
+    data.chosen = true;
+    if (arg == "crc"sv)
+      data.algo = algorithm::crc;
+    else if (arg == "sha256"sv)
+      data.algo = algorithm::sha256;
+    else
+      fail(argv[0], fmt::format("unsupported algorithm '{}'", arg));
+  };
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-a", 1>(set_algorithm),
+    option<"--algorithm", 1>(set_algorithm),
+    option<"-b", 0>([&] { data.binary = true; }),
+    option<"--binary", 0>([&] { data.binary = true; }),
+    option<"-t", 0>([&] { data.binary = false; }),
+    option<"--text", 0>([&] { data.binary = false; }),
+    option<"-c", 0>([&] { data.check = true; }),
+    option<"--check", 0>([&] { data.check = true; }),
+    option<"--tag", 0>([&] { data.tagged = true; }),
+    option<"--untagged", 0>([&] { data.tagged = false; }),
+    option<"-z", 0>([&] { data.zero = true; }),
+    option<"--zero", 0>([&] { data.zero = true; }),
+    option<"--quiet", 0>([&] { data.quiet = true; }),
+    option<"--status", 0>([&] { data.status = true; }),
+    option<"--strict", 0>([&] { data.strict = true; }),
+    option<"-w", 0>([&] { data.warn = true; }),
+    option<"--warn", 0>([&] { data.warn = true; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+
+  // only SHA-256 lines can be checked, so cksum -c means cksum -a sha256
+  if (data.check && data.algo == algorithm::crc) {
+    if (data.chosen)
+      fail(argv[0], "--check is not supported with --algorithm=crc");
+    data.algo = algorithm::sha256;
+  }
+  if (data.paths.empty()) {
+    data.paths.emplace_back("-");
+    data.implicit = true;
+  }
+  return data;
+}
+
+namespace {
+  using algorithm = option_data::algorithm;
+
+  // The digest of a file, as printed: the CRC and size for cksum's CRC,
+  // otherwise hex.
+  struct file_hash {
+    std::string digest;
+    int error = 0;
+  };
+
+  class hasher {
+  public:
+    explicit hasher(algorithm algo) : algo(algo) {}
+
+    void update(const void* data, size_t n) {
+      size += n;
+      if (algo == algorithm::crc)
+        crc.update(data, n);
+      else
+        sha.update(data, n);
+    }
+
+    std::string finish() {
+      if (algo == algorithm::crc)
+        return fmt::format("{} {}", crc.finish(), size);
+
+      static constexpr char hex[] = "0123456789abcdef";
+      std::string res;
+      for (uint8_t byte : sha.finish()) {
+        res.push_back(hex[byte >> 4]);
+        res.push_back(hex[byte & 15]);
+      }
+      return res;
+    }
+
+  private:
+    algorithm algo;
+    uint64_t size = 0;
+    coreutils::crc32_posix crc;
+    coreutils::sha256 sha;
+  };
+
+  // Regular files big enough to be worth it are mapped a window at a time,
+  // with the page tables filled in up front rather than one fault per page;
+  // everything else is read in large blocks.
+  constexpr size_t map_threshold = 1024 * 1024;
+  constexpr size_t map_window    = 64 * 1024 * 1024;
+  constexpr size_t read_block    = 256 * 1024;
+
+  // Returns false if the file should be read instead. Sets error if it
+  // failed partway.
+  bool hash_mapped(int fd, hasher& h, int& error) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+    if (size_t(st.st_size) < map_threshold) return false;
+
+    size_t size = size_t(st.st_size);
+    for (size_t offset = 0; offset < size; offset += map_window) {
+      size_t len = std::min(map_window, size - offset);
+      void* map  = mmap(
+        nullptr, len, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, off_t(offset));
+      if (map == MAP_FAILED) {
+        if (offset == 0) return false;
+        error = errno;
+        break;
+      }
+      h.update(map, len);
+      munmap(map, len);
+    }
+    return true;
+  }
+
+  file_hash hash_file(const std::string& path, algorithm algo) {
+    file_hash res;
+    int fd = STDIN_FILENO;
+    if (path != "-") {
+      fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        res.error = errno;
+        return res;
+      }
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    hasher h(algo);
+    if (fd == STDIN_FILENO || !hash_mapped(fd, h, res.error)) {
+      std::unique_ptr<char[]> buffer(new char[read_block]);
+      for (;;) {
+        ssize_t len = read(fd, buffer.get(), read_block);
+        if (len < 0) {
+          if (errno == EINTR) continue;
+          res.error = errno;
+          break;
+        }
+        if (len == 0) break;
+        h.update(buffer.get(), size_t(len));
+      }
+    }
+    if (fd != STDIN_FILENO) close(fd);
+    if (res.error == 0) res.digest = h.finish();
+    return res;
+  }
+
+  // Hashes every regular file on the pool, calling emit for each result in
+  // order as soon as it and everything before it is ready. Anything else,
+  // standard input in particular, is read on this thread when its turn
+  // comes, so that the first of several "-" gets all of the input.
+  template <typename Emit>
+  void hash_all(
+    const std::vector<std::string>& paths, algorithm algo, Emit&& emit) {
+    if (paths.size() == 1) {
+      emit(size_t(0), hash_file(paths[0], algo));
+      return;
+    }
+
+    std::vector<file_hash> results(paths.size());
+    std::vector<bool> done(paths.size());
+    std::vector<bool> pooled(paths.size());
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+
+    coreutils::thread_pool pool;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      struct stat st;
+      if (paths[i] == "-" || stat(paths[i].c_str(), &st) != 0 ||
+          !S_ISREG(st.st_mode)) {
+        continue;
+      }
+      pooled[i] = true;
+      pool.submit([&, i] {
+        results[i] = hash_file(paths[i], algo);
+        std::lock_guard guard(done_lock);
+        done[i] = true;
+        done_cv.notify_all();
+      });
+    }
+    try {
+      for (size_t i = 0; i < paths.size(); ++i) {
+        if (!pooled[i]) {
+          emit(i, hash_file(paths[i], algo));
+          continue;
+        }
+        {
+          std::unique_lock guard(done_lock);
+          done_cv.wait(guard, [&] { return done[i]; });
+        }
+        emit(i, std::move(results[i]));
+      }
+    }
+    catch (...) {
+      // the workers still use the results
+      pool.wait();
+      throw;
+    }
+    pool.wait();
+  }
+
+  // File names with newlines or backslashes are escaped, and the line
+  // starts with a backslash to say so.
+  bool needs_escape(std::string_view name) {
+    return name.find_first_of("\\\n"sv) != std::string_view::npos;
+  }
+
+  std::string unescape_name(std::string_view name) {
+    std::string res;
+    for (size_t i = 0; i < name.size(); ++i) {
+      if (name[i] == '\\' && i + 1 < name.size()) {
+        ++i;
+        res.push_back(name[i] == 'n' ? '\n' : name[i]);
+      }
+      else {
+        res.push_back(name[i]);
+      }
+    }
+    return res;
+  }
+
+  class checksummer {
+  public:
+    checksummer(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {}
+
+    int print(const std::vector<std::string>& paths) {
+      int status = 0;
+      hash_all(paths, config.algo, [&](size_t i, file_hash res) {
+        if (res.error != 0) {
+          report(paths[i], std::strerror(res.error));
+          status = 1;
+          return;
+        }
+        write_line(res.digest, paths[i]);
+      });
+      out.flush();
+      return status;
+    }
+
+    int check(const std::string& list) {
+      std::vector<std::string> names, expected;
+      // line numbers of malformed lines for -w, and how many good lines
+      // came before each, so that the warnings go out where the lines were
+      std::vector<std::pair<size_t, size_t>> bad;
+      size_t bad_lines = 0;
+      bool read_error  = false;
+
+      int fd = STDIN_FILENO;
+      if (list != "-") {
+        fd = open(list.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+          report(list, std::strerror(errno));
+          return 1;
+        }
+      }
+      try {
+        coreutils::line_reader lines(fd);
+        std::string_view line;
+        for (size_t number = 1; lines.next(line); ++number) {
+          std::string name, digest;
+          if (parse_line(line, name, digest)) {
+            names.push_back(std::move(name));
+            expected.push_back(std::move(digest));
+            continue;
+          }
+          ++bad_lines;
+          if (config.warn) bad.emplace_back(names.size(), number);
+        }
+      }
+      catch (const std::system_error& e) {
+        report(list, e.code().message());
+        read_error = true;
+      }
+      if (fd != STDIN_FILENO) close(fd);
+      if (read_error) return 1;
+
+      size_t next_bad  = 0;
+      auto warn_before = [&](size_t good) {
+        for (; next_bad < bad.size() && bad[next_bad].first <= good;
+             ++next_bad) {
+          out.flush();
+          std::cerr << fmt::format(
+            "{}: {}: {}: improperly formatted SHA256 checksum line\n", argv0,
+            list, bad[next_bad].second);
+        }
+      };
+
+      if (names.empty()) {
+        warn_before(0);
+        report(list, "no properly formatted checksum lines found");
+        return 1;
+      }
+
+      size_t unreadable = 0, mismatched = 0;
+      hash_all(names, config.algo, [&](size_t i, file_hash res) {
+        warn_before(i);
+        if (res.error != 0) {
+          ++unreadable;
+          report(names[i], std::strerror(res.error));
+          write_verdict(names[i], "FAILED open or read"sv);
+        }
+        else if (res.digest != expected[i]) {
+          ++mismatched;
+          write_verdict(names[i], "FAILED"sv);
+        }
+        else if (!config.quiet) {
+          write_verdict(names[i], "OK"sv);
+        }
+      });
+      warn_before(names.size());
+      out.flush();
+
+      if (!config.status) {
+        if (bad_lines > 0) {
+          warn(
+            bad_lines, "line is improperly formatted",
+            "lines are improperly formatted");
+        }
+        if (unreadable > 0) {
+          warn(
+            unreadable, "listed file could not be read",
+            "listed files could not be read");
+        }
+        if (mismatched > 0) {
+          warn(
+            mismatched, "computed checksum did NOT match",
+            "computed checksums did NOT match");
+        }
+      }
+      bool failed =
+        unreadable > 0 || mismatched > 0 || (config.strict && bad_lines > 0);
+      return failed ? 1 : 0;
+    }
+
+  private:
+    void report(std::string_view path, std::string_view msg) {
+      out.flush();
+      std::cerr << fmt::format("{}: {}: {}\n", argv0, path, msg);
+    }
+
+    void warn(size_t n, std::string_view one, std::string_view many) {
+      std::cerr << fmt::format(
+        "{}: WARNING: {} {}\n", argv0, n, n == 1 ? one : many);
+    }
+
+    void write_line(std::string_view digest, std::string_view path) {
+      char end = config.zero ? '\0' : '\n';
+      if (config.algo == algorithm::crc) {
+        out.write(digest);
+        if (!config.implicit) {
+          out.put(' ');
+          out.write(path);
+        }
+        out.put(end);
+        return;
+      }
+
+      bool escape = !config.zero && needs_escape(path);
+      if (escape) out.put('\\');
+      if (config.tagged) {
+        out.write("SHA256 ("sv);
+        write_name(path, escape);
+        out.write(") = "sv);
+        out.write(digest);
+      }
+      else {
+        out.write(digest);
+        out.put(' ');
+        out.put(config.binary ? '*' : ' ');
+        write_name(path, escape);
+      }
+      out.put(end);
+    }
+
+    void write_name(std::string_view name, bool escape) {
+      if (!escape) {
+        out.write(name);
+        return;
+      }
+      for (char c : name) {
+        if (c == '\\')
+          out.write("\\\\"sv);
+        else if (c == '\n')
+          out.write("\\n"sv);
+        else
+          out.put(c);
+      }
+    }
+
+    void write_verdict(std::string_view name, std::string_view verdict) {
+      if (config.status) return;
+      // unlike in checksum lines, only a newline needs escaping here
+      bool escape = name.find('\n') != std::string_view::npos;
+      if (escape) out.put('\\');
+      write_name(name, escape);
+      out.write(": "sv);
+      out.write(verdict);
+      out.put('\n');
+    }
+
+    // Accepts "DIGEST  NAME", "DIGEST *NAME" and "SHA256 (NAME) = DIGEST",
+    // each optionally escaped.
+    static bool parse_line(
+      std::string_view line, std::string& name, std::string& digest) {
+      bool escaped = !line.empty() && line[0] == '\\';
+      if (escaped) line.remove_prefix(1);
+
+      std::string_view raw_name, raw_digest;
+      if (line.starts_with("SHA256 ("sv)) {
+        size_t close = line.rfind(") = "sv);
+        if (close == std::string_view::npos || close < 8) return false;
+        raw_name   = line.substr(8, close - 8);
+        raw_digest = line.substr(close + 4);
+      }
+      else {
+        if (line.size() < 66 || line[64] != ' ') return false;
+        raw_digest = line.substr(0, 64);
+        size_t start = (line[65] == ' ' || line[65] == '*') ? 66 : 65;
+        raw_name     = line.substr(start);
+      }
+      if (raw_digest.size() != 64 || raw_name.empty()) return false;
+
+      digest.clear();
+      for (char c : raw_digest) {
+        if (c >= 'A' && c <= 'F') c += 'a' - 'A';
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+        digest.push_back(c);
+      }
+      name = escaped ? unescape_name(raw_name) : std::string(raw_name);
+      return true;
+    }
+
+    const option_data& config;
+    const char* argv0;
+    coreutils::output_buffer out;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  checksummer sum(config, argv[0]);
+
+  try {
+    if (!config.check) return sum.print(config.paths);
+
+    int status = 0;
+    for (const auto& list : config.paths)
+      status |= sum.check(list);
+    return status;
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.code().message());
+    return 1;
+  }
+}
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/split.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] FILE1 FILE2
+   or: {0} --help
+Compares two sorted files line by line. Writes three columns: lines only in
+FILE1, lines only in FILE2, and lines in both. When FILE1 or FILE2 is -,
+reads standard input. Lines are compared byte by byte.
+
+Options:
+  -1                    do not write lines only in FILE1
+  -2                    do not write lines only in FILE2
+  -3                    do not write lines in both files
+  -z                    lines end with NUL, not newline
+  --check-order         fail as soon as an input is found to be out of order
+  --nocheck-order       do not check that the inputs are sorted
+  --output-delimiter S  separate columns with S instead of a tab
+  --total               finish with the number of lines in each column
+
+  --help                print this help page and exit
+
+By default, the order of the inputs is checked once a line has been found
+that is only in one of them; if they are out of order, that is reported and
+the exit status is 1.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string> paths;
+  std::string delimiter = "\t";
+
+  enum class order_check { normal, strict, none };
+  order_check check = order_check::normal;
+
+  bool hide[3] = {false, false, false};
+  bool zero_terminated : 1 = false;
+  bool total : 1           = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  using check = option_data::order_check;
+  option_data data;
+
+  // the column flags are usually given together (-12), so such groups are
+  // split up first
+  std::vector<const char*> args;
+  for (int i = 0; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool group           = i > 0 && arg.size() > 2 && arg[0] == '-' &&
+      arg.find_first_not_of("123z", 1) == std::string_view::npos;
+    if (!group) {
+      args.push_back(argv[i]);
+      continue;
+    }
+    for (char c : arg.substr(1)) {
+      static const char* const flags[] = {"-1", "-2", "-3", "-z"};
+      args.push_back(flags[c == 'z' ? 3 : c - '1']);
+    }
+  }
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-1", 0>([&] { data.hide[0] = true; }),
+    option<"-2", 0>([&] { data.hide[1] = true; }),
+    option<"-3", 0>([&] { data.hide[2] = true; }),
+    option<"-z", 0>([&] { data.zero_terminated = true; }),
+    option<"--check-order", 0>([&] { data.check = check::strict; }),
+    option<"--nocheck-order", 0>([&] { data.check = check::none; }),
+    option<"--output-delimiter", 1>([&](std::string_view arg) {
+      // an empty delimiter stands for NUL
+      data.delimiter = arg.empty() ? std::string(1, '\0') : std::string(arg);
+    }),
+    option<"--total", 0>([&] { data.total = true; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(int(args.size()), args.data());
+
+  if (data.paths.empty()) fail(argv[0], "missing operand");
+  if (data.paths.size() == 1)
+    fail(argv[0], fmt::format("missing operand after '{}'", data.paths[0]));
+  if (data.paths.size() > 2)
+    fail(argv[0], fmt::format("extra operand '{}'", data.paths[2]));
+  return data;
+}
+
+namespace {
+  // Byte order, as in the C locale: the shorter of two lines that agree up
+  // to its length sorts first.
+  int compare(std::string_view a, std::string_view b) {
+    size_t len = std::min(a.size(), b.size());
+    int res    = len ? std::memcmp(a.data(), b.data(), len) : 0;
+    if (res != 0) return res;
+    return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+  }
+
+  // Merges the two inputs in one pass. Both are read with line_reader, whose
+  // lines are views into its buffer and stay valid for one more line: just
+  // what is needed to compare each line with the other input's current line
+  // and with its own predecessor. Nothing is copied but the output.
+  class comm {
+  public:
+    comm(const option_data& config, const char* argv0) :
+      config(config),
+      argv0(argv0),
+      terminator(config.zero_terminated ? '\0' : '\n') {
+      // the delimiters in front of each column
+      for (size_t col = 0, shown = 0; col < 3; ++col) {
+        for (size_t i = 0; i < shown; ++i)
+          prefix[col] += config.delimiter;
+        if (!config.hide[col]) ++shown;
+      }
+    }
+
+    int run(int fd1, int fd2) {
+      input in[2] = {input(fd1, terminator), input(fd2, terminator)};
+      advance(in[0], 0);
+      advance(in[1], 1);
+      while (in[0].has || in[1].has) {
+        int cmp = !in[0].has ? 1 :
+          !in[1].has         ? -1 :
+                               compare(in[0].line, in[1].line);
+        if (cmp < 0) {
+          seen_unpairable = true;
+          emit(0, in[0].line);
+          advance(in[0], 0);
+        }
+        else if (cmp > 0) {
+          seen_unpairable = true;
+          emit(1, in[1].line);
+          advance(in[1], 1);
+        }
+        else {
+          emit(2, in[0].line);
+          advance(in[0], 0);
+          advance(in[1], 1);
+        }
+      }
+
+      if (config.total) {
+        out.format(
+          "{}{}{}{}{}{}total", counts[0], config.delimiter, counts[1],
+          config.delimiter, counts[2], config.delimiter);
+        out.put(terminator);
+      }
+      out.flush();
+      if (disordered) {
+        std::cerr << fmt::format("{}: input is not in sorted order\n", argv0);
+        return 1;
+      }
+      return 0;
+    }
+
+  private:
+    struct input {
+      input(int fd, char terminator) : reader(fd, terminator) {}
+
+      coreutils::line_reader reader;
+      std::string_view line;
+      bool has        = false;
+      bool disordered = false;
+    };
+
+    void advance(input& in, size_t n) {
+      std::string_view prev = in.line;
+      bool had              = in.has;
+      in.has                = in.reader.next(in.line);
+      if (!had || !in.has || in.disordered ||
+          config.check == option_data::order_check::none)
+        return;
+      if (config.check == option_data::order_check::normal && !seen_unpairable)
+        return;
+      if (compare(prev, in.line) > 0) {
+        out.flush();
+        std::cerr << fmt::format(
+          "{}: file {} is not in sorted order\n", argv0, n + 1);
+        if (config.check == option_data::order_check::strict) exit(1);
+        in.disordered = true;
+        disordered    = true;
+      }
+    }
+
+    void emit(size_t col, std::string_view line) {
+      ++counts[col];
+      if (config.hide[col]) return;
+      out.write(prefix[col]);
+      out.write(line);
+      out.put(terminator);
+    }
+
+    const option_data& config;
+    const char* argv0;
+    char terminator;
+    coreutils::output_buffer out;
+    std::string prefix[3];
+    size_t counts[3]     = {0, 0, 0};
+    bool seen_unpairable = false;
+    bool disordered      = false;
+  };
+
+  int open_input(const char* argv0, const std::string& path) {
+    if (path == "-") return STDIN_FILENO;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      std::cerr << fmt::format(
+        "{}: {}: {}\n", argv0, path, std::strerror(errno));
+      exit(1);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+  }
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  int fd1     = open_input(argv[0], config.paths[0]);
+  int fd2     = open_input(argv[0], config.paths[1]);
+
+  try {
+    return comm(config, argv[0]).run(fd1, fd2);
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.code().message());
+    return 1;
+  }
+}
@@ -0,0 +1,738 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/thread_pool.hpp"
+#include "details/uring.hpp"
+#include "details/walker.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: cp [OPTIONS...] SOURCE DEST
+   or: cp [OPTIONS...] SOURCE... DIRECTORY
+
+Copies SOURCE to DEST, or each SOURCE into DIRECTORY.
+
+Options:
+  -a      archive mode: same as -R -p, and never follow symlinks
+  -p      preserve mode, ownership and timestamps
+  -R, -r  copy directories recursively
+
+  --reflink=auto
+          share data blocks with the source where the file system supports
+          it, otherwise copy normally (default)
+  --reflink=always
+          fail if data blocks cannot be shared
+  --reflink=never
+          always copy data
+  --help  print this help page and exit
+
+Directory trees are copied in parallel. Symlinks inside copied trees are
+copied as symlinks.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  enum class reflink { never, automatic, always };
+
+  std::vector<std::string> paths;
+
+  bool recursive : 1 = false;
+  bool preserve : 1  = false;
+  bool no_deref : 1  = false;
+
+  reflink reflink_bhv = reflink::automatic;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-a", 0>([&] {
+      data.recursive = true;
+      data.preserve  = true;
+      data.no_deref  = true;
+    }),
+    option<"-p", 0>([&] { data.preserve = true; }),
+    option<"-R", 0>([&] { data.recursive = true; }),
+    option<"-r", 0>([&] { data.recursive = true; }),
+    option<"--reflink=auto", 0>(
+      [&] { data.reflink_bhv = option_data::reflink::automatic; }),
+    option<"--reflink=always", 0>(
+      [&] { data.reflink_bhv = option_data::reflink::always; }),
+    option<"--reflink=never", 0>(
+      [&] { data.reflink_bhv = option_data::reflink::never; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+  return data;
+}
+
+namespace {
+  namespace walk = coreutils::walk;
+
+  constexpr unsigned cp_stat_mask = STATX_TYPE | STATX_MODE | STATX_UID |
+    STATX_GID | STATX_ATIME | STATX_MTIME | STATX_SIZE | STATX_INO;
+
+  // regular files in one directory are split into tasks of this many files
+  constexpr size_t files_per_task = 32;
+
+  // io_uring pipeline: buffers in flight and size of each
+  constexpr unsigned uring_depth   = 8;
+  constexpr size_t uring_block     = 256 * 1024;
+  constexpr size_t copy_range_step = size_t(1) << 30;
+
+  // Source and destination directories that files are copied between, open
+  // for as long as one callback or task needs them.
+  struct dir_pair {
+    int src = AT_FDCWD;
+    int dst = AT_FDCWD;
+    std::string src_path;
+    std::string dst_path;
+
+    dir_pair() = default;
+    dir_pair(const dir_pair&) = delete;
+    ~dir_pair() {
+      if (src >= 0) close(src);
+      if (dst >= 0) close(dst);
+    }
+
+    std::string src_name(std::string_view name) const {
+      return join(src_path, name);
+    }
+    std::string dst_name(std::string_view name) const {
+      return join(dst_path, name);
+    }
+
+    static std::string join(std::string_view dir, std::string_view name) {
+      if (dir.empty()) return std::string(name);
+      std::string res(dir);
+      if (res.back() != '/') res.push_back('/');
+      res.append(name);
+      return res;
+    }
+  };
+
+  struct file_job {
+    std::string name;
+    struct statx stat;
+  };
+
+  // metadata applied after all data has been written
+  struct meta_update {
+    std::string path;
+    struct statx stat;
+  };
+
+  struct timespec_pair {
+    struct timespec times[2];
+  };
+
+  timespec_pair stat_times(const struct statx& stx) {
+    return {{
+      {stx.stx_atime.tv_sec, long(stx.stx_atime.tv_nsec)},
+      {stx.stx_mtime.tv_sec, long(stx.stx_mtime.tv_nsec)},
+    }};
+  }
+
+  bool read_write_copy(int in, int out) {
+    std::unique_ptr<char[]> buffer(new char[uring_block]);
+    for (;;) {
+      ssize_t n = read(in, buffer.get(), uring_block);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      if (n == 0) return true;
+      for (ssize_t done = 0; done < n;) {
+        ssize_t m = write(out, buffer.get() + done, size_t(n - done));
+        if (m < 0) {
+          if (errno == EINTR) continue;
+          return false;
+        }
+        done += m;
+      }
+    }
+  }
+
+  // Copies `size` bytes with a ring of buffers: each buffer is read into and
+  // then written out at the same offset, so reads and writes of different
+  // blocks overlap without any threads.
+  bool uring_copy(int in, int out, uint64_t size) {
+    struct slot {
+      uint64_t start = 0;
+      uint64_t end   = 0;
+      size_t filled  = 0;
+      size_t written = 0;
+      bool writing   = false;
+      std::unique_ptr<char[]> buffer;
+    };
+    // declared before the ring, so that the ring goes first
+    std::vector<slot> slots(uring_depth);
+    std::unique_ptr<coreutils::uring> ring;
+    try {
+      ring = std::make_unique<coreutils::uring>(uring_depth * 2);
+    }
+    catch (const std::system_error&) {
+      return read_write_copy(in, out);
+    }
+
+    uint64_t next    = 0;
+    size_t in_flight = 0;
+    int error        = 0;
+
+    auto queue_read = [&](size_t i) {
+      auto& s  = slots[i];
+      auto sqe = ring->get_sqe();
+      sqe->opcode    = IORING_OP_READ;
+      sqe->fd        = in;
+      sqe->addr      = reinterpret_cast<uint64_t>(s.buffer.get() + s.filled);
+      sqe->len       = unsigned(s.end - s.start - s.filled);
+      sqe->off       = s.start + s.filled;
+      sqe->user_data = i;
+      s.writing      = false;
+      ++in_flight;
+    };
+    auto queue_write = [&](size_t i) {
+      auto& s  = slots[i];
+      auto sqe = ring->get_sqe();
+      sqe->opcode    = IORING_OP_WRITE;
+      sqe->fd        = out;
+      sqe->addr      = reinterpret_cast<uint64_t>(s.buffer.get() + s.written);
+      sqe->len       = unsigned(s.filled - s.written);
+      sqe->off       = s.start + s.written;
+      sqe->user_data = i;
+      s.writing      = true;
+      ++in_flight;
+    };
+    auto next_block = [&](size_t i) {
+      if (next >= size) return;
+      auto& s   = slots[i];
+      s.start   = next;
+      s.end     = std::min<uint64_t>(next + uring_block, size);
+      s.filled  = 0;
+      s.written = 0;
+      next      = s.end;
+      queue_read(i);
+    };
+
+    for (size_t i = 0; i < slots.size(); ++i) {
+      slots[i].buffer.reset(new char[uring_block]);
+      next_block(i);
+    }
+
+    // After an error nothing new is queued, but every request in flight is
+    // still waited for: the kernel may write into the buffers until then.
+    while (in_flight > 0) {
+      if (!ring->submit(1) && errno != EAGAIN && errno != EBUSY) {
+        // the requests can no longer be waited for, so their buffers are
+        // left to them rather than freed
+        for (auto& s : slots)
+          static_cast<void>(s.buffer.release());
+        return false;
+      }
+      io_uring_cqe cqe;
+      while (ring->pop_cqe(cqe)) {
+        --in_flight;
+        size_t i = size_t(cqe.user_data);
+        auto& s  = slots[i];
+        if (error != 0) continue;
+        if (cqe.res < 0) {
+          error = -cqe.res;
+          continue;
+        }
+        if (!s.writing) {
+          // end of file came early: the file shrank while being copied
+          if (cqe.res == 0) s.end = s.start + s.filled;
+          s.filled += size_t(cqe.res);
+          if (s.filled < s.end - s.start)
+            queue_read(i);
+          else if (s.filled > 0)
+            queue_write(i);
+          else
+            next_block(i);
+        }
+        else {
+          s.written += size_t(cqe.res);
+          if (s.written < s.filled)
+            queue_write(i);
+          else
+            next_block(i);
+        }
+      }
+    }
+    if (error != 0) {
+      errno = error;
+      return false;
+    }
+    return true;
+  }
+
+  bool is_unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTTY || err == EXDEV ||
+      err == EINVAL || err == ENOSYS || err == EBADF;
+  }
+
+  // Copies file data, trying the cheapest method first.
+  bool copy_data(
+    int in, int out, const struct statx& stx, option_data::reflink mode) {
+    if (mode != option_data::reflink::never) {
+      if (ioctl(out, FICLONE, in) == 0) return true;
+      if (mode == option_data::reflink::always || !is_unsupported(errno))
+        return false;
+    }
+
+    // files like those in /proc report a size of 0 but still have data
+    if (stx.stx_size == 0) return read_write_copy(in, out);
+
+    uint64_t copied = 0;
+    while (copied < stx.stx_size) {
+      ssize_t n = copy_file_range(
+        in, nullptr, out, nullptr,
+        std::min<uint64_t>(stx.stx_size - copied, copy_range_step), 0);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (copied == 0 && is_unsupported(errno))
+          return uring_copy(in, out, stx.stx_size);
+        return false;
+      }
+      if (n == 0) break;
+      copied += uint64_t(n);
+    }
+    return true;
+  }
+
+  class copier {
+  public:
+    copier(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {
+      file_mask = umask(0);
+      umask(file_mask);
+    }
+
+    void report(std::string_view what, std::string_view path, int err) {
+      std::lock_guard guard(err_lock);
+      std::cerr << fmt::format(
+        "{}: {} '{}': {}\n", argv0, what, path, std::strerror(err));
+      status = 1;
+    }
+
+    void report(std::string_view msg) {
+      std::lock_guard guard(err_lock);
+      std::cerr << fmt::format("{}: {}\n", argv0, msg);
+      status = 1;
+    }
+
+    bool open_src(dir_pair& dirs) {
+      dirs.src = open(
+        dirs.src_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirs.src < 0) report("cannot open directory", dirs.src_path, errno);
+      return dirs.src >= 0;
+    }
+
+    bool open_dst(dir_pair& dirs) {
+      dirs.dst = open(
+        dirs.dst_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (dirs.dst < 0) report("cannot open directory", dirs.dst_path, errno);
+      return dirs.dst >= 0;
+    }
+
+    void copy_file(
+      const dir_pair& dirs, const std::string& src_name,
+      const std::string& dst_name, const struct statx& stx) {
+      // opening the destination truncates it, which must not happen to the
+      // source itself
+      struct stat dst_st;
+      if (fstatat(dirs.dst, dst_name.c_str(), &dst_st, 0) == 0 &&
+          dst_st.st_dev == makedev(stx.stx_dev_major, stx.stx_dev_minor) &&
+          dst_st.st_ino == stx.stx_ino) {
+        report(fmt::format(
+          "'{}' and '{}' are the same file", dirs.src_name(src_name),
+          dirs.dst_name(dst_name)));
+        return;
+      }
+      int in = openat(dirs.src, src_name.c_str(), O_RDONLY | O_CLOEXEC);
+      if (in < 0) {
+        report("cannot open", dirs.src_name(src_name), errno);
+        return;
+      }
+      int out = openat(
+        dirs.dst, dst_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        stx.stx_mode & 0777);
+      if (out < 0) {
+        report("cannot create", dirs.dst_name(dst_name), errno);
+        close(in);
+        return;
+      }
+
+      if (!copy_data(in, out, stx, config.reflink_bhv)) {
+        report("error copying to", dirs.dst_name(dst_name), errno);
+      }
+      else if (config.preserve) {
+        // while the file is open this needs no path lookups at all
+        if (fchown(out, stx.stx_uid, stx.stx_gid) != 0 && errno != EPERM)
+          report("cannot preserve ownership of", dirs.dst_name(dst_name), errno);
+        if (fchmod(out, stx.stx_mode & 07777) != 0)
+          report("cannot preserve mode of", dirs.dst_name(dst_name), errno);
+        auto times = stat_times(stx);
+        if (futimens(out, times.times) != 0)
+          report("cannot preserve times of", dirs.dst_name(dst_name), errno);
+      }
+      close(out);
+      close(in);
+    }
+
+    // Recreates a symlink, FIFO, socket or device node.
+    void copy_special(
+      const dir_pair& dirs, const std::string& src_name,
+      const std::string& dst_name, const struct statx& stx) {
+      int res;
+      if (S_ISLNK(stx.stx_mode)) {
+        std::string target(stx.stx_size ? stx.stx_size : PATH_MAX, '\0');
+        ssize_t len = readlinkat(
+          dirs.src, src_name.c_str(), target.data(), target.size());
+        if (len < 0) {
+          report("cannot read symlink", dirs.src_name(src_name), errno);
+          return;
+        }
+        target.resize(size_t(len));
+        res = symlinkat(target.c_str(), dirs.dst, dst_name.c_str());
+        if (res != 0 && errno == EEXIST) {
+          unlinkat(dirs.dst, dst_name.c_str(), 0);
+          res = symlinkat(target.c_str(), dirs.dst, dst_name.c_str());
+        }
+      }
+      else {
+        res = mknodat(
+          dirs.dst, dst_name.c_str(), stx.stx_mode & (S_IFMT | 07777),
+          makedev(stx.stx_rdev_major, stx.stx_rdev_minor));
+      }
+
+      if (res != 0) {
+        report("cannot create", dirs.dst_name(dst_name), errno);
+        return;
+      }
+      if (config.preserve) add_meta(dirs.dst_name(dst_name), stx);
+    }
+
+    void add_meta(std::string path, const struct statx& stx) {
+      std::lock_guard guard(meta_lock);
+      meta.push_back({std::move(path), stx});
+    }
+
+    // Applies ownership, mode and times of directories (and symlinks) in one
+    // pass once everything below them has been written, since creating
+    // entries would change their timestamps again.
+    void apply_meta(coreutils::thread_pool& pool) {
+      constexpr size_t batch = 256;
+      for (size_t i = 0; i < meta.size(); i += batch) {
+        pool.submit([this, i] {
+          size_t end = std::min(i + batch, meta.size());
+          for (size_t j = i; j < end; ++j)
+            apply_one(meta[j]);
+        });
+      }
+      pool.wait();
+    }
+
+    bool prepare_dir(const std::string& dst, const struct statx& stx) {
+      // make sure the directory is writable until its contents are copied
+      if (mkdir(dst.c_str(), (stx.stx_mode & 07777) | S_IRWXU) != 0) {
+        struct stat st;
+        if (errno != EEXIST || stat(dst.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+          report("cannot create directory", dst, errno);
+          return false;
+        }
+        // merging into an existing directory: leave its mode alone
+        if (!config.preserve) return true;
+      }
+      add_meta(dst, stx);
+      return true;
+    }
+
+    const option_data& config;
+    int status = 0;
+
+  private:
+    void apply_one(const meta_update& m) {
+      const auto& stx = m.stat;
+      const char* path = m.path.c_str();
+      bool is_link     = S_ISLNK(stx.stx_mode);
+      if (config.preserve) {
+        if (fchownat(AT_FDCWD, path, stx.stx_uid, stx.stx_gid,
+                     AT_SYMLINK_NOFOLLOW) != 0 && errno != EPERM)
+          report("cannot preserve ownership of", m.path, errno);
+      }
+      if (!is_link) {
+        mode_t mode = config.preserve ?
+          (stx.stx_mode & 07777) :
+          (stx.stx_mode & 07777 & ~file_mask);
+        if (fchmodat(AT_FDCWD, path, mode, 0) != 0)
+          report("cannot set mode of", m.path, errno);
+      }
+      if (config.preserve) {
+        auto times = stat_times(stx);
+        if (utimensat(AT_FDCWD, path, times.times, AT_SYMLINK_NOFOLLOW) != 0)
+          report("cannot preserve times of", m.path, errno);
+      }
+    }
+
+    const char* argv0;
+    mode_t file_mask;
+    std::mutex err_lock;
+    std::mutex meta_lock;
+    std::vector<meta_update> meta;
+  };
+
+  std::string_view base_name(std::string_view path) {
+    while (path.size() > 1 && path.back() == '/')
+      path.remove_suffix(1);
+    auto pos = path.rfind('/');
+    return (pos == std::string_view::npos || path.size() == 1) ?
+      path :
+      path.substr(pos + 1);
+  }
+
+  std::string strip_slashes(std::string path) {
+    while (path.size() > 1 && path.back() == '/')
+      path.pop_back();
+    return path;
+  }
+
+  // Whether dst, or the directory it would be created in, lies inside the
+  // directory src: whether src is one of its ancestors.
+  bool inside(const struct statx& src, const std::string& dst) {
+    int fd = open(dst.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      auto pos = dst.rfind('/');
+      std::string parent = pos == std::string::npos ? "." :
+        pos == 0                                    ? "/" :
+                                                      dst.substr(0, pos);
+      fd = open(parent.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+      if (fd < 0) return false;
+    }
+
+    dev_t src_dev = makedev(src.stx_dev_major, src.stx_dev_minor);
+    bool found    = false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) st.st_ino = 0;
+    while (st.st_ino != 0) {
+      if (st.st_dev == src_dev && st.st_ino == src.stx_ino) {
+        found = true;
+        break;
+      }
+      int up = openat(fd, "..", O_PATH | O_DIRECTORY | O_CLOEXEC);
+      struct stat up_st;
+      if (up < 0 || fstat(up, &up_st) != 0) {
+        if (up >= 0) close(up);
+        break;
+      }
+      close(fd);
+      fd = up;
+      // the root is its own parent
+      if (up_st.st_dev == st.st_dev && up_st.st_ino == st.st_ino) break;
+      st = up_st;
+    }
+    close(fd);
+    return found;
+  }
+
+  // lets more directories be open at once on wide trees
+  void raise_fd_limit() {
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+      lim.rlim_cur = lim.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &lim);
+    }
+  }
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  if (config.paths.size() < 2) {
+    std::cerr << fmt::format(
+      "{}: missing operand\nTry '{} --help' for more information.\n", argv[0],
+      argv[0]);
+    return 1;
+  }
+  raise_fd_limit();
+
+  std::string dest = config.paths.back();
+  config.paths.pop_back();
+
+  struct stat dest_st;
+  bool dest_is_dir = stat(dest.c_str(), &dest_st) == 0 && S_ISDIR(dest_st.st_mode);
+  if (config.paths.size() > 1 && !dest_is_dir) {
+    std::cerr << fmt::format(
+      "{}: target '{}' is not a directory\n", argv[0], dest);
+    return 1;
+  }
+
+  coreutils::thread_pool pool;
+  copier cp(config, argv[0]);
+
+  // destination of each source tree, keyed by the root path of its walk
+  std::unordered_map<std::string, std::string> dest_roots;
+  auto dest_path = [&](const walk::node& dir) {
+    const walk::node* root = &dir;
+    while (root->parent)
+      root = root->parent;
+    std::string res = dest_roots.at(root->path);
+    std::string_view suffix = std::string_view(dir.path).substr(root->path.size());
+    if (!suffix.empty() && suffix.front() != '/') res.push_back('/');
+    res.append(suffix);
+    return res;
+  };
+
+  walk::options walk_opts;
+  walk_opts.stat_mask    = cp_stat_mask;
+  walk_opts.retain_depth = 0;
+  walk_opts.keep_entries = false;
+
+  walk::walker walker(walk_opts);
+  walker.on_error = [&](const walk::node& dir) {
+    cp.report("cannot read directory", dir.path, dir.error);
+  };
+  walker.on_directory = [&](walk::node& dir) {
+    dir_pair dirs;
+    dirs.src_path = dir.path;
+    dirs.dst_path = dest_path(dir);
+
+    // Subdirectories are only walked after this callback returns, so every
+    // directory exists before anything inside it is created.
+    if (dir.depth > 0 && !cp.prepare_dir(dirs.dst_path, dir.stat)) {
+      for (auto& e : dir.entries)
+        e.descend = false;
+      return;
+    }
+    if (dir.error != 0) return;
+
+    // these descriptors only live as long as this callback
+    dirs.src = dup(dir.fd);
+    if (dirs.src < 0 || !cp.open_dst(dirs)) {
+      if (dirs.src < 0)
+        cp.report("cannot open directory", dirs.src_path, errno);
+      for (auto& e : dir.entries)
+        e.descend = false;
+      return;
+    }
+
+    // Queued batches only hold the paths and open the directories when
+    // they run. They wait behind the subdirectories, so descriptors held
+    // for them would pile up with the depth of the tree.
+    std::vector<file_job> batch;
+    auto flush_batch = [&] {
+      if (batch.empty()) return;
+      pool.submit([&cp, src_path = dirs.src_path, dst_path = dirs.dst_path,
+                   jobs = std::move(batch)] {
+        dir_pair task_dirs;
+        task_dirs.src_path = src_path;
+        task_dirs.dst_path = dst_path;
+        if (!cp.open_src(task_dirs) || !cp.open_dst(task_dirs)) return;
+        for (auto& job : jobs)
+          cp.copy_file(task_dirs, job.name, job.name, job.stat);
+      });
+      batch.clear();
+    };
+
+    for (auto& e : dir.entries) {
+      if (e.descend) continue;
+      if (!e.has_stat && !walk::walker::stat_entry(dir, e, cp_stat_mask)) {
+        cp.report("cannot access", dir.child_path(e.name), errno);
+        continue;
+      }
+      if (S_ISREG(e.stat.stx_mode)) {
+        batch.push_back({std::move(e.name), e.stat});
+        if (batch.size() == files_per_task) flush_batch();
+      }
+      else if (!S_ISDIR(e.stat.stx_mode)) {
+        cp.copy_special(dirs, e.name, e.name, e.stat);
+      }
+    }
+    flush_batch();
+  };
+
+  // Every walk's destination is known before the first walk starts, since
+  // the workers look them up.
+  struct tree_root {
+    std::string path;
+    struct statx stat;
+  };
+  std::vector<tree_root> roots;
+  auto top_dirs = std::make_shared<dir_pair>();
+  for (const auto& src : config.paths) {
+    std::string dst = dest_is_dir ?
+      dir_pair::join(dest, base_name(src)) :
+      dest;
+
+    struct statx stx;
+    int flags = AT_NO_AUTOMOUNT |
+      ((config.recursive || config.no_deref) ? AT_SYMLINK_NOFOLLOW : 0);
+    if (statx(AT_FDCWD, src.c_str(), flags, cp_stat_mask, &stx) != 0) {
+      cp.report("cannot stat", src, errno);
+      continue;
+    }
+
+    if (S_ISDIR(stx.stx_mode)) {
+      if (!config.recursive) {
+        cp.report(
+          fmt::format("-r not specified; omitting directory '{}'", src));
+        continue;
+      }
+      if (inside(stx, dst)) {
+        cp.report(fmt::format(
+          "cannot copy a directory, '{}', into itself, '{}'", src, dst));
+        continue;
+      }
+      if (!cp.prepare_dir(dst, stx)) continue;
+      std::string root = strip_slashes(src);
+      if (dest_roots.emplace(root, dst).second)
+        roots.push_back({std::move(root), stx});
+    }
+    else if (S_ISREG(stx.stx_mode)) {
+      pool.submit([&cp, top_dirs, src, dst, stx] {
+        cp.copy_file(*top_dirs, src, dst, stx);
+      });
+    }
+    else {
+      cp.copy_special(*top_dirs, src, dst, stx);
+    }
+  }
+
+  std::vector<std::unique_ptr<walk::node>> trees;
+  for (const auto& root : roots)
+    trees.push_back(walker.start(pool, root.path, root.stat));
+  pool.wait();
+  cp.apply_meta(pool);
+  return cp.status;
+}
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/split.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} OPTION... [FILES...]
+   or: {0} --help
+Writes the selected parts of each line of each FILE to standard output. With
+no FILES, or when FILE is -, reads standard input.
+
+Options:
+  -b LIST   select only these bytes
+  -c LIST   select only these characters (the same as -b)
+  -d DELIM  use DELIM instead of TAB to separate fields
+  -f LIST   select only these fields; lines without any delimiter are
+            written whole, unless -s is given
+  -n        ignored
+  -s        skip lines without any delimiter
+  -z        lines end with NUL, not newline
+
+  --complement
+            select everything except what LIST selects
+  --output-delimiter STRING
+            separate output fields (or, with -b and -c, ranges) with STRING;
+            the default is the input delimiter
+
+  --help    print this help page and exit
+
+LIST is made up of ranges separated by commas. Each range is one of N, N-M,
+N- (from N to the end) and -M (from the first to M), counting from 1.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  enum class list_mode { none, bytes, fields };
+
+  std::vector<std::string> paths;
+  // 1-based, inclusive, sorted and merged
+  std::vector<std::pair<size_t, size_t>> ranges;
+  std::string output_delim;
+
+  list_mode mode            = list_mode::none;
+  char delim                = '\t';
+  bool only_delimited : 1   = false;
+  bool complement : 1       = false;
+  bool zero_terminated : 1  = false;
+  bool has_output_delim : 1 = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+
+  std::vector<std::pair<size_t, size_t>> parse_list(
+    const char* argv0, std::string_view list) {
+    std::vector<std::pair<size_t, size_t>> res;
+    auto number = [&](std::string_view str) {
+      size_t value = 0;
+      auto [ptr, ec] =
+        std::from_chars(str.data(), str.data() + str.size(), value);
+      if (ec != std::errc {} || ptr != str.data() + str.size())
+        fail(argv0, "invalid byte, character or field list");
+      if (value == 0)
+        fail(argv0, "fields and positions are numbered from 1");
+      return value;
+    };
+
+    while (!list.empty()) {
+      size_t comma = list.find(',');
+      auto item    = list.substr(0, comma);
+      list         = comma == std::string_view::npos ? std::string_view() :
+                                                       list.substr(comma + 1);
+
+      size_t dash = item.find('-');
+      if (dash == std::string_view::npos) {
+        size_t n = number(item);
+        res.emplace_back(n, n);
+        continue;
+      }
+      auto lo = item.substr(0, dash), hi = item.substr(dash + 1);
+      if (lo.empty() && hi.empty())
+        fail(argv0, "invalid range with no endpoint: -");
+      size_t first = lo.empty() ? 1 : number(lo);
+      size_t last  = hi.empty() ? SIZE_MAX : number(hi);
+      if (last < first) fail(argv0, "invalid decreasing range");
+      res.emplace_back(first, last);
+    }
+    if (res.empty()) fail(argv0, "invalid byte, character or field list");
+
+    std::sort(res.begin(), res.end());
+    std::vector<std::pair<size_t, size_t>> merged;
+    for (auto r : res) {
+      if (!merged.empty() && (merged.back().second == SIZE_MAX ||
+                              r.first <= merged.back().second + 1))
+        merged.back().second = std::max(merged.back().second, r.second);
+      else
+        merged.push_back(r);
+    }
+    return merged;
+  }
+
+  std::vector<std::pair<size_t, size_t>> complement(
+    const std::vector<std::pair<size_t, size_t>>& ranges) {
+    std::vector<std::pair<size_t, size_t>> res;
+    size_t next = 1;
+    for (auto [first, last] : ranges) {
+      if (first > next) res.emplace_back(next, first - 1);
+      if (last == SIZE_MAX) return res;
+      next = last + 1;
+    }
+    res.emplace_back(next, SIZE_MAX);
+    return res;
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  using mode = option_data::list_mode;
+  auto set_mode = [&](mode mode, std::string_view list) {
+    if (data.mode != mode::none)
+      fail(argv[0], "only one type of list may be specified");
+    data.mode   = mode;
+    data.ranges = parse_list(argv[0], list);
+  };
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-b", 1>(
+      [&](std::string_view arg) { set_mode(mode::bytes, arg); }),
+    option<"-c", 1>(
+      [&](std::string_view arg) { set_mode(mode::bytes, arg); }),
+    option<"-f", 1>(
+      [&](std::string_view arg) { set_mode(mode::fields, arg); }),
+    option<"-d", 1>([&](std::string_view arg) {
+      if (arg.size() != 1)
+        fail(argv[0], "the delimiter must be a single character");
+      data.delim = arg[0];
+    }),
+    option<"-n", 0>([] {}),
+    option<"-s", 0>([&] { data.only_delimited = true; }),
+    option<"-z", 0>([&] { data.zero_terminated = true; }),
+    option<"--complement", 0>([&] { data.complement = true; }),
+    option<"--output-delimiter", 1>([&](std::string_view arg) {
+      data.output_delim     = arg;
+      data.has_output_delim = true;
+    }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+
+  if (data.mode == mode::none)
+    fail(argv[0], "you must specify a list of bytes, characters, or fields");
+  if (data.only_delimited && data.mode != mode::fields) {
+    fail(
+      argv[0],
+      "suppressing non-delimited lines makes sense\n"
+      "\tonly when operating on fields");
+  }
+  if (data.complement) data.ranges = complement(data.ranges);
+  if (!data.has_output_delim) data.output_delim = std::string(1, data.delim);
+  if (data.paths.empty()) data.paths.emplace_back("-");
+  return data;
+}
+
+namespace {
+  class cutter {
+  public:
+    explicit cutter(const option_data& config) :
+      config(config), terminator(config.zero_terminated ? '\0' : '\n') {}
+
+    void cut_bytes(std::string_view line) {
+      bool first = true;
+      for (auto [lo, hi] : config.ranges) {
+        if (lo > line.size()) break;
+        size_t len = std::min(hi, line.size()) - lo + 1;
+        if (!first && config.has_output_delim) out.write(config.output_delim);
+        out.write(line.substr(lo - 1, len));
+        first = false;
+      }
+    }
+
+    void cut_fields(std::string_view line) {
+      coreutils::field_splitter fields(line, config.delim);
+      std::string_view field;
+      fields.next(field);
+      if (!fields.split()) {
+        // no delimiter at all
+        if (config.only_delimited) return;
+        out.write(line);
+        out.put(terminator);
+        return;
+      }
+
+      // fields past the last range are never split off
+      auto range   = config.ranges.begin();
+      size_t index = 1;
+      bool first   = true;
+      for (;;) {
+        if (index >= range->first) {
+          if (!first) out.write(config.output_delim);
+          out.write(field);
+          first = false;
+          if (index == range->second && ++range == config.ranges.end()) break;
+        }
+        if (!fields.next(field)) break;
+        ++index;
+      }
+      out.put(terminator);
+    }
+
+    void cut_file(int fd) {
+      coreutils::line_reader lines(fd, terminator);
+      std::string_view line;
+      while (lines.next(line)) {
+        if (config.mode == option_data::list_mode::bytes) {
+          cut_bytes(line);
+          out.put(terminator);
+        }
+        else {
+          cut_fields(line);
+        }
+      }
+    }
+
+    void flush() { out.flush(); }
+
+  private:
+    const option_data& config;
+    char terminator;
+    coreutils::output_buffer out;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  cutter cut(config);
+
+  int status = 0;
+  for (const auto& path : config.paths) {
+    int fd = STDIN_FILENO;
+    if (path != "-") {
+      fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        cut.flush();
+        std::cerr << fmt::format(
+          "{}: {}: {}\n", argv[0], path, std::strerror(errno));
+        status = 1;
+        continue;
+      }
+    }
+    try {
+      cut.cut_file(fd);
+    }
+    catch (const std::system_error& e) {
+      cut.flush();
+      std::cerr << fmt::format(
+        "{}: {}: {}\n", argv[0], path, e.code().message());
+      status = 1;
+    }
+    if (fd != STDIN_FILENO) close(fd);
+  }
+  return status;
+}
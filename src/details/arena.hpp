@@ -0,0 +1,22 @@
+#ifndef _CXCU_DETAILS_ARENA_HPP_
+#define _CXCU_DETAILS_ARENA_HPP_
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace coreutils {
+  // A monotonic arena for allocations that live until the program exits:
+  // argument tables, operand lists, parsed expressions. Nothing is freed on
+  // its own; all of it goes at once when the arena is destroyed at exit.
+  // The first block is static, so short runs never reach malloc for these.
+  //
+  // Not synchronized: only allocate from the main thread (or before any
+  // worker threads are started).
+  inline std::pmr::memory_resource* arena() {
+    alignas(std::max_align_t) static std::byte initial[16 * 1024];
+    static std::pmr::monotonic_buffer_resource resource(
+      initial, sizeof(initial));
+    return &resource;
+  }
+}  // namespace coreutils
+#endif
@@ -0,0 +1,25 @@
+#ifndef _CXCU_DETAILS_ARGS_HPP_
+#define _CXCU_DETAILS_ARGS_HPP_
+
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+
+#include "arena.hpp"
+
+namespace coreutils {
+  // The command line as string_views over argv, without copying any of the
+  // strings. The table itself lives in the arena. The views end where the
+  // original strings do, so data() is still NUL-terminated.
+  inline std::span<const std::string_view> arg_view(
+    int argc, const char* const* argv) {
+    std::pmr::polymorphic_allocator<std::string_view> alloc(arena());
+    size_t count          = argc > 0 ? size_t(argc) : 0;
+    std::string_view* res = alloc.allocate(count);
+    for (size_t i = 0; i < count; ++i)
+      alloc.construct(res + i, argv[i]);
+    return {res, count};
+  }
+}  // namespace coreutils
+#endif
@@ -0,0 +1,402 @@
+#include "digest.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <immintrin.h>
+
+namespace coreutils {
+  namespace {
+    struct cpu_features {
+      bool pclmul  = false;
+      bool vpclmul = false;
+      bool sha     = false;
+    };
+
+    const cpu_features& cpu() {
+      static const cpu_features features = [] {
+        cpu_features res;
+        __builtin_cpu_init();
+        res.pclmul = __builtin_cpu_supports("pclmul") &&
+          __builtin_cpu_supports("ssse3");
+        res.vpclmul = res.pclmul && __builtin_cpu_supports("vpclmulqdq") &&
+          __builtin_cpu_supports("avx512bw");
+        res.sha = __builtin_cpu_supports("sha") &&
+          __builtin_cpu_supports("sse4.1");
+        return res;
+      }();
+      return features;
+    }
+
+    constexpr uint32_t crc_poly = 0x04C11DB7;
+
+    // tables[k][i] is the CRC of byte i followed by k zero bytes
+    constexpr auto crc_tables = [] {
+      std::array<std::array<uint32_t, 256>, 8> res {};
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i << 24;
+        for (int bit = 0; bit < 8; ++bit)
+          c = (c & 0x80000000) ? (c << 1) ^ crc_poly : c << 1;
+        res[0][i] = c;
+      }
+      for (size_t k = 1; k < 8; ++k) {
+        for (size_t i = 0; i < 256; ++i)
+          res[k][i] = (res[k - 1][i] << 8) ^ res[0][res[k - 1][i] >> 24];
+      }
+      return res;
+    }();
+
+    // x^n mod P, for the folding constants
+    constexpr uint64_t crc_xpow(unsigned n) {
+      uint32_t c = 1;
+      for (unsigned i = 0; i < n; ++i)
+        c = (c & 0x80000000) ? (c << 1) ^ crc_poly : c << 1;
+      return c;
+    }
+
+    uint32_t load_be32(const uint8_t* p) {
+      uint32_t v;
+      std::memcpy(&v, p, 4);
+      return __builtin_bswap32(v);
+    }
+
+    uint32_t crc_scalar(uint32_t crc, const uint8_t* p, size_t n) {
+      const auto& t = crc_tables;
+      for (; n >= 8; p += 8, n -= 8) {
+        uint32_t a = load_be32(p) ^ crc;
+        uint32_t b = load_be32(p + 4);
+        crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xFF] ^ t[5][(a >> 8) & 0xFF] ^
+          t[4][a & 0xFF] ^ t[3][b >> 24] ^ t[2][(b >> 16) & 0xFF] ^
+          t[1][(b >> 8) & 0xFF] ^ t[0][b & 0xFF];
+      }
+      for (; n > 0; ++p, --n)
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p];
+      return crc;
+    }
+
+    // Each 16-byte block is byte-reversed, so that bit i of the register is
+    // the coefficient of x^i. A 128-bit value H * x^64 + L that is followed
+    // by d more bits of data is then congruent to
+    // H * (x^(d + 64) mod P) + L * (x^d mod P), which fits in 96 bits and can
+    // be added to the data it was moved onto.
+    [[gnu::target("pclmul,ssse3")]] inline __m128i crc_fold(
+      __m128i x, __m128i k) {
+      return _mm_xor_si128(
+        _mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+    }
+
+    [[gnu::target("pclmul,ssse3")]] inline __m128i crc_load(
+      const uint8_t* p, __m128i reverse) {
+      return _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), reverse);
+    }
+
+    // Folds the remaining 16-byte blocks onto x, which is congruent to
+    // everything before them, and finishes with the tables.
+    [[gnu::target("pclmul,ssse3")]] uint32_t crc_pclmul_tail(
+      __m128i x, const uint8_t* p, size_t n) {
+      const __m128i reverse =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      const __m128i k128 = _mm_set_epi64x(crc_xpow(192), crc_xpow(128));
+      for (; n >= 16; p += 16, n -= 16)
+        x = _mm_xor_si128(crc_fold(x, k128), crc_load(p, reverse));
+
+      // the CRC of x alone is the running CRC
+      alignas(16) uint8_t rest[16];
+      _mm_store_si128(
+        reinterpret_cast<__m128i*>(rest), _mm_shuffle_epi8(x, reverse));
+      uint32_t crc = crc_scalar(0, rest, 16);
+      return crc_scalar(crc, p, n);
+    }
+
+    [[gnu::target("pclmul,ssse3")]] uint32_t crc_pclmul(
+      uint32_t crc, const uint8_t* p, size_t n) {
+      const __m128i reverse =
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+      const __m128i k512 = _mm_set_epi64x(crc_xpow(576), crc_xpow(512));
+      const __m128i k384 = _mm_set_epi64x(crc_xpow(448), crc_xpow(384));
+      const __m128i k256 = _mm_set_epi64x(crc_xpow(320), crc_xpow(256));
+      const __m128i k128 = _mm_set_epi64x(crc_xpow(192), crc_xpow(128));
+
+      // the running CRC goes onto the first 32 bits of data
+      __m128i x0 = _mm_xor_si128(
+        crc_load(p, reverse), _mm_set_epi32(int(crc), 0, 0, 0));
+      __m128i x1 = crc_load(p + 16, reverse);
+      __m128i x2 = crc_load(p + 32, reverse);
+      __m128i x3 = crc_load(p + 48, reverse);
+      p += 64;
+      n -= 64;
+      for (; n >= 64; p += 64, n -= 64) {
+        x0 = _mm_xor_si128(crc_fold(x0, k512), crc_load(p, reverse));
+        x1 = _mm_xor_si128(crc_fold(x1, k512), crc_load(p + 16, reverse));
+        x2 = _mm_xor_si128(crc_fold(x2, k512), crc_load(p + 32, reverse));
+        x3 = _mm_xor_si128(crc_fold(x3, k512), crc_load(p + 48, reverse));
+      }
+      __m128i x = _mm_xor_si128(
+        _mm_xor_si128(crc_fold(x0, k384), crc_fold(x1, k256)),
+        _mm_xor_si128(crc_fold(x2, k128), x3));
+      return crc_pclmul_tail(x, p, n);
+    }
+
+#define COREUTILS_CRC512_TARGET \
+  gnu::target("avx512f,avx512bw,vpclmulqdq,pclmul,ssse3")
+
+    // The same folds on four 16-byte blocks at once, one per lane.
+    [[COREUTILS_CRC512_TARGET]] inline __m512i crc_fold512(
+      __m512i x, __m512i k) {
+      return _mm512_xor_si512(
+        _mm512_clmulepi64_epi128(x, k, 0x11),
+        _mm512_clmulepi64_epi128(x, k, 0x00));
+    }
+
+    [[COREUTILS_CRC512_TARGET]] inline __m512i crc_load512(
+      const uint8_t* p, __m512i reverse) {
+      return _mm512_shuffle_epi8(_mm512_loadu_si512(p), reverse);
+    }
+
+    [[COREUTILS_CRC512_TARGET]] inline __m512i crc_constants512(unsigned d) {
+      long long hi = crc_xpow(d + 64), lo = crc_xpow(d);
+      return _mm512_set_epi64(hi, lo, hi, lo, hi, lo, hi, lo);
+    }
+
+    [[COREUTILS_CRC512_TARGET]] uint32_t crc_vpclmul(
+      uint32_t crc, const uint8_t* p, size_t n) {
+      const long long hi = 0x0001020304050607, lo = 0x08090A0B0C0D0E0F;
+      const __m512i reverse = _mm512_set_epi64(hi, lo, hi, lo, hi, lo, hi, lo);
+      const __m512i k2048 = crc_constants512(2048);
+      const __m512i k1536 = crc_constants512(1536);
+      const __m512i k1024 = crc_constants512(1024);
+      const __m512i k512  = crc_constants512(512);
+
+      __m512i x0 = _mm512_xor_si512(
+        crc_load512(p, reverse),
+        _mm512_zextsi128_si512(_mm_set_epi32(int(crc), 0, 0, 0)));
+      __m512i x1 = crc_load512(p + 64, reverse);
+      __m512i x2 = crc_load512(p + 128, reverse);
+      __m512i x3 = crc_load512(p + 192, reverse);
+      p += 256;
+      n -= 256;
+      for (; n >= 256; p += 256, n -= 256) {
+        x0 = _mm512_xor_si512(
+          crc_fold512(x0, k2048), crc_load512(p, reverse));
+        x1 = _mm512_xor_si512(
+          crc_fold512(x1, k2048), crc_load512(p + 64, reverse));
+        x2 = _mm512_xor_si512(
+          crc_fold512(x2, k2048), crc_load512(p + 128, reverse));
+        x3 = _mm512_xor_si512(
+          crc_fold512(x3, k2048), crc_load512(p + 192, reverse));
+      }
+      __m512i x = _mm512_xor_si512(
+        _mm512_xor_si512(crc_fold512(x0, k1536), crc_fold512(x1, k1024)),
+        _mm512_xor_si512(crc_fold512(x2, k512), x3));
+      for (; n >= 64; p += 64, n -= 64)
+        x = _mm512_xor_si512(crc_fold512(x, k512), crc_load512(p, reverse));
+
+      // fold the lanes together, first onto last
+      const __m128i k384 = _mm_set_epi64x(crc_xpow(448), crc_xpow(384));
+      const __m128i k256 = _mm_set_epi64x(crc_xpow(320), crc_xpow(256));
+      const __m128i k128 = _mm_set_epi64x(crc_xpow(192), crc_xpow(128));
+      alignas(64) __m128i lanes[4];
+      _mm512_store_si512(lanes, x);
+      __m128i y = _mm_xor_si128(
+        _mm_xor_si128(crc_fold(lanes[0], k384), crc_fold(lanes[1], k256)),
+        _mm_xor_si128(crc_fold(lanes[2], k128), lanes[3]));
+      return crc_pclmul_tail(y, p, n);
+    }
+
+#undef COREUTILS_CRC512_TARGET
+  }  // namespace
+
+  void crc32_posix::update(const void* data, size_t size) {
+    auto p = static_cast<const uint8_t*>(data);
+    length += size;
+    if (size >= 512 && cpu().vpclmul)
+      crc = crc_vpclmul(crc, p, size);
+    else if (size >= 128 && cpu().pclmul)
+      crc = crc_pclmul(crc, p, size);
+    else
+      crc = crc_scalar(crc, p, size);
+  }
+
+  uint32_t crc32_posix::finish() const {
+    uint8_t bytes[8];
+    size_t n = 0;
+    for (uint64_t len = length; len != 0; len >>= 8)
+      bytes[n++] = uint8_t(len);
+    return ~crc_scalar(crc, bytes, n);
+  }
+
+  namespace {
+    alignas(16) constexpr uint32_t sha256_k[64] = {
+      0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+      0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+      0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+      0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+      0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+      0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+      0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+      0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+      0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+      0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+      0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+    };
+
+    constexpr uint32_t rotr(uint32_t x, int n) {
+      return (x >> n) | (x << (32 - n));
+    }
+
+    void sha256_scalar(uint32_t* state, const uint8_t* p, size_t blocks) {
+      for (; blocks > 0; --blocks, p += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+          w[i] = load_be32(p + 4 * i);
+        for (int i = 16; i < 64; ++i) {
+          uint32_t a  = w[i - 15], b = w[i - 2];
+          uint32_t s0 = rotr(a, 7) ^ rotr(a, 18) ^ (a >> 3);
+          uint32_t s1 = rotr(b, 17) ^ rotr(b, 19) ^ (b >> 10);
+          w[i]        = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+          uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+          uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+          uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+          uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+          h = g;
+          g = f;
+          f = e;
+          e = d + t1;
+          d = c;
+          c = b;
+          b = a;
+          a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+      }
+    }
+
+    // sha256rnds2 does two rounds on the state split as ABEF and CDGH; each
+    // group of four rounds also advances the message schedule, which is kept
+    // as four vectors of four words.
+    [[gnu::target("sha,sse4.1")]] void sha256_shani(
+      uint32_t* state, const uint8_t* p, size_t blocks) {
+      const __m128i swap = _mm_set_epi64x(
+        0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+
+      __m128i tmp = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+      __m128i cdgh = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+      __m128i abef = _mm_alignr_epi8(tmp, cdgh, 8);
+      cdgh         = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+      for (; blocks > 0; --blocks, p += 64) {
+        __m128i abef_save = abef, cdgh_save = cdgh;
+        __m128i msg[4];
+#pragma GCC unroll 16
+        for (int i = 0; i < 16; ++i) {
+          __m128i& cur  = msg[i % 4];
+          __m128i& next = msg[(i + 1) % 4];
+          __m128i& prev = msg[(i + 3) % 4];
+          if (i < 4) {
+            cur = _mm_shuffle_epi8(
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i)),
+              swap);
+          }
+          __m128i m = _mm_add_epi32(
+            cur,
+            _mm_load_si128(reinterpret_cast<const __m128i*>(sha256_k + 4 * i)));
+          cdgh = _mm_sha256rnds2_epu32(cdgh, abef, m);
+          if (i >= 3 && i < 15) {
+            next = _mm_sha256msg2_epu32(
+              _mm_add_epi32(next, _mm_alignr_epi8(cur, prev, 4)), cur);
+          }
+          m    = _mm_shuffle_epi32(m, 0x0E);
+          abef = _mm_sha256rnds2_epu32(abef, cdgh, m);
+          if (i >= 1 && i < 13) prev = _mm_sha256msg1_epu32(prev, cur);
+        }
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+      }
+
+      tmp  = _mm_shuffle_epi32(abef, 0x1B);
+      cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+      _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, cdgh, 0xF0));
+      _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(cdgh, tmp, 8));
+    }
+
+    void sha256_blocks(uint32_t* state, const uint8_t* p, size_t blocks) {
+      if (cpu().sha)
+        sha256_shani(state, p, blocks);
+      else
+        sha256_scalar(state, p, blocks);
+    }
+  }  // namespace
+
+  sha256::sha256() :
+    state {
+      0x6A09E667,
+      0xBB67AE85,
+      0x3C6EF372,
+      0xA54FF53A,
+      0x510E527F,
+      0x9B05688C,
+      0x1F83D9AB,
+      0x5BE0CD19,
+    } {}
+
+  void sha256::update(const void* data, size_t size) {
+    auto p = static_cast<const uint8_t*>(data);
+    length += size;
+    if (buffered > 0) {
+      size_t take = std::min(size, 64 - buffered);
+      std::memcpy(block + buffered, p, take);
+      buffered += take;
+      p += take;
+      size -= take;
+      if (buffered < 64) return;
+      sha256_blocks(state, block, 1);
+      buffered = 0;
+    }
+    sha256_blocks(state, p, size / 64);
+    p += size & ~size_t(63);
+    size &= 63;
+    std::memcpy(block, p, size);
+    buffered = size;
+  }
+
+  sha256::digest sha256::finish() {
+    uint64_t bits = length * 8;
+    block[buffered++] = 0x80;
+    if (buffered > 56) {
+      std::memset(block + buffered, 0, 64 - buffered);
+      sha256_blocks(state, block, 1);
+      buffered = 0;
+    }
+    std::memset(block + buffered, 0, 56 - buffered);
+    for (int i = 0; i < 8; ++i)
+      block[56 + i] = uint8_t(bits >> (56 - 8 * i));
+    sha256_blocks(state, block, 1);
+
+    digest res;
+    for (int i = 0; i < 8; ++i) {
+      res[4 * i]     = uint8_t(state[i] >> 24);
+      res[4 * i + 1] = uint8_t(state[i] >> 16);
+      res[4 * i + 2] = uint8_t(state[i] >> 8);
+      res[4 * i + 3] = uint8_t(state[i]);
+    }
+    return res;
+  }
+}  // namespace coreutils
@@ -0,0 +1,41 @@
+#ifndef _CXCU_DETAILS_DIGEST_HPP_
+#define _CXCU_DETAILS_DIGEST_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace coreutils {
+  // The POSIX cksum CRC: CRC-32 with polynomial 0x04C11DB7, most significant
+  // bit first, over the data followed by its length. Whole 16-byte blocks are
+  // folded with carry-less multiplication when the CPU has PCLMULQDQ (64
+  // bytes at a time with VPCLMULQDQ on AVX-512), and the rest goes through
+  // slice-by-8 tables.
+  class crc32_posix {
+  public:
+    void update(const void* data, size_t size);
+    uint32_t finish() const;
+
+  private:
+    uint32_t crc    = 0;
+    uint64_t length = 0;
+  };
+
+  // SHA-256, using the SHA extensions when the CPU has them.
+  class sha256 {
+  public:
+    using digest = std::array<uint8_t, 32>;
+
+    sha256();
+
+    void update(const void* data, size_t size);
+    digest finish();
+
+  private:
+    uint32_t state[8];
+    uint8_t block[64];
+    size_t buffered = 0;
+    uint64_t length = 0;
+  };
+}  // namespace coreutils
+#endif
@@ -0,0 +1,57 @@
+#ifndef _CXCU_DETAILS_DIGITS_HPP_
+#define _CXCU_DETAILS_DIGITS_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace coreutils {
+  // "00", "01", ..., "99" back to back, so that integers can be written two
+  // digits at a time.
+  inline constexpr auto digit_pairs = [] {
+    std::array<char, 200> table {};
+    for (int i = 0; i < 100; ++i) {
+      table[2 * i]     = char('0' + i / 10);
+      table[2 * i + 1] = char('0' + i % 10);
+    }
+    return table;
+  }();
+
+  // enough room for any uint64_t
+  inline constexpr size_t max_decimal_digits = 20;
+
+  // Writes the two digits of v (0 <= v < 100) to out.
+  [[gnu::always_inline]] inline void write_two_digits(char* out, unsigned v) {
+    std::memcpy(out, &digit_pairs[2 * v], 2);
+  }
+
+  // Writes v in decimal so that it ends just before `end`. Returns a pointer
+  // to the first digit.
+  inline char* format_decimal(char* end, uint64_t v) {
+    while (v >= 100) {
+      end -= 2;
+      write_two_digits(end, unsigned(v % 100));
+      v /= 100;
+    }
+    if (v >= 10) {
+      end -= 2;
+      write_two_digits(end, unsigned(v));
+    }
+    else {
+      *--end = char('0' + v);
+    }
+    return end;
+  }
+
+  // Number of decimal digits in v.
+  inline size_t decimal_width(uint64_t v) {
+    size_t n = 1;
+    for (; v >= 10000; v /= 10000)
+      n += 4;
+    for (; v >= 10; v /= 10)
+      ++n;
+    return n;
+  }
+}  // namespace coreutils
+#endif
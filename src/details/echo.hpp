@@ -0,0 +1,67 @@
+#ifndef _CXCU_DETAILS_ECHO_HPP_
+#define _CXCU_DETAILS_ECHO_HPP_
+
+#include <string_view>
+
+#include "escapes.hpp"
+
+namespace coreutils {
+  // Passes everything echo prints for args (argv without argv[0]), trailing
+  // newline included, to sink as a series of string_views. Used by echo
+  // itself, which buffers it without touching the heap, and by xargs, which
+  // runs echo in-process. Args only has to iterate over things that convert
+  // to string_view, so echo can hand over argv as it is.
+  template <typename Args, typename Sink>
+  void echo_to(const Args& args, Sink&& sink) {
+    // process CLI arguments manually, because this command is special
+    struct echo_opts {
+      bool no_nl;
+      bool escapes;
+    } opts {false, false};
+    auto i   = args.begin();
+    auto end = args.end();
+    for (; i != end; ++i) {
+      std::string_view arg = *i;
+      if (arg.empty() || arg[0] != '-') break;
+      echo_opts new_opts = opts;
+      for (char c : std::string_view(arg.data() + 1, arg.size() - 1)) {
+        switch (c) {
+          case 'e':
+            new_opts.escapes = true;
+            break;
+          case 'n':
+            new_opts.no_nl = true;
+            break;
+          default:
+            goto echo_past_opts;
+        }
+      }
+      opts = new_opts;
+    }
+  echo_past_opts:
+
+    for (bool first = true; i != end; ++i, first = false) {
+      std::string_view arg = *i;
+      if (!first) sink(std::string_view(" "));
+      if (!opts.escapes) {
+        sink(arg);
+        continue;
+      }
+      // escapes never take in a space, so each word can be decoded alone.
+      // No substr() here: its range check is the only thing that would need
+      // libstdc++ at run time.
+      while (!arg.empty()) {
+        size_t next = arg.find('\\');
+        if (next == std::string_view::npos) next = arg.size();
+        if (next > 0) sink(std::string_view(arg.data(), next));
+        if (next == arg.size()) break;
+        arg.remove_prefix(next + 1);
+        auto esc = decode_escape(arg, escape_syntax::echo);
+        sink(std::string_view(esc.bytes, esc.size));
+        arg.remove_prefix(esc.length);
+      }
+    }
+    if (!opts.no_nl) sink(std::string_view("\n"));
+  }
+}  // namespace coreutils
+#endif
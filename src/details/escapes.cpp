@@ -0,0 +1,127 @@
+#include "escapes.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+
+namespace {
+  // The single-letter escapes, shared by every decoder and encoder.
+  constexpr std::pair<char, char> letter_escapes[] = {
+    {'\\', '\\'}, {'a', '\a'}, {'b', '\b'}, {'e', '\x1b'}, {'f', '\f'},
+    {'n', '\n'},  {'r', '\r'}, {'t', '\t'}, {'v', '\v'},
+  };
+
+  constexpr auto unescape_table = [] {
+    std::array<int16_t, 256> table {};
+    for (auto& v : table)
+      v = -1;
+    for (auto [letter, value] : letter_escapes)
+      table[uint8_t(letter)] = uint8_t(value);
+    return table;
+  }();
+
+  constexpr auto escape_table = [] {
+    std::array<char, 256> table {};
+    for (auto [letter, value] : letter_escapes)
+      table[uint8_t(value)] = letter;
+    return table;
+  }();
+}  // namespace
+
+namespace coreutils {
+  int unescape_letter(char c) { return unescape_table[uint8_t(c)]; }
+
+  char escape_letter(unsigned char c) { return escape_table[c]; }
+
+  escape decode_escape(std::string_view in, escape_syntax syntax) {
+    escape res;
+    auto take = [&](char c) { res.bytes[res.size++] = c; };
+    if (in.empty()) {
+      // a lone backslash at the end stands for itself
+      take('\\');
+      return res;
+    }
+
+    char c            = in[0];
+    bool printf_style = syntax != escape_syntax::echo;
+    // echo wants a 0 before octal digits, printf does not (but allows one
+    // in %b operands)
+    if (
+      is_octal_digit(c) &&
+      (printf_style || (c == '0' && in.size() > 1 && is_octal_digit(in[1])))) {
+      size_t i      = syntax != escape_syntax::printf && c == '0';
+      size_t end    = std::min(i + 3, in.size());
+      uint8_t value = 0;
+      for (; i < end && is_octal_digit(in[i]); ++i)
+        value = uint8_t(value << 3 | (in[i] - '0'));
+      take(char(value));
+      res.length = uint8_t(i);
+      return res;
+    }
+    if (c == '0') {
+      take('\0');
+      res.length = 1;
+      return res;
+    }
+
+    size_t max_digits = c == 'x' ? 2 : c == 'u' ? 4 : c == 'U' ? 8 : 0;
+    if (c == 'x' || (printf_style && max_digits > 0)) {
+      uint32_t value = 0;
+      size_t i       = 1;
+      for (; i <= max_digits && i < in.size() && is_hex_digit(in[i]); ++i)
+        value = value << 4 | uint32_t(extract_hex_digit(in[i]));
+      // \u and \U need all of their digits, \x at least one
+      size_t needed = c == 'x' ? 1 : max_digits;
+      if (i - 1 < needed || value > 0x10FFFF) {
+        if (printf_style) {
+          res.invalid = true;
+          return res;
+        }
+        take('\\');
+        take(c);
+        res.length = 1;
+        return res;
+      }
+      res.length = uint8_t(i);
+      if (c == 'x' || value < 0x80) {
+        take(char(value));
+      }
+      else if (value < 0x800) {
+        take(char(0xC0 | value >> 6));
+        take(char(0x80 | (value & 0x3F)));
+      }
+      else if (value < 0x10000) {
+        take(char(0xE0 | value >> 12));
+        take(char(0x80 | (value >> 6 & 0x3F)));
+        take(char(0x80 | (value & 0x3F)));
+      }
+      else {
+        take(char(0xF0 | value >> 18));
+        take(char(0x80 | (value >> 12 & 0x3F)));
+        take(char(0x80 | (value >> 6 & 0x3F)));
+        take(char(0x80 | (value & 0x3F)));
+      }
+      return res;
+    }
+
+    res.length = 1;
+    if (printf_style && c == 'c') {
+      res.stop = true;
+      return res;
+    }
+    if (printf_style && c == '"') {
+      take('"');
+      return res;
+    }
+    int letter = unescape_letter(c);
+    if (letter >= 0) {
+      take(char(letter));
+    }
+    else {
+      take('\\');
+      take(c);
+    }
+    return res;
+  }
+}  // namespace coreutils
@@ -0,0 +1,56 @@
+#ifndef _CXCU_DETAILS_ESCAPES_HPP_
+#define _CXCU_DETAILS_ESCAPES_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace coreutils {
+  // The dialects of backslash escapes. They differ in how octal escapes are
+  // written and in what they accept beyond the single-letter ones.
+  enum class escape_syntax {
+    echo,        // \0NNN and \xHH, as in echo -e
+    printf,      // \NNN, \xHH, \uHHHH, \UHHHHHHHH, \" and \c, as in FORMAT
+    printf_arg,  // as printf, but octal may also be \0NNN, as in %b operands
+  };
+
+  // One decoded escape: the bytes it stands for, and how many characters
+  // after the backslash it spans. Anything that is not an escape stands for
+  // itself, backslash included.
+  struct escape {
+    char bytes[4];
+    uint8_t size   = 0;
+    uint8_t length = 0;
+    // \c: produce no further output
+    bool stop = false;
+    // \x, \u or \U without the hex digits it needs (printf only)
+    bool invalid = false;
+  };
+
+  // Decodes the escape at the start of in, which is the text right after a
+  // backslash.
+  escape decode_escape(std::string_view in, escape_syntax syntax);
+
+  // Value of the single-letter escape \c, or -1 if c is not one.
+  int unescape_letter(char c);
+
+  // Letter of the single-letter escape for the byte c, or '\0' if it has none.
+  char escape_letter(unsigned char c);
+
+  [[gnu::always_inline]] inline bool is_octal_digit(char c) {
+    return (c >= '0' && c <= '7');
+  }
+
+  [[gnu::always_inline]] inline bool is_hex_digit(char c) {
+    return (c >= '0' && c <= '9') | (c >= 'A' && c <= 'F') |
+      (c >= 'a' && c <= 'f');
+  }
+
+  [[gnu::always_inline]] inline char extract_hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    else if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    else if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return '\0';
+  }
+}  // namespace coreutils
+#endif
@@ -0,0 +1,88 @@
+#ifndef _CXCU_DETAILS_INODE_SET_HPP_
+#define _CXCU_DETAILS_INODE_SET_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace coreutils {
+  // Identifies a file independently of the path used to reach it.
+  struct file_id {
+    uint64_t dev;
+    uint64_t ino;
+
+    bool operator==(const file_id&) const = default;
+  };
+
+  struct file_id_hash {
+    size_t operator()(const file_id& id) const noexcept {
+      // inode numbers are mostly sequential; mix so that shards and buckets
+      // both see well-spread bits
+      uint64_t x = id.ino ^ (id.dev * 0x9E3779B97F4A7C15ull);
+      x ^= x >> 33;
+      x *= 0xFF51AFD7ED558CCDull;
+      x ^= x >> 33;
+      return size_t(x);
+    }
+  };
+
+  // Set of (dev, ino) pairs that many threads can insert into at once. It is
+  // split into independently locked shards, so threads only contend when they
+  // hit the same shard at the same time.
+  class inode_set {
+  public:
+    // Returns true if the id was not in the set yet.
+    bool insert(const file_id& id) {
+      size_t hash = file_id_hash {}(id);
+      auto& shard = shards[(hash >> 32) % shard_count];
+      std::lock_guard guard(shard.lock);
+      return shard.ids.insert(id).second;
+    }
+
+    bool contains(const file_id& id) const {
+      size_t hash = file_id_hash {}(id);
+      auto& shard = shards[(hash >> 32) % shard_count];
+      std::lock_guard guard(shard.lock);
+      return shard.ids.count(id) != 0;
+    }
+
+  private:
+    static constexpr size_t shard_count = 64;
+
+    struct alignas(64) shard {
+      mutable std::mutex lock;
+      std::unordered_set<file_id, file_id_hash> ids;
+    };
+    std::array<shard, shard_count> shards;
+  };
+
+  // Map from file ids to T, sharded the same way.
+  template <typename T>
+  class inode_map {
+  public:
+    // Calls f(value, inserted) with the value for id, default-constructed if
+    // it was not in the map yet, while its shard is locked.
+    template <typename F>
+    void update(const file_id& id, F&& f) {
+      size_t hash = file_id_hash {}(id);
+      auto& shard = shards[(hash >> 32) % shard_count];
+      std::lock_guard guard(shard.lock);
+      auto [it, inserted] = shard.values.try_emplace(id);
+      f(it->second, inserted);
+    }
+
+  private:
+    static constexpr size_t shard_count = 64;
+
+    struct alignas(64) shard {
+      std::mutex lock;
+      std::unordered_map<file_id, T, file_id_hash> values;
+    };
+    std::array<shard, shard_count> shards;
+  };
+}  // namespace coreutils
+#endif
@@ -0,0 +1,86 @@
+#ifndef _CXCU_DETAILS_OUTPUT_BUFFER_HPP_
+#define _CXCU_DETAILS_OUTPUT_BUFFER_HPP_
+
+#include <cerrno>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <unistd.h>
+
+namespace coreutils {
+  // Buffers output for a file descriptor and writes it out in large blocks.
+  // Text is formatted straight into the buffer, so no temporary strings are
+  // needed for each line of output.
+  class output_buffer {
+  public:
+    explicit output_buffer(int fd = STDOUT_FILENO, size_t block = 64 * 1024) :
+      fd(fd), block(block) {
+      buffer.reserve(block * 2);
+    }
+
+    ~output_buffer() {
+      try {
+        flush();
+      }
+      catch (const std::system_error&) {
+      }
+    }
+
+    output_buffer(const output_buffer&)            = delete;
+    output_buffer& operator=(const output_buffer&) = delete;
+
+    void write(std::string_view str) {
+      buffer.append(str.data(), str.data() + str.size());
+      maybe_flush();
+    }
+
+    void put(char c) {
+      buffer.push_back(c);
+      maybe_flush();
+    }
+
+    template <typename... Args>
+    void format(fmt::format_string<Args...> fmt, Args&&... args) {
+      fmt::format_to(
+        std::back_inserter(buffer), fmt, std::forward<Args>(args)...);
+      maybe_flush();
+    }
+
+    // Direct access for callers that fill the buffer themselves. Call
+    // maybe_flush() once done.
+    fmt::memory_buffer& data() { return buffer; }
+    auto out() { return std::back_inserter(buffer); }
+
+    void maybe_flush() {
+      if (buffer.size() >= block) flush();
+    }
+
+    void flush() {
+      const char* ptr = buffer.data();
+      size_t left     = buffer.size();
+      while (left > 0) {
+        ssize_t res = ::write(fd, ptr, left);
+        if (res < 0) {
+          if (errno == EINTR) continue;
+          buffer.clear();
+          throw std::system_error(errno, std::generic_category(), "write");
+        }
+        ptr += res;
+        left -= size_t(res);
+      }
+      buffer.clear();
+    }
+
+  private:
+    int fd;
+    size_t block;
+    fmt::memory_buffer buffer;
+  };
+}  // namespace coreutils
+#endif
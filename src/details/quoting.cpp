@@ -0,0 +1,197 @@
+#include "quoting.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#include "escapes.hpp"
+
+namespace {
+  // Length of the valid UTF-8 sequence at the start of s, or 0 if invalid.
+  size_t utf8_length(std::string_view s) {
+    auto b0 = uint8_t(s[0]);
+    size_t len;
+    uint32_t min;
+    if (b0 >= 0xC2 && b0 <= 0xDF) {
+      len = 2;
+      min = 0x80;
+    }
+    else if (b0 >= 0xE0 && b0 <= 0xEF) {
+      len = 3;
+      min = 0x800;
+    }
+    else if (b0 >= 0xF0 && b0 <= 0xF4) {
+      len = 4;
+      min = 0x10000;
+    }
+    else {
+      return 0;
+    }
+    if (s.size() < len) return 0;
+
+    uint32_t cp = b0 & (0x7F >> len);
+    for (size_t i = 1; i < len; ++i) {
+      auto b = uint8_t(s[i]);
+      if ((b & 0xC0) != 0x80) return 0;
+      cp = (cp << 6) | (b & 0x3F);
+    }
+    // reject overlong forms, surrogates, and C1 controls (as unprintable)
+    if (cp < min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF ||
+        (cp >= 0x80 && cp < 0xA0))
+      return 0;
+    return len;
+  }
+
+  void append_octal(fmt::memory_buffer& out, uint8_t c) {
+    char buf[4] = {'\\', char('0' + (c >> 6)), char('0' + ((c >> 3) & 7)),
+                   char('0' + (c & 7))};
+    out.append(buf, buf + 4);
+  }
+
+  // Besides control and non-ASCII bytes, each style has up to two printable
+  // bytes that need a backslash (DEL stands in for "none").
+  std::pair<uint8_t, uint8_t> extra_bytes(coreutils::quote_style style) {
+    switch (style) {
+      case coreutils::quote_style::cstyle: return {'\\', ' '};
+      case coreutils::quote_style::json: return {'\\', '"'};
+      default: return {0x7F, 0x7F};
+    }
+  }
+
+  // JSON has no way to write raw bytes, so invalid UTF-8 is written as lone
+  // surrogates U+DC80..U+DCFF (the "surrogateescape" convention), which
+  // decoders can map back to the original bytes.
+  void append_json_escape(fmt::memory_buffer& out, uint8_t c) {
+    constexpr char digits[] = "0123456789abcdef";
+    char letter = '\0';
+    switch (c) {
+      case '\b': letter = 'b'; break;
+      case '\f': letter = 'f'; break;
+      case '\n': letter = 'n'; break;
+      case '\r': letter = 'r'; break;
+      case '\t': letter = 't'; break;
+    }
+    if (letter != '\0') {
+      char buf[2] = {'\\', letter};
+      out.append(buf, buf + 2);
+      return;
+    }
+    char buf[6] = {'\\', 'u', c >= 0x80 ? 'd' : '0', c >= 0x80 ? 'c' : '0',
+                   digits[c >> 4], digits[c & 15]};
+    out.append(buf, buf + 6);
+  }
+}  // namespace
+
+namespace coreutils {
+  size_t find_unsafe(std::string_view name, quote_style style) {
+    const char* p   = name.data();
+    const char* end = p + name.size();
+    auto [extra1, extra2] = extra_bytes(style);
+
+#if defined(__SSE2__)
+    // A signed compare against 0x20 catches both control characters and
+    // every byte >= 0x80.
+    const __m128i space  = _mm_set1_epi8(0x20);
+    const __m128i del    = _mm_set1_epi8(0x7F);
+    const __m128i first  = _mm_set1_epi8(char(extra1));
+    const __m128i second = _mm_set1_epi8(char(extra2));
+    for (; end - p >= 16; p += 16) {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      __m128i bad   = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi8(block, space), _mm_cmpeq_epi8(block, del)),
+        _mm_or_si128(
+          _mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second)));
+      int mask = _mm_movemask_epi8(bad);
+      if (mask != 0)
+        return size_t(p - name.data()) + unsigned(__builtin_ctz(unsigned(mask)));
+    }
+#endif
+    // eight bytes at a time for the (common) short names; false positives
+    // only send us to the scalar loop early
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t high = 0x8080808080808080ull;
+    auto has_byte           = [](uint64_t w, uint8_t c) {
+      uint64_t x = w ^ (ones * c);
+      return (x - ones) & ~x;
+    };
+    for (; end - p >= 8; p += 8) {
+      uint64_t w;
+      std::memcpy(&w, p, 8);
+      uint64_t ctrl = (w - ones * 0x20) | w;  // < 0x20 or >= 0x80
+      if ((ctrl | has_byte(w, 0x7F) | has_byte(w, extra1) |
+           has_byte(w, extra2)) & high)
+        break;
+    }
+    for (; p < end; ++p) {
+      auto c = uint8_t(*p);
+      if (c < 0x20 || c >= 0x7F || c == extra1 || c == extra2)
+        return size_t(p - name.data());
+    }
+    return std::string_view::npos;
+  }
+
+  size_t append_quoted(
+    fmt::memory_buffer& out, std::string_view name, quote_style style) {
+    size_t pos = style == quote_style::none ?
+      std::string_view::npos :
+      find_unsafe(name, style);
+    if (pos == std::string_view::npos) {
+      // fast path: nothing to do but copy
+      out.append(name.data(), name.data() + name.size());
+      return name.size();
+    }
+
+    out.append(name.data(), name.data() + pos);
+    auto extra   = extra_bytes(style);
+    size_t width = pos;
+    while (pos < name.size()) {
+      auto c = uint8_t(name[pos]);
+      if (c >= 0x20 && c < 0x7F) {
+        if (c == extra.first || c == extra.second) {
+          char buf[2] = {'\\', char(c)};
+          out.append(buf, buf + 2);
+          width += 2;
+        }
+        else {
+          out.push_back(char(c));
+          ++width;
+        }
+        ++pos;
+        continue;
+      }
+      if (c >= 0x80) {
+        size_t len = utf8_length(name.substr(pos));
+        if (len > 0) {
+          out.append(name.data() + pos, name.data() + pos + len);
+          ++width;
+          pos += len;
+          continue;
+        }
+      }
+
+      // not printable
+      if (style == quote_style::qmark) {
+        out.push_back('?');
+        ++width;
+      }
+      else if (style == quote_style::json) {
+        append_json_escape(out, c);
+      }
+      else if (char letter = escape_letter(c); letter != '\0') {
+        char buf[2] = {'\\', letter};
+        out.append(buf, buf + 2);
+        width += 2;
+      }
+      else {
+        append_octal(out, c);
+        width += 4;
+      }
+      ++pos;
+    }
+    return width;
+  }
+}  // namespace coreutils
@@ -0,0 +1,28 @@
+#ifndef _CXCU_DETAILS_QUOTING_HPP_
+#define _CXCU_DETAILS_QUOTING_HPP_
+
+#include <cstddef>
+#include <string_view>
+
+#include <fmt/format.h>
+
+namespace coreutils {
+  // How names with unprintable or special bytes are shown.
+  enum class quote_style {
+    none,    // write names as they are
+    qmark,   // replace non-printable bytes with ?
+    cstyle,  // C-style escapes: \n, \t, \\, \ooo, and "\ " for spaces
+    json,    // contents of a JSON string (without the quotes)
+  };
+
+  // Offset of the first byte of name that may need quoting (control, DEL,
+  // non-ASCII, backslash and space for cstyle, backslash and '"' for json),
+  // or npos if the name is clean.
+  size_t find_unsafe(std::string_view name, quote_style style);
+
+  // Appends name to out, quoted in the given style. Returns the number of
+  // terminal columns the result takes up.
+  size_t append_quoted(
+    fmt::memory_buffer& out, std::string_view name, quote_style style);
+}  // namespace coreutils
+#endif
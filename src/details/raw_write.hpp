@@ -0,0 +1,56 @@
+#ifndef _CXCU_DETAILS_RAW_WRITE_HPP_
+#define _CXCU_DETAILS_RAW_WRITE_HPP_
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Output for the small utilities that are started far more often than they
+// run (true, false, echo). Only raw system calls, so using these pulls in no
+// stream or locale initialization.
+namespace coreutils {
+  // Writes iov[0..count) to fd, continuing after short writes. Modifies
+  // iov. Returns false (with errno set) on error.
+  inline bool write_all(int fd, iovec* iov, size_t count) {
+    while (count > 0) {
+      ssize_t res = writev(fd, iov, int(count < IOV_MAX ? count : IOV_MAX));
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      // skip over what was written, which may end mid-piece
+      size_t done = size_t(res);
+      while (count > 0 && done >= iov->iov_len) {
+        done -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (count > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + done;
+        iov->iov_len -= done;
+      }
+    }
+    return true;
+  }
+
+  // Writes the pieces to fd in order, in a single writev where possible.
+  inline bool write_all(int fd, std::initializer_list<std::string_view> pieces) {
+    constexpr size_t max_pieces = 16;
+    iovec iov[max_pieces];
+    size_t count = 0;
+    for (auto piece : pieces) {
+      if (count == max_pieces) {
+        if (!write_all(fd, iov, count)) return false;
+        count = 0;
+      }
+      iov[count++] = {const_cast<char*>(piece.data()), piece.size()};
+    }
+    return write_all(fd, iov, count);
+  }
+}  // namespace coreutils
+#endif
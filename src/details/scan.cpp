@@ -0,0 +1,128 @@
+#include "scan.hpp"
+
+#include <algorithm>
+#include <memory>
+
+#include <unistd.h>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+namespace {
+  constexpr size_t npos = std::string_view::npos;
+
+  // index of the k-th lowest set bit (k counted from 1)
+  inline unsigned nth_low_bit(uint64_t mask, size_t k) {
+    while (--k > 0)
+      mask &= mask - 1;
+    return unsigned(__builtin_ctzll(mask));
+  }
+
+  // index of the k-th highest set bit (k counted from 1)
+  inline unsigned nth_high_bit(uint64_t mask, size_t k) {
+    unsigned bit = 63 - unsigned(__builtin_clzll(mask));
+    while (--k > 0) {
+      mask &= ~(uint64_t(1) << bit);
+      bit = 63 - unsigned(__builtin_clzll(mask));
+    }
+    return bit;
+  }
+}  // namespace
+
+namespace coreutils {
+  uint64_t match_mask(const char* p, char c) {
+#if defined(__SSE2__)
+    const __m128i needle = _mm_set1_epi8(c);
+    auto part = [&](size_t off) -> uint64_t {
+      __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + off));
+      return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    };
+    return part(0) | (part(16) << 16) | (part(32) << 32) | (part(48) << 48);
+#else
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < 64; ++i)
+      mask |= uint64_t(p[i] == c) << i;
+    return mask;
+#endif
+  }
+
+  size_t count_char(std::string_view data, char c) {
+    const char* p   = data.data();
+    const char* end = p + data.size();
+    size_t count    = 0;
+
+#if defined(__SSE2__)
+    // Each match subtracts -1 from a byte lane; lanes are summed into 64-bit
+    // counters before they can overflow (at most 255 blocks).
+    const __m128i needle = _mm_set1_epi8(c);
+    const __m128i zero   = _mm_setzero_si128();
+    while (end - p >= 16) {
+      size_t blocks = std::min<size_t>(size_t(end - p) / 16, 255);
+      __m128i acc   = zero;
+      for (size_t i = 0; i < blocks; ++i, p += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(block, needle));
+      }
+      __m128i sums = _mm_sad_epu8(acc, zero);
+      count += size_t(_mm_cvtsi128_si64(sums)) +
+        size_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(sums, sums)));
+    }
+#endif
+    for (; p < end; ++p)
+      count += (*p == c);
+    return count;
+  }
+
+  size_t find_nth(std::string_view data, char c, size_t& n) {
+    if (n == 0) return npos;
+    size_t pos = 0;
+    for (; data.size() - pos >= 64; pos += 64) {
+      uint64_t mask = match_mask(data.data() + pos, c);
+      size_t found  = size_t(__builtin_popcountll(mask));
+      if (found >= n) return pos + nth_low_bit(mask, n);
+      n -= found;
+    }
+    for (; pos < data.size(); ++pos) {
+      if (data[pos] == c && --n == 0) return pos;
+    }
+    return npos;
+  }
+
+  size_t rfind_nth(std::string_view data, char c, size_t& n) {
+    if (n == 0) return npos;
+    size_t end = data.size();
+    for (; end >= 64; end -= 64) {
+      uint64_t mask = match_mask(data.data() + end - 64, c);
+      size_t found  = size_t(__builtin_popcountll(mask));
+      if (found >= n) return end - 64 + nth_high_bit(mask, n);
+      n -= found;
+    }
+    while (end > 0) {
+      --end;
+      if (data[end] == c && --n == 0) return end;
+    }
+    return npos;
+  }
+
+  off_t find_last_lines(
+    int fd, off_t start, off_t end, char terminator, size_t n) {
+    if (n == 0 || end <= start) return end;
+    constexpr size_t block_size = 64 * 1024;
+    std::unique_ptr<char[]> buffer(new char[block_size]);
+    bool first = true;
+    while (end > start) {
+      off_t from  = std::max<off_t>(start, end - off_t(block_size));
+      ssize_t len = pread(fd, buffer.get(), size_t(end - from), from);
+      if (len <= 0) break;
+      std::string_view block(buffer.get(), size_t(len));
+      if (first && block.back() == terminator) block.remove_suffix(1);
+      first      = false;
+      size_t hit = rfind_nth(block, terminator, n);
+      if (hit != npos) return from + off_t(hit) + 1;
+      end = from;
+    }
+    return start;
+  }
+}  // namespace coreutils
@@ -0,0 +1,33 @@
+#ifndef _CXCU_DETAILS_SCAN_HPP_
+#define _CXCU_DETAILS_SCAN_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <sys/types.h>
+
+namespace coreutils {
+  // Bit i is set if p[i] == c, for the 64 bytes starting at p.
+  uint64_t match_mask(const char* p, char c);
+
+  // Counts the occurrences of c in data.
+  size_t count_char(std::string_view data, char c);
+
+  // Finds the n-th occurrence (counting from 1) of c in data, scanning from
+  // the front. Returns its offset, or npos after subtracting the number of
+  // occurrences seen from n.
+  size_t find_nth(std::string_view data, char c, size_t& n);
+
+  // Same as find_nth, but counts from the back of data.
+  size_t rfind_nth(std::string_view data, char c, size_t& n);
+
+  // Where the last n lines of the range [start, end) of fd begin. Blocks are
+  // read backward from end with pread, so only about as much as the lines
+  // take up is read. A terminator at the very end ends the last line rather
+  // than starting another one. Returns start if the range has no more than
+  // n lines (or cannot be read), and end if n is 0.
+  off_t find_last_lines(
+    int fd, off_t start, off_t end, char terminator, size_t n);
+}  // namespace coreutils
+#endif
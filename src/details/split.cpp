@@ -0,0 +1,145 @@
+#include "split.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+
+#include "scan.hpp"
+
+namespace coreutils {
+  // The buffer has 64 bytes of slack past its capacity, so that a mask can
+  // always be computed for a whole block; bits past `end` are cleared.
+  line_reader::line_reader(int fd, char terminator, size_t block) :
+    fd(fd),
+    terminator(terminator),
+    block(block),
+    capacity(2 * block),
+    buffer(new char[capacity + 64]) {}
+
+  size_t line_reader::find_terminator(size_t from) {
+    while (from < end) {
+      size_t base = from & ~size_t(63);
+      if (base != mask_base) {
+        mask      = match_mask(buffer.get() + base, terminator);
+        mask_base = base;
+        if (end - base < 64) mask &= (uint64_t(1) << (end - base)) - 1;
+      }
+      uint64_t m = mask & (~uint64_t(0) << (from - base));
+      if (m != 0) return base + size_t(__builtin_ctzll(m));
+      from = base + 64;
+    }
+    return SIZE_MAX;
+  }
+
+  bool line_reader::fill() {
+    // Unread data is moved to the start of a buffer when the free space is
+    // getting short. The first move in a call to next() goes to the spare
+    // buffer, since the caller may still be holding the previous line; later
+    // ones only move data that nobody has seen.
+    if (capacity - end < block) {
+      size_t keep = end - begin;
+      size_t need = keep + block;
+      if (!moved) {
+        if (spare_capacity < need) {
+          spare_capacity = std::max(2 * block, 2 * need);
+          spare.reset(new char[spare_capacity + 64]);
+        }
+        std::memcpy(spare.get(), buffer.get() + begin, keep);
+        std::swap(buffer, spare);
+        std::swap(capacity, spare_capacity);
+        moved = true;
+      }
+      else if (need > capacity) {
+        capacity = 2 * need;
+        std::unique_ptr<char[]> bigger(new char[capacity + 64]);
+        std::memcpy(bigger.get(), buffer.get() + begin, keep);
+        buffer = std::move(bigger);
+      }
+      else {
+        std::memmove(buffer.get(), buffer.get() + begin, keep);
+      }
+      begin = 0;
+      end   = keep;
+    }
+    // the last block may have been cut short by the old end
+    mask_base = SIZE_MAX;
+
+    for (;;) {
+      ssize_t len = read(fd, buffer.get() + end, capacity - end);
+      if (len < 0) {
+        if (errno == EINTR) continue;
+        throw std::system_error(errno, std::generic_category(), "read");
+      }
+      if (len == 0) {
+        eof = true;
+        return false;
+      }
+      end += size_t(len);
+      return true;
+    }
+  }
+
+  bool line_reader::next(std::string_view& line) {
+    size_t from = begin;
+    moved       = false;
+    for (;;) {
+      size_t pos = find_terminator(from);
+      if (pos != SIZE_MAX) {
+        line            = {buffer.get() + begin, pos - begin};
+        begin           = pos + 1;
+        last_terminated = true;
+        return true;
+      }
+      // everything up to end has been searched; fill() may move it
+      size_t scanned = end - begin;
+      if (eof || !fill()) {
+        if (begin == end) return false;
+        line            = {buffer.get() + begin, end - begin};
+        begin           = end;
+        last_terminated = false;
+        return true;
+      }
+      from = begin + scanned;
+    }
+  }
+
+  size_t field_splitter::find_delim() {
+    while (pos < line.size()) {
+      size_t base = pos & ~size_t(63);
+      if (base != mask_base) {
+        mask_base = base;
+        if (line.size() - base >= 64) {
+          mask = match_mask(line.data() + base, delim);
+        }
+        else {
+          mask = 0;
+          for (size_t i = base; i < line.size(); ++i)
+            mask |= uint64_t(line[i] == delim) << (i - base);
+        }
+      }
+      uint64_t m = mask & (~uint64_t(0) << (pos - base));
+      if (m != 0) return base + size_t(__builtin_ctzll(m));
+      pos = base + 64;
+    }
+    return std::string_view::npos;
+  }
+
+  bool field_splitter::next(std::string_view& field) {
+    if (pos > line.size()) return false;
+    size_t start = pos;
+    size_t hit   = find_delim();
+    if (hit == std::string_view::npos) {
+      field = line.substr(start);
+      pos   = line.size() + 1;
+      return true;
+    }
+    found = true;
+    field = line.substr(start, hit - start);
+    pos   = hit + 1;
+    return true;
+  }
+}  // namespace coreutils
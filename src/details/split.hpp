@@ -0,0 +1,83 @@
+#ifndef _CXCU_DETAILS_SPLIT_HPP_
+#define _CXCU_DETAILS_SPLIT_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace coreutils {
+  // Reads a file descriptor in large blocks and hands out its lines as views
+  // into its buffer, without the terminator. Terminators are found 64 bytes
+  // at a time with match_mask, and the mask of a block is kept for the lines
+  // that follow in it.
+  //
+  // A line stays valid until the second call to next() after the one that
+  // returned it, so callers can always compare a line with the one before.
+  class line_reader {
+  public:
+    explicit line_reader(
+      int fd, char terminator = '\n', size_t block = 256 * 1024);
+
+    // Returns false at the end of input. Throws std::system_error if reading
+    // fails.
+    bool next(std::string_view& line);
+
+    // Whether the last line returned ended with the terminator (only the
+    // last line of the input may not).
+    bool terminated() const { return last_terminated; }
+
+  private:
+    size_t find_terminator(size_t from);
+    bool fill();
+
+    int fd;
+    char terminator;
+    size_t block;
+    size_t capacity;
+    std::unique_ptr<char[]> buffer;
+    // the buffer before the last move, which still holds the previous line
+    size_t spare_capacity = 0;
+    std::unique_ptr<char[]> spare;
+    // [begin, end) is unread
+    size_t begin = 0;
+    size_t end   = 0;
+    // terminator positions in the 64 bytes at mask_base, valid up to end
+    size_t mask_base = SIZE_MAX;
+    uint64_t mask    = 0;
+    bool eof             = false;
+    bool last_terminated = true;
+    bool moved           = false;
+  };
+
+  // Splits a line at each occurrence of a delimiter, scanning 64 bytes at a
+  // time like line_reader.
+  class field_splitter {
+  public:
+    field_splitter(std::string_view line, char delim) :
+      line(line), delim(delim) {}
+
+    // Returns false after the last field. A line without delimiters is one
+    // field; an empty line is one empty field.
+    bool next(std::string_view& field);
+
+    // Whether any delimiter was found so far.
+    bool split() const { return found; }
+
+    // The rest of the line after the last field returned.
+    std::string_view rest() const {
+      return pos <= line.size() ? line.substr(pos) : std::string_view();
+    }
+
+  private:
+    size_t find_delim();
+
+    std::string_view line;
+    char delim;
+    size_t pos       = 0;
+    size_t mask_base = SIZE_MAX;
+    uint64_t mask    = 0;
+    bool found       = false;
+  };
+}  // namespace coreutils
+#endif
@@ -7,6 +7,7 @@
 #include <iostream>
 #include <locale>
 #include <regex>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -14,12 +15,13 @@
 #include <vector>
 #include "parse_error.hpp"
 
+#include <dirent.h>
 #include <fcntl.h>
 #include <fmt/core.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-using namespace std::literals::string_literals;
+using namespace std::literals::string_view_literals;
 namespace fs = std::filesystem;
 
 #ifdef __GNUC__
@@ -40,13 +42,13 @@ namespace {
   }
 #endif
 
-  long parse_int(const std::string& str) {
+  long parse_int(std::string_view str) {
     auto it = str.begin();
-    while (std::isspace(*it, std::locale()))
+    while (it != str.end() && std::isspace(*it, std::locale()))
       ++it;
 
-    long result;
-    while (!std::isspace(*it, std::locale())) {
+    long result = 0;
+    while (it != str.end() && !std::isspace(*it, std::locale())) {
       if (!std::isdigit(*it, std::locale())) {
         throw std::invalid_argument(
           fmt::format("\"{}\" is not an integer", str));
@@ -60,7 +62,7 @@ namespace {
       result += (*it++ - '0');
     }
 
-    while (it != str.end()) {
+    for (; it != str.end(); ++it) {
       if (!std::isspace(*it, std::locale())) {
         throw std::invalid_argument(
           fmt::format("\"{}\" contains more than just one integer", str));
@@ -71,36 +73,36 @@ namespace {
 }  // namespace
 
 namespace coreutils::test {
-  std::optional<opcode> try_parse_opcode(const std::string& str) {
-    static const std::unordered_map<std::string, opcode> map = {
-      {"-b"s, opcode::file_block_special},
-      {"-c"s, opcode::file_char_special},
-      {"-d"s, opcode::file_directory},
-      {"-e"s, opcode::file_exists},
-      {"-f"s, opcode::file_regular_file},
-      {"-g"s, opcode::file_set_group_id},
-      {"-h"s, opcode::file_symbolic_link},
-      {"-L"s, opcode::file_symbolic_link},
-      {"-n"s, opcode::str_not_empty},
-      {"-p"s, opcode::file_fifo},
-      {"-r"s, opcode::file_readable},
-      {"-t"s, opcode::fd_open},
-      {"-u"s, opcode::file_set_user_id},
-      {"-w"s, opcode::file_writable},
-      {"-x"s, opcode::file_executable},
-      {"-z"s, opcode::str_empty},
-      {"="s, opcode::str_equal},
-      {"!="s, opcode::str_not_equal},
-      {"-eq"s, opcode::num_equal},
-      {"-ne"s, opcode::num_not_equal},
-      {"-gt"s, opcode::num_greater},
-      {"-ge"s, opcode::num_greater_equal},
-      {"-lt"s, opcode::num_less_equal},
-      {"-a"s, opcode::bool_and},
-      {"-o"s, opcode::bool_or},
-      {"!"s, opcode::bool_not},
-      {"("s, opcode::paren_left},
-      {")"s, opcode::paren_right},
+  std::optional<opcode> try_parse_opcode(std::string_view str) {
+    static const std::unordered_map<std::string_view, opcode> map = {
+      {"-b"sv, opcode::file_block_special},
+      {"-c"sv, opcode::file_char_special},
+      {"-d"sv, opcode::file_directory},
+      {"-e"sv, opcode::file_exists},
+      {"-f"sv, opcode::file_regular_file},
+      {"-g"sv, opcode::file_set_group_id},
+      {"-h"sv, opcode::file_symbolic_link},
+      {"-L"sv, opcode::file_symbolic_link},
+      {"-n"sv, opcode::str_not_empty},
+      {"-p"sv, opcode::file_fifo},
+      {"-r"sv, opcode::file_readable},
+      {"-t"sv, opcode::fd_open},
+      {"-u"sv, opcode::file_set_user_id},
+      {"-w"sv, opcode::file_writable},
+      {"-x"sv, opcode::file_executable},
+      {"-z"sv, opcode::str_empty},
+      {"="sv, opcode::str_equal},
+      {"!="sv, opcode::str_not_equal},
+      {"-eq"sv, opcode::num_equal},
+      {"-ne"sv, opcode::num_not_equal},
+      {"-gt"sv, opcode::num_greater},
+      {"-ge"sv, opcode::num_greater_equal},
+      {"-lt"sv, opcode::num_less_equal},
+      {"-a"sv, opcode::bool_and},
+      {"-o"sv, opcode::bool_or},
+      {"!"sv, opcode::bool_not},
+      {"("sv, opcode::paren_left},
+      {")"sv, opcode::paren_right},
     };
 
     auto res = map.find(str);
@@ -109,86 +111,86 @@ namespace coreutils::test {
     else
       return std::nullopt;
   }
-  std::optional<bool> try_test_unary(opcode op, const std::string& p1) {
-    static const std::unordered_map<opcode, bool (*)(const std::string&)> map {
+  std::optional<bool> try_test_unary(opcode op, std::string_view p1) {
+    static const std::unordered_map<opcode, bool (*)(std::string_view)> map {
       {
         opcode::file_block_special,
-        [](const std::string& path) -> bool { return fs::is_block_file(path); },
+        [](std::string_view path) -> bool { return fs::is_block_file(path); },
       },
       {
         opcode::file_char_special,
-        [](const std::string& path) -> bool {
+        [](std::string_view path) -> bool {
           return fs::is_character_file(path);
         },
       },
       {
         opcode::file_directory,
-        [](const std::string& path) -> bool { return fs::is_directory(path); },
+        [](std::string_view path) -> bool { return fs::is_directory(path); },
       },
       {
         opcode::file_exists,
-        [](const std::string& path) -> bool { return fs::exists(path); },
+        [](std::string_view path) -> bool { return fs::exists(path); },
       },
       {
         opcode::file_regular_file,
-        [](const std::string& path) -> bool {
+        [](std::string_view path) -> bool {
           return fs::is_regular_file(path);
         },
       },
       {
         opcode::file_set_group_id,
-        [](const std::string& path) -> bool {
+        [](std::string_view path) -> bool {
           auto permissions = fs::status(path).permissions();
           return (permissions & fs::perms::set_gid) != fs::perms::none;
         },
       },
       {
         opcode::file_symbolic_link,
-        [](const std::string& path) -> bool { return fs::is_symlink(path); },
+        [](std::string_view path) -> bool { return fs::is_symlink(path); },
       },
       {
         opcode::str_not_empty,
-        [](const std::string& str) -> bool { return !str.empty(); },
+        [](std::string_view str) -> bool { return !str.empty(); },
       },
       {
         opcode::file_fifo,
-        [](const std::string& str) -> bool { return fs::is_fifo(str); },
+        [](std::string_view str) -> bool { return fs::is_fifo(str); },
       },
       {
         opcode::fd_open,
-        [](const std::string& str) -> bool {
+        [](std::string_view str) -> bool {
           auto fd = parse_int(str);
           return isatty(fd);
         },
       },
       {
         opcode::file_readable,
-        [](const std::string& path) -> bool {
-          return euidaccess(std::string(path).c_str(), R_OK) == 0;
+        [](std::string_view path) -> bool {
+          return *try_test_access(opcode::file_readable, AT_FDCWD, path.data());
         },
       },
       {
         opcode::file_set_user_id,
-        [](const std::string& path) -> bool {
+        [](std::string_view path) -> bool {
           auto permissions = fs::status(path).permissions();
           return (permissions & fs::perms::set_uid) != fs::perms::none;
         },
       },
       {
         opcode::file_writable,
-        [](const std::string& path) -> bool {
-          return euidaccess(std::string(path).c_str(), W_OK) == 0;
+        [](std::string_view path) -> bool {
+          return *try_test_access(opcode::file_writable, AT_FDCWD, path.data());
         },
       },
       {
         opcode::file_executable,
-        [](const std::string& path) -> bool {
-          return euidaccess(std::string(path).c_str(), X_OK) == 0;
+        [](std::string_view path) -> bool {
+          return *try_test_access(opcode::file_executable, AT_FDCWD, path.data());
         },
       },
       {
         opcode::str_empty,
-        [](const std::string& str) -> bool { return str.empty(); },
+        [](std::string_view str) -> bool { return str.empty(); },
       },
     };
 
@@ -198,26 +200,88 @@ namespace coreutils::test {
     else
       return std::nullopt;
   }
+  std::optional<bool> try_test_mode(opcode op, uint32_t mode) {
+    switch (op) {
+    case opcode::file_block_special:
+      return S_ISBLK(mode);
+    case opcode::file_char_special:
+      return S_ISCHR(mode);
+    case opcode::file_directory:
+      return S_ISDIR(mode);
+    case opcode::file_exists:
+      return true;
+    case opcode::file_regular_file:
+      return S_ISREG(mode);
+    case opcode::file_set_group_id:
+      return (mode & S_ISGID) != 0;
+    case opcode::file_symbolic_link:
+      return S_ISLNK(mode);
+    case opcode::file_fifo:
+      return S_ISFIFO(mode);
+    case opcode::file_socket:
+      return S_ISSOCK(mode);
+    case opcode::file_set_user_id:
+      return (mode & S_ISUID) != 0;
+    default:
+      return std::nullopt;
+    }
+  }
+
+  std::optional<bool> try_test_dtype(opcode op, unsigned char dtype) {
+    if (dtype == DT_UNKNOWN) return std::nullopt;
+    switch (op) {
+    case opcode::file_block_special:
+    case opcode::file_char_special:
+    case opcode::file_directory:
+    case opcode::file_exists:
+    case opcode::file_regular_file:
+    case opcode::file_symbolic_link:
+    case opcode::file_fifo:
+    case opcode::file_socket:
+      return try_test_mode(op, DTTOIF(dtype));
+    default:
+      return std::nullopt;
+    }
+  }
+
+  std::optional<bool> try_test_access(opcode op, int dirfd, const char* name) {
+    int mode;
+    switch (op) {
+    case opcode::file_readable:
+      mode = R_OK;
+      break;
+    case opcode::file_writable:
+      mode = W_OK;
+      break;
+    case opcode::file_executable:
+      mode = X_OK;
+      break;
+    default:
+      return std::nullopt;
+    }
+    return faccessat(dirfd, name, mode, AT_EACCESS) == 0;
+  }
+
   std::optional<bool> try_test_binary(
-    opcode op, const std::string& p1, const std::string& p2) {
+    opcode op, std::string_view p1, std::string_view p2) {
     static const std::unordered_map<
-      opcode, bool (*)(const std::string&, const std::string&)>
+      opcode, bool (*)(std::string_view, std::string_view)>
       map {
         {
           opcode::str_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             return a == b;
           },
         },
         {
           opcode::str_not_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             return a == b;
           },
         },
         {
           opcode::num_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -232,7 +296,7 @@ namespace coreutils::test {
         },
         {
           opcode::num_not_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -247,7 +311,7 @@ namespace coreutils::test {
         },
         {
           opcode::num_greater,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -262,7 +326,7 @@ namespace coreutils::test {
         },
         {
           opcode::num_greater_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -277,7 +341,7 @@ namespace coreutils::test {
         },
         {
           opcode::num_less,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -292,7 +356,7 @@ namespace coreutils::test {
         },
         {
           opcode::num_less_equal,
-          [](const std::string& a, const std::string& b) -> bool {
+          [](std::string_view a, std::string_view b) -> bool {
             signed long x, y;
             try {
               x = parse_int(a);
@@ -314,7 +378,7 @@ namespace coreutils::test {
       return std::nullopt;
   }
 
-  std::string eval_conditions(const std::vector<std::string>& args) {
+  std::string eval_conditions(std::span<const std::string_view> args) {
     std::string out;
     for (auto i0 = args.begin(); i0 < args.end();) {
       auto op0         = try_parse_opcode(*i0);
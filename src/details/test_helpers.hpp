@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <stdexcept>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <variant>
@@ -64,14 +65,29 @@ namespace coreutils::test {
 
   using token_t = std::variant<std::string, opcode>;
 
-  std::optional<opcode> try_parse_opcode(const std::string& str);
+  std::optional<opcode> try_parse_opcode(std::string_view str);
 
-  std::optional<bool> try_test_unary(opcode op, const std::string& p1);
+  std::optional<bool> try_test_unary(opcode op, std::string_view p1);
+
+  // Evaluates a file type or set-ID predicate against an already known
+  // st_mode, without touching the file system.
+  std::optional<bool> try_test_mode(opcode op, uint32_t mode);
+
+  // Evaluates a file type predicate against a d_type value from readdir.
+  // Returns nullopt if d_type is DT_UNKNOWN or op is not a type predicate.
+  std::optional<bool> try_test_dtype(opcode op, unsigned char dtype);
+
+  // Evaluates a permission predicate (-r, -w, -x) for the effective user on
+  // `name` relative to the directory `dirfd`.
+  std::optional<bool> try_test_access(opcode op, int dirfd, const char* name);
   
   std::optional<bool> try_test_binary(
-    opcode op, const std::string& p1, const std::string& p2);
-  
-  std::string eval_conditions(const std::vector<std::string>& args);
+    opcode op, std::string_view p1, std::string_view p2);
+
+  // Reduces args to a string of 0/1 results and logical operators for
+  // eval_logic. File operands are passed to the system as they are, so the
+  // views must be NUL-terminated (as views over argv are).
+  std::string eval_conditions(std::span<const std::string_view> args);
   bool eval_logic(const std::string& str);
 }  // namespace coreutils::test
 #endif
\ No newline at end of file
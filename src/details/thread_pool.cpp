@@ -0,0 +1,119 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+  // identifies the pool and queue of the current thread, if it is a worker
+  thread_local const coreutils::thread_pool* current_pool = nullptr;
+  thread_local size_t current_index                      = 0;
+}  // namespace
+
+namespace coreutils {
+  thread_pool::thread_pool(size_t threads) {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+
+    queues.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+      queues.push_back(std::make_unique<queue>());
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+      workers.emplace_back([this, i] { run_worker(i); });
+  }
+
+  thread_pool::~thread_pool() {
+    {
+      std::lock_guard guard(sleep_lock);
+      stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& worker : workers)
+      worker.join();
+  }
+
+  void thread_pool::submit(task t) {
+    size_t index = (current_pool == this) ?
+      current_index :
+      next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+    // counted before it becomes visible, so the counters never underflow
+    pending.fetch_add(1, std::memory_order_relaxed);
+    queued.fetch_add(1, std::memory_order_release);
+    {
+      std::lock_guard guard(queues[index]->lock);
+      queues[index]->tasks.push_back(std::move(t));
+    }
+
+    // taking the lock orders this against a worker checking `queued`
+    { std::lock_guard guard(sleep_lock); }
+    sleep_cv.notify_one();
+  }
+
+  void thread_pool::wait() {
+    std::unique_lock guard(done_lock);
+    done_cv.wait(
+      guard, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    if (error) std::rethrow_exception(std::exchange(error, nullptr));
+  }
+
+  bool thread_pool::try_pop(size_t index, task& out) {
+    {
+      // own queue: newest first
+      auto& own = *queues[index];
+      std::lock_guard guard(own.lock);
+      if (!own.tasks.empty()) {
+        out = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        return true;
+      }
+    }
+    // steal: oldest first, starting from the next queue over
+    for (size_t i = 1; i < queues.size(); ++i) {
+      auto& victim = *queues[(index + i) % queues.size()];
+      std::lock_guard guard(victim.lock);
+      if (!victim.tasks.empty()) {
+        out = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void thread_pool::finish_task() {
+    if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      std::lock_guard guard(done_lock);
+      done_cv.notify_all();
+    }
+  }
+
+  void thread_pool::run_worker(size_t index) {
+    current_pool  = this;
+    current_index = index;
+
+    task t;
+    for (;;) {
+      if (try_pop(index, t)) {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        try {
+          t();
+        }
+        catch (...) {
+          std::lock_guard guard(done_lock);
+          if (!error) error = std::current_exception();
+        }
+        t = nullptr;
+        finish_task();
+        continue;
+      }
+
+      std::unique_lock guard(sleep_lock);
+      sleep_cv.wait(guard, [this] {
+        return stopping || queued.load(std::memory_order_acquire) > 0;
+      });
+      if (stopping && queued.load(std::memory_order_acquire) == 0) return;
+    }
+  }
+}  // namespace coreutils
@@ -0,0 +1,65 @@
+#ifndef _CXCU_DETAILS_THREAD_POOL_HPP_
+#define _CXCU_DETAILS_THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace coreutils {
+  // Work-stealing thread pool. Each worker owns a deque: tasks submitted from
+  // a worker go to the back of its own deque and are popped from there (LIFO,
+  // which keeps traversals depth-first and cache-warm), while idle workers
+  // steal from the front of other deques.
+  class thread_pool {
+  public:
+    using task = std::function<void()>;
+
+    // 0 threads means one per hardware thread
+    explicit thread_pool(size_t threads = 0);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&)            = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    void submit(task t);
+
+    // Blocks until every submitted task, including tasks submitted by other
+    // tasks, has finished. Rethrows the first exception thrown by a task.
+    void wait();
+
+    size_t size() const { return workers.size(); }
+
+  private:
+    struct queue {
+      std::mutex lock;
+      std::deque<task> tasks;
+    };
+
+    void run_worker(size_t index);
+    bool try_pop(size_t index, task& out);
+    void finish_task();
+
+    std::vector<std::unique_ptr<queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> queued {0};
+    std::atomic<size_t> pending {0};
+    std::atomic<size_t> next_queue {0};
+    bool stopping = false;
+
+    std::mutex sleep_lock;
+    std::condition_variable sleep_cv;
+
+    std::mutex done_lock;
+    std::condition_variable done_cv;
+    std::exception_ptr error;
+  };
+}  // namespace coreutils
+#endif
@@ -0,0 +1,328 @@
+#include "translate.hpp"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define CXCU_TRANSLATE_X86 1
+#else
+  #define CXCU_TRANSLATE_X86 0
+#endif
+
+namespace {
+  // Past this many rows, the per-row pshufb kernels lose to a plain table
+  // lookup per byte.
+  constexpr int max_vector_rows = 6;
+
+  struct cpu_features {
+    bool ssse3 = false;
+    bool avx2  = false;
+    bool vbmi  = false;
+  };
+
+  const cpu_features& cpu() {
+    static const cpu_features features = [] {
+      cpu_features res;
+#if CXCU_TRANSLATE_X86
+      __builtin_cpu_init();
+      res.ssse3 = __builtin_cpu_supports("ssse3");
+      res.avx2  = __builtin_cpu_supports("avx2");
+      res.vbmi  = __builtin_cpu_supports("avx512vbmi");
+#endif
+      return res;
+    }();
+    return features;
+  }
+
+  // For each 8-bit keep mask, the pshufb indices that move the kept bytes
+  // of an 8-byte group to its front.
+  constexpr auto compact_shuffles = [] {
+    std::array<uint64_t, 256> table {};
+    for (unsigned keep = 0; keep < 256; ++keep) {
+      uint64_t indices = 0;
+      unsigned out     = 0;
+      for (unsigned i = 0; i < 8; ++i) {
+        if (keep & (1u << i)) indices |= uint64_t(i) << (8 * out++);
+      }
+      table[keep] = indices;
+    }
+    return table;
+  }();
+}  // namespace
+
+namespace coreutils {
+  byte_translator::byte_translator(const byte_map& map) : map(map) {
+    for (unsigned i = 0; i < 256; ++i) {
+      uint8_t delta        = uint8_t(map[i] - i);
+      deltas[i / 16][i % 16] = delta;
+      if (delta != 0) rows |= uint16_t(1u << (i / 16));
+    }
+
+    int changed = std::popcount(rows);
+    if (changed == 0)
+      kernel = [](const byte_translator&, char*, size_t) {};
+    else if (cpu().vbmi)
+      kernel = apply_vbmi;
+    else if (changed <= max_vector_rows && cpu().avx2)
+      kernel = apply_avx2;
+    else if (changed <= max_vector_rows && cpu().ssse3)
+      kernel = apply_ssse3;
+    else
+      kernel = apply_scalar;
+  }
+
+  void byte_translator::apply_scalar(
+    const byte_translator& t, char* data, size_t n) {
+    auto* p = reinterpret_cast<uint8_t*>(data);
+    for (size_t i = 0; i < n; ++i)
+      p[i] = t.map[p[i]];
+  }
+
+#if CXCU_TRANSLATE_X86
+  [[gnu::target("ssse3")]] void byte_translator::apply_ssse3(
+    const byte_translator& t, char* data, size_t n) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    size_t i             = 0;
+    for (; n - i >= 16; i += 16) {
+      __m128i x   = _mm_loadu_si128(reinterpret_cast<__m128i*>(data + i));
+      __m128i lo  = _mm_and_si128(x, nibble);
+      __m128i hi  = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+      __m128i res = x;
+      for (unsigned rows = t.rows; rows != 0; rows &= rows - 1) {
+        int k        = std::countr_zero(rows);
+        __m128i row  = _mm_load_si128(
+          reinterpret_cast<const __m128i*>(t.deltas[size_t(k)].data()));
+        __m128i hit  = _mm_cmpeq_epi8(hi, _mm_set1_epi8(char(k)));
+        __m128i diff = _mm_and_si128(_mm_shuffle_epi8(row, lo), hit);
+        res          = _mm_add_epi8(res, diff);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), res);
+    }
+    apply_scalar(t, data + i, n - i);
+  }
+
+  [[gnu::target("avx2")]] void byte_translator::apply_avx2(
+    const byte_translator& t, char* data, size_t n) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i             = 0;
+    for (; n - i >= 32; i += 32) {
+      __m256i x   = _mm256_loadu_si256(reinterpret_cast<__m256i*>(data + i));
+      __m256i lo  = _mm256_and_si256(x, nibble);
+      __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+      __m256i res = x;
+      for (unsigned rows = t.rows; rows != 0; rows &= rows - 1) {
+        int k        = std::countr_zero(rows);
+        __m256i row  = _mm256_broadcastsi128_si256(_mm_load_si128(
+          reinterpret_cast<const __m128i*>(t.deltas[size_t(k)].data())));
+        __m256i hit  = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(char(k)));
+        __m256i diff = _mm256_and_si256(_mm256_shuffle_epi8(row, lo), hit);
+        res          = _mm256_add_epi8(res, diff);
+      }
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), res);
+    }
+    apply_scalar(t, data + i, n - i);
+  }
+
+  // vpermi2b looks up 64 bytes at once in a 128-entry table (two registers)
+  // using the low 7 bits of each index; the top bit picks between the two
+  // halves of the map.
+  [[gnu::target("avx512f,avx512bw,avx512vbmi")]] void
+  byte_translator::apply_vbmi(const byte_translator& t, char* data, size_t n) {
+    const auto* table = reinterpret_cast<const __m512i*>(t.map.data());
+    const __m512i t0  = _mm512_load_si512(table + 0);
+    const __m512i t1  = _mm512_load_si512(table + 1);
+    const __m512i t2  = _mm512_load_si512(table + 2);
+    const __m512i t3  = _mm512_load_si512(table + 3);
+    for (size_t i = 0; i < n; i += 64) {
+      // the last block is done with masked loads and stores
+      __mmask64 live = n - i >= 64 ? ~__mmask64(0) :
+                                     (__mmask64(1) << (n - i)) - 1;
+      __m512i x      = _mm512_maskz_loadu_epi8(live, data + i);
+      __m512i low    = _mm512_permutex2var_epi8(t0, x, t1);
+      __m512i high   = _mm512_permutex2var_epi8(t2, x, t3);
+      __mmask64 top  = _mm512_movepi8_mask(x);
+      __m512i res    = _mm512_mask_blend_epi8(top, low, high);
+      _mm512_mask_storeu_epi8(data + i, live, res);
+    }
+  }
+#else
+  void byte_translator::apply_ssse3(
+    const byte_translator& t, char* data, size_t n) {
+    apply_scalar(t, data, n);
+  }
+
+  void byte_translator::apply_avx2(
+    const byte_translator& t, char* data, size_t n) {
+    apply_scalar(t, data, n);
+  }
+
+  void byte_translator::apply_vbmi(
+    const byte_translator& t, char* data, size_t n) {
+    apply_scalar(t, data, n);
+  }
+#endif
+
+  byte_filter::byte_filter(const byte_set& set) : set(set) {
+    for (unsigned i = 0; i < 256; ++i) {
+      if (!set[i]) continue;
+      auto& rows = i < 128 ? lo_rows : hi_rows;
+      rows[i % 16] |= uint8_t(1u << ((i / 16) % 8));
+    }
+    wide   = cpu().avx2;
+    vector = wide || cpu().ssse3;
+  }
+
+  size_t byte_filter::remove(char* data, size_t n) const {
+    int last = -1;
+    return run<false>(data, n, last);
+  }
+
+  size_t byte_filter::squeeze(char* data, size_t n, int& last) const {
+    return run<true>(data, n, last);
+  }
+
+#if CXCU_TRANSLATE_X86
+  namespace {
+    // Finds the bytes of x that are in the set described by lo_rows and
+    // hi_rows (see byte_filter).
+    [[gnu::target("ssse3")]] inline __m128i members_ssse3(
+      __m128i x, __m128i lo_rows, __m128i hi_rows) {
+      const __m128i nibble = _mm_set1_epi8(0x0F);
+      const __m128i bits   = _mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+      __m128i lo   = _mm_and_si128(x, nibble);
+      __m128i hi   = _mm_and_si128(_mm_srli_epi16(x, 4), nibble);
+      __m128i top  = _mm_cmplt_epi8(x, _mm_setzero_si128());
+      __m128i row  = _mm_or_si128(
+        _mm_andnot_si128(top, _mm_shuffle_epi8(lo_rows, lo)),
+        _mm_and_si128(top, _mm_shuffle_epi8(hi_rows, lo)));
+      __m128i bit  = _mm_shuffle_epi8(bits, hi);
+      return _mm_cmpeq_epi8(_mm_and_si128(row, bit), bit);
+    }
+
+    [[gnu::target("avx2")]] inline __m256i members_avx2(
+      __m256i x, __m256i lo_rows, __m256i hi_rows) {
+      const __m256i nibble = _mm256_set1_epi8(0x0F);
+      const __m256i bits   = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+      __m256i lo  = _mm256_and_si256(x, nibble);
+      __m256i hi  = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+      __m256i row = _mm256_blendv_epi8(
+        _mm256_shuffle_epi8(lo_rows, lo), _mm256_shuffle_epi8(hi_rows, lo), x);
+      __m256i bit = _mm256_shuffle_epi8(bits, hi);
+      return _mm256_cmpeq_epi8(_mm256_and_si256(row, bit), bit);
+    }
+
+    // Writes the bytes of x whose bit in drop is clear to out, 8 at a time.
+    // Each store writes a full 8 bytes; out is at or before the input block,
+    // so the excess only lands on bytes that are already loaded.
+    [[gnu::target("ssse3")]] inline char* compact_ssse3(
+      char* out, __m128i x, uint32_t drop) {
+      for (unsigned half = 0; half < 2; ++half) {
+        unsigned keep  = ~(drop >> (8 * half)) & 0xFF;
+        uint64_t order = compact_shuffles[keep] + 0x0808080808080808ull * half;
+        __m128i moved  = _mm_shuffle_epi8(x, _mm_cvtsi64_si128(int64_t(order)));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out), moved);
+        out += std::popcount(keep);
+      }
+      return out;
+    }
+
+    // The drop masks below work on the input bytes only. That is enough for
+    // squeezing, since a byte is only dropped when it equals the one before
+    // it, so the last byte written always equals the last byte read.
+    [[gnu::target("ssse3")]] size_t filter_ssse3(
+      char* data, size_t n, char*& out, int& last, bool squeeze,
+      const std::array<uint8_t, 16>& lo_table,
+      const std::array<uint8_t, 16>& hi_table) {
+      const __m128i lo_rows = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(lo_table.data()));
+      const __m128i hi_rows = _mm_load_si128(
+        reinterpret_cast<const __m128i*>(hi_table.data()));
+      __m128i prev = _mm_set1_epi8(char(last));
+      size_t i     = 0;
+      for (; n - i >= 16; i += 16) {
+        __m128i x   = _mm_loadu_si128(reinterpret_cast<__m128i*>(data + i));
+        __m128i hit = members_ssse3(x, lo_rows, hi_rows);
+        if (squeeze) {
+          __m128i before = _mm_alignr_epi8(x, prev, 15);
+          hit            = _mm_and_si128(hit, _mm_cmpeq_epi8(x, before));
+          prev           = x;
+        }
+        uint32_t drop = uint32_t(_mm_movemask_epi8(hit));
+        if (squeeze && i == 0 && last < 0) drop &= ~1u;
+        if (drop == 0) {
+          if (out != data + i)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), x);
+          out += 16;
+        }
+        else {
+          out = compact_ssse3(out, x, drop);
+        }
+      }
+      if (i > 0) last = uint8_t(data[i - 1]);
+      // the caller finishes the tail
+      return i;
+    }
+
+    [[gnu::target("avx2")]] size_t filter_avx2(
+      char* data, size_t n, char*& out, int& last, bool squeeze,
+      const std::array<uint8_t, 16>& lo_table,
+      const std::array<uint8_t, 16>& hi_table) {
+      const __m256i lo_rows = _mm256_broadcastsi128_si256(_mm_load_si128(
+        reinterpret_cast<const __m128i*>(lo_table.data())));
+      const __m256i hi_rows = _mm256_broadcastsi128_si256(_mm_load_si128(
+        reinterpret_cast<const __m128i*>(hi_table.data())));
+      __m256i prev = _mm256_set1_epi8(char(last));
+      size_t i     = 0;
+      for (; n - i >= 32; i += 32) {
+        __m256i x   = _mm256_loadu_si256(reinterpret_cast<__m256i*>(data + i));
+        __m256i hit = members_avx2(x, lo_rows, hi_rows);
+        if (squeeze) {
+          // x shifted up by one byte, with the last byte of prev in front
+          __m256i carry  = _mm256_permute2x128_si256(prev, x, 0x21);
+          __m256i before = _mm256_alignr_epi8(x, carry, 15);
+          hit            = _mm256_and_si256(hit, _mm256_cmpeq_epi8(x, before));
+          prev           = x;
+        }
+        uint32_t drop = uint32_t(_mm256_movemask_epi8(hit));
+        if (squeeze && i == 0 && last < 0) drop &= ~1u;
+        if (drop == 0) {
+          if (out != data + i)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), x);
+          out += 32;
+        }
+        else {
+          out = compact_ssse3(out, _mm256_castsi256_si128(x), drop & 0xFFFF);
+          out = compact_ssse3(out, _mm256_extracti128_si256(x, 1), drop >> 16);
+        }
+      }
+      if (i > 0) last = uint8_t(data[i - 1]);
+      return i;
+    }
+  }  // namespace
+#endif
+
+  template <bool Squeeze>
+  size_t byte_filter::run(char* data, size_t n, int& last) const {
+    char* out = data;
+    size_t i  = 0;
+#if CXCU_TRANSLATE_X86
+    if (vector) {
+      i = wide ? filter_avx2(data, n, out, last, Squeeze, lo_rows, hi_rows) :
+                 filter_ssse3(data, n, out, last, Squeeze, lo_rows, hi_rows);
+    }
+#endif
+    for (; i < n; ++i) {
+      auto c = uint8_t(data[i]);
+      bool drop = set[c] && (!Squeeze || int(c) == last);
+      last      = c;
+      if (!drop) *out++ = char(c);
+    }
+    return size_t(out - data);
+  }
+
+  template size_t byte_filter::run<false>(char*, size_t, int&) const;
+  template size_t byte_filter::run<true>(char*, size_t, int&) const;
+}  // namespace coreutils
@@ -0,0 +1,70 @@
+#ifndef _CXCU_DETAILS_TRANSLATE_HPP_
+#define _CXCU_DETAILS_TRANSLATE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace coreutils {
+  // A mapping from every byte value to its replacement.
+  using byte_map = std::array<uint8_t, 256>;
+
+  // A set of byte values, as a membership flag per byte.
+  using byte_set = std::array<bool, 256>;
+
+  // Applies a byte_map to buffers in place. The vector kernel is picked once,
+  // when the map is compiled, based on what the CPU supports: a 256-entry
+  // vpermi2b lookup with AVX-512 VBMI, otherwise pshufb lookups of the
+  // differences from the identity, one per 16-byte row of the map that
+  // changes anything (for the usual case-folding maps, just two).
+  class byte_translator {
+  public:
+    explicit byte_translator(const byte_map& map);
+
+    void apply(char* data, size_t n) const { kernel(*this, data, n); }
+
+  private:
+    using kernel_fn = void (*)(const byte_translator&, char*, size_t);
+
+    static void apply_scalar(const byte_translator& t, char* data, size_t n);
+    static void apply_ssse3(const byte_translator& t, char* data, size_t n);
+    static void apply_avx2(const byte_translator& t, char* data, size_t n);
+    static void apply_vbmi(const byte_translator& t, char* data, size_t n);
+
+    alignas(64) byte_map map;
+    // deltas[k][i] = map[16 * k + i] - (16 * k + i), mod 256
+    alignas(16) std::array<std::array<uint8_t, 16>, 16> deltas;
+    // bit k is set if row k of the map is not the identity
+    uint16_t rows = 0;
+    kernel_fn kernel;
+  };
+
+  // Removes bytes in a byte_set from buffers in place, or squeezes runs of
+  // them to a single byte. Membership is tested 16 or 32 bytes at a time with
+  // two pshufb lookups into a bitmap of the set.
+  class byte_filter {
+  public:
+    explicit byte_filter(const byte_set& set);
+
+    // Removes every byte in the set. Returns the new length.
+    size_t remove(char* data, size_t n) const;
+
+    // Removes every byte in the set that repeats the byte before it. `last`
+    // is the byte before data (carried over from the previous buffer), or -1
+    // at the start of the input. Returns the new length.
+    size_t squeeze(char* data, size_t n, int& last) const;
+
+  private:
+    template <bool Squeeze>
+    size_t run(char* data, size_t n, int& last) const;
+
+    byte_set set;
+    // bit j of lo_rows[i] is set if 16 * j + i is in the set (j < 8),
+    // and likewise of hi_rows[i] for 16 * (j + 8) + i
+    alignas(16) std::array<uint8_t, 16> lo_rows {};
+    alignas(16) std::array<uint8_t, 16> hi_rows {};
+    bool vector = false;
+    bool wide   = false;
+  };
+}  // namespace coreutils
+#endif
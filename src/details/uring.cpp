@@ -0,0 +1,138 @@
+#include "uring.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+  int sys_io_uring_setup(unsigned entries, io_uring_params* params) {
+    return int(syscall(__NR_io_uring_setup, entries, params));
+  }
+
+  int sys_io_uring_enter(
+    int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return int(syscall(
+      __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+  }
+
+  template <typename T>
+  T* ring_ptr(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+  }
+
+  [[noreturn]] void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+  }
+}  // namespace
+
+namespace coreutils {
+  uring::uring(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = sys_io_uring_setup(entries, &params);
+    if (fd < 0) throw_errno("io_uring_setup");
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) sq_size = cq_size = std::max(sq_size, cq_size);
+
+    sq_ring = mmap(
+      nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+      IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+      sq_ring = nullptr;
+      release_and_throw("mmap");
+    }
+    if (single_mmap) {
+      cq_ring = sq_ring;
+    }
+    else {
+      cq_ring = mmap(
+        nullptr, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_CQ_RING);
+      if (cq_ring == MAP_FAILED) {
+        cq_ring = nullptr;
+        release_and_throw("mmap");
+      }
+    }
+
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqe_mem = mmap(
+      nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      fd, IORING_OFF_SQES);
+    if (sqe_mem == MAP_FAILED) release_and_throw("mmap");
+    sqes = static_cast<io_uring_sqe*>(sqe_mem);
+
+    sq_head    = ring_ptr<unsigned>(sq_ring, params.sq_off.head);
+    sq_tail    = ring_ptr<unsigned>(sq_ring, params.sq_off.tail);
+    sq_array   = ring_ptr<unsigned>(sq_ring, params.sq_off.array);
+    sq_mask    = *ring_ptr<unsigned>(sq_ring, params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    local_tail = submitted = *sq_tail;
+
+    cq_head = ring_ptr<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = ring_ptr<unsigned>(cq_ring, params.cq_off.tail);
+    cqes    = ring_ptr<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+    cq_mask = *ring_ptr<unsigned>(cq_ring, params.cq_off.ring_mask);
+  }
+
+  uring::~uring() { release(); }
+
+  void uring::release_and_throw(const char* what) {
+    int err = errno;
+    release();
+    errno = err;
+    throw_errno(what);
+  }
+
+  void uring::release() {
+    if (sqes) munmap(sqes, sqes_size);
+    if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_size);
+    if (sq_ring) munmap(sq_ring, sq_size);
+    if (fd >= 0) close(fd);
+    sqes = nullptr;
+    cq_ring = sq_ring = nullptr;
+    fd = -1;
+  }
+
+  io_uring_sqe* uring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (local_tail - head >= sq_entries) return nullptr;
+
+    unsigned index  = local_tail & sq_mask;
+    sq_array[index] = index;
+    ++local_tail;
+
+    io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+  }
+
+  bool uring::submit(unsigned wait_nr) {
+    __atomic_store_n(sq_tail, local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = local_tail - submitted;
+    unsigned flags     = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+      int res = sys_io_uring_enter(fd, to_submit, wait_nr, flags);
+      if (res >= 0) {
+        submitted += unsigned(res);
+        return true;
+      }
+      if (errno != EINTR) return false;
+    }
+  }
+
+  bool uring::pop_cqe(io_uring_cqe& out) {
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return false;
+    out = cqes[head & cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+}  // namespace coreutils
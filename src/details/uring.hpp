@@ -0,0 +1,59 @@
+#ifndef _CXCU_DETAILS_URING_HPP_
+#define _CXCU_DETAILS_URING_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+namespace coreutils {
+  // Minimal io_uring wrapper over the raw syscalls: a single submission and
+  // completion queue pair, no registered buffers or files.
+  class uring {
+  public:
+    // Throws std::system_error if io_uring is unavailable (old kernel, or
+    // disabled by seccomp or sysctl).
+    explicit uring(unsigned entries);
+    ~uring();
+
+    uring(const uring&)            = delete;
+    uring& operator=(const uring&) = delete;
+
+    // Returns a zeroed SQE, or nullptr if the submission queue is full.
+    io_uring_sqe* get_sqe();
+
+    // Submits all queued SQEs and waits for at least `wait_nr` completions.
+    // Returns false and sets errno on failure.
+    bool submit(unsigned wait_nr = 0);
+
+    // Pops one completion if any is available.
+    bool pop_cqe(io_uring_cqe& out);
+
+  private:
+    void release();
+    [[noreturn]] void release_and_throw(const char* what);
+
+    int fd = -1;
+
+    void* sq_ring  = nullptr;
+    size_t sq_size = 0;
+    void* cq_ring  = nullptr;
+    size_t cq_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size   = 0;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned local_tail = 0;
+    unsigned submitted  = 0;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    io_uring_cqe* cqes;
+    unsigned cq_mask;
+  };
+}  // namespace coreutils
+#endif
@@ -0,0 +1,168 @@
+#include "walker.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  // getdents64 fills as much of the buffer as it can, so a large buffer means
+  // one or two syscalls for all but the biggest directories
+  constexpr size_t dents_buffer_size = 256 * 1024;
+
+  bool is_dot_or_dotdot(const char* name) {
+    return name[0] == '.' &&
+      (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+  }
+}  // namespace
+
+namespace coreutils::walk {
+  bool entry::is_dir() const {
+    if (type != DT_UNKNOWN) return type == DT_DIR;
+    return has_stat && S_ISDIR(stat.stx_mode);
+  }
+
+  std::string node::child_path(std::string_view name) const {
+    std::string res;
+    res.reserve(path.size() + name.size() + 1);
+    res.append(path);
+    if (res.empty() || res.back() != '/') res.push_back('/');
+    res.append(name);
+    return res;
+  }
+
+  bool read_entries(int fd, std::vector<entry>& out) {
+    thread_local std::unique_ptr<char[]> buffer(new char[dents_buffer_size]);
+
+    for (;;) {
+      ssize_t res = getdents64(fd, buffer.get(), dents_buffer_size);
+      if (res < 0) {
+        if (errno == EINTR) continue;
+        return false;
+      }
+      if (res == 0) return true;
+
+      for (ssize_t pos = 0; pos < res;) {
+        auto* dent = reinterpret_cast<struct dirent64*>(buffer.get() + pos);
+        pos += dent->d_reclen;
+        if (is_dot_or_dotdot(dent->d_name)) continue;
+
+        auto& e = out.emplace_back();
+        e.name  = dent->d_name;
+        e.ino   = dent->d_ino;
+        e.type  = dent->d_type;
+      }
+    }
+  }
+
+  bool walker::stat_entry(
+    const node& dir, entry& e, unsigned mask, bool follow) {
+    if (e.has_stat && (e.stat.stx_mask & mask) == mask) return true;
+    int res = statx(
+      dir.fd, e.name.c_str(),
+      (follow ? 0 : AT_SYMLINK_NOFOLLOW) | AT_NO_AUTOMOUNT, mask | STATX_TYPE,
+      &e.stat);
+    if (res != 0) return false;
+    e.has_stat = true;
+    if (e.type == DT_UNKNOWN || follow) e.type = IFTODT(e.stat.stx_mode);
+    return true;
+  }
+
+  std::unique_ptr<node> walker::start(
+    thread_pool& pool, std::string path, const struct statx& stat) {
+    auto root  = std::make_unique<node>();
+    root->path = std::move(path);
+    root->stat = stat;
+
+    node* ptr = root.get();
+    pool.submit([this, &pool, ptr] { process(pool, *ptr); });
+    return root;
+  }
+
+  void walker::process(thread_pool& pool, node& dir) {
+    int nofollow = (dir.depth > 0 && !opts.follow_links) ? O_NOFOLLOW : 0;
+    dir.fd       = open(
+      dir.path.c_str(), O_RDONLY | O_DIRECTORY | nofollow | O_CLOEXEC);
+    if (dir.fd < 0 || !read_entries(dir.fd, dir.entries)) {
+      dir.error = errno;
+      if (on_error) on_error(dir);
+    }
+
+    if (dir.error == 0) {
+      // Stat everything this walk needs in one pass over the directory while
+      // its inode is hot. Directories need their type (and identity, for -x
+      // and for callers that follow links and must detect cycles) to decide
+      // whether to descend.
+      unsigned dir_mask =
+        (opts.same_device || opts.follow_links) ? STATX_TYPE | STATX_INO : 0;
+      for (auto& e : dir.entries) {
+        unsigned mask = opts.stat_mask;
+        bool link = opts.follow_links && e.type == DT_LNK;
+        if (e.type == DT_UNKNOWN || link) mask |= STATX_TYPE;
+        if (e.type == DT_DIR || e.type == DT_UNKNOWN || link) mask |= dir_mask;
+        if (mask != 0) stat_entry(dir, e, mask, opts.follow_links);
+
+        e.descend = dir.depth < opts.max_depth && e.is_dir();
+        if (e.descend && opts.same_device) {
+          e.descend = e.has_stat &&
+            e.stat.stx_dev_major == dir.stat.stx_dev_major &&
+            e.stat.stx_dev_minor == dir.stat.stx_dev_minor;
+        }
+      }
+    }
+
+    if (on_directory) on_directory(dir);
+
+    if (dir.fd >= 0) {
+      close(dir.fd);
+      dir.fd = -1;
+    }
+
+    // create all children before scheduling any, so that `children` is never
+    // resized while another thread holds a pointer into it
+    for (auto& e : dir.entries) {
+      if (!e.descend) continue;
+      auto child    = std::make_unique<node>();
+      child->parent = &dir;
+      child->slot   = dir.children.size();
+      child->index  = size_t(&e - dir.entries.data());
+      child->path   = dir.child_path(e.name);
+      child->depth  = dir.depth + 1;
+      child->stat   = e.stat;
+      e.child       = dir.children.size();
+      dir.children.push_back(std::move(child));
+    }
+    dir.pending.fetch_add(dir.children.size(), std::memory_order_relaxed);
+
+    if (!opts.keep_entries) {
+      dir.entries.clear();
+      dir.entries.shrink_to_fit();
+    }
+
+    for (auto& child : dir.children) {
+      node* ptr = child.get();
+      pool.submit([this, &pool, ptr] { process(pool, *ptr); });
+    }
+
+    complete(&dir);
+  }
+
+  void walker::complete(node* dir) {
+    // walk up the tree for as long as this thread finishes the last piece of
+    // work of a directory; no locks are needed since exactly one thread sees
+    // the counter drop to zero
+    while (dir->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      node* parent = dir->parent;
+      if (on_complete) on_complete(*dir);
+      // once the root is complete the tree belongs to the caller again, and
+      // may already be gone
+      if (parent == nullptr) return;
+      if (dir->depth > opts.retain_depth) parent->children[dir->slot].reset();
+      dir = parent;
+    }
+  }
+}  // namespace coreutils::walk
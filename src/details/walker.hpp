@@ -0,0 +1,132 @@
+#ifndef _CXCU_DETAILS_WALKER_HPP_
+#define _CXCU_DETAILS_WALKER_HPP_
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "thread_pool.hpp"
+
+namespace coreutils::walk {
+  struct node;
+
+  // A directory entry as returned by getdents64. The stat data is only
+  // filled in when something asked for it.
+  struct entry {
+    static constexpr size_t no_child = SIZE_MAX;
+
+    std::string name;
+    uint64_t ino;
+    unsigned char type;  // DT_* constant, DT_UNKNOWN if the fs doesn't say
+
+    bool has_stat  = false;
+    bool descend   = false;  // walk into this entry after the callback
+    bool selected  = true;   // free for the callbacks to use
+    size_t child   = no_child;  // index into node::children if descended
+    uint64_t total = 0;         // free for the callbacks to use
+    struct statx stat {};
+
+    bool is_dir() const;
+  };
+
+  // A directory being walked. Nodes form a tree mirroring the file system;
+  // subdirectories are kept in `children` in the order they were listed.
+  struct node {
+    node* parent = nullptr;
+    size_t slot  = 0;  // index in parent->children
+    size_t index = 0;  // index in parent->entries
+    std::string path;
+    int depth = 0;
+    struct statx stat {};
+
+    // only valid during walker::on_directory
+    int fd = -1;
+    // errno if the directory could not be read
+    int error = 0;
+
+    std::vector<entry> entries;
+    std::vector<std::unique_ptr<node>> children;
+
+    // Reduction slot for callbacks. Children are completed before their
+    // parent, so a child may add to parent->total in on_complete and the
+    // parent will see the final value in its own on_complete.
+    std::atomic<uint64_t> total {0};
+    // outstanding children, plus one for the directory itself
+    std::atomic<size_t> pending {1};
+
+    // Text for callbacks to build up while walking and write out once the
+    // walk is done, e.g. to keep output in tree order.
+    std::string output;
+    std::string errors;
+
+    std::string child_path(std::string_view name) const;
+  };
+
+  struct options {
+    // statx fields to load for every entry up front; 0 loads entries lazily
+    unsigned stat_mask = 0;
+    // don't descend into directories on other file systems
+    bool same_device = false;
+    // don't descend below this depth (roots are depth 0)
+    int max_depth = INT_MAX;
+    // subtrees deeper than this are freed as soon as they are complete
+    int retain_depth = INT_MAX;
+    // keep node::entries after on_directory
+    bool keep_entries = true;
+    // stat entries through symlinks and descend into linked directories;
+    // callers must guard against cycles themselves (the roots are always
+    // opened through symlinks, since the caller has already decided they are
+    // directories)
+    bool follow_links = false;
+  };
+
+  // Parallel directory walker. Each directory is a task on a thread pool:
+  // it is read with large getdents64 calls, its entries are stat'ed in one
+  // batch relative to the directory's fd (no path lookups), and its
+  // subdirectories are submitted as new tasks.
+  class walker {
+  public:
+    explicit walker(options opts) : opts(opts) {}
+
+    // Called once a directory's entries have been read, on a worker thread.
+    // May clear entry::descend to prune subdirectories.
+    std::function<void(node&)> on_directory;
+    // Called after all subdirectories of a directory are complete, on a
+    // worker thread. The walker doesn't touch the tree after calling this for
+    // the root.
+    std::function<void(node&)> on_complete;
+    // Called for directories that could not be opened or read. May be called
+    // from several threads at once.
+    std::function<void(const node&)> on_error;
+
+    // Starts walking the directory at `path`. The walk is finished once
+    // pool.wait() returns; until then the tree must not be inspected.
+    std::unique_ptr<node> start(
+      thread_pool& pool, std::string path, const struct statx& stat);
+
+    // Loads the stat data of an entry relative to the directory's fd, of the
+    // symlink's target if `follow` is set. Returns false and sets errno on
+    // failure.
+    static bool stat_entry(
+      const node& dir, entry& e, unsigned mask, bool follow = false);
+
+  private:
+    void process(thread_pool& pool, node& dir);
+    void complete(node* dir);
+
+    options opts;
+  };
+
+  // Reads all entries of an open directory (except . and ..). Returns false
+  // and sets errno on failure.
+  bool read_entries(int fd, std::vector<entry>& out);
+}  // namespace coreutils::walk
+#endif
@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/inode_set.hpp"
+#include "details/output_buffer.hpp"
+#include "details/thread_pool.hpp"
+#include "details/walker.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: du [OPTIONS...] [FILES...]
+
+Summarizes the disk usage of each FILE, recursively for directories. If no
+FILES are specified, summarizes the current directory.
+
+Options:
+  -a      write counts for all files, not just directories
+  -h      write sizes in human readable form (e.g. 1.5K, 23M, 4.0G)
+  -k      write sizes in units of 1024 bytes instead of 512 bytes
+  -s      only write the total for each FILE
+  -x      do not cross file system boundaries
+
+  --max-depth N
+          only write totals for directories at most N levels below FILE
+  --help  print this help page and exit
+
+Files with multiple hard links are only counted once.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string> paths;
+
+  bool all_files : 1   = false;
+  bool human : 1       = false;
+  bool summarize : 1   = false;
+  bool same_device : 1 = false;
+
+  size_t block_size = 512;
+  int max_depth     = INT_MAX;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-a", 0>([&] { data.all_files = true; }),
+    option<"-h", 0>([&] { data.human = true; }),
+    option<"-k", 0>([&] { data.block_size = 1024; }),
+    option<"-s", 0>([&] { data.summarize = true; }),
+    option<"-x", 0>([&] { data.same_device = true; }),
+    option<"--max-depth", 1>([&](std::string_view arg) {
+      int depth;
+      auto res = std::from_chars(arg.data(), arg.data() + arg.size(), depth);
+      if (res.ec != std::errc {} || res.ptr != arg.data() + arg.size() ||
+          depth < 0) {
+        std::cerr << fmt::format("{}: invalid maximum depth '{}'\n", argv[0], arg);
+        exit(1);
+      }
+      data.max_depth = depth;
+    }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+
+  if (data.paths.empty()) data.paths.emplace_back(".");
+  if (data.summarize) data.max_depth = 0;
+  return data;
+}
+
+namespace {
+  namespace walk = coreutils::walk;
+
+  constexpr unsigned du_stat_mask =
+    STATX_TYPE | STATX_NLINK | STATX_INO | STATX_BLOCKS;
+
+  // `blocks` is in 512-byte units, as reported by statx
+  void write_size(
+    coreutils::output_buffer& out, const option_data& config, uint64_t blocks) {
+    if (!config.human) {
+      uint64_t bytes = blocks * 512;
+      out.format("{}", (bytes + config.block_size - 1) / config.block_size);
+      return;
+    }
+
+    static constexpr char suffixes[] = "KMGTPE";
+    double value = double(blocks) * 512;
+    if (value < 1024) {
+      out.format("{}", uint64_t(value));
+      return;
+    }
+    size_t unit = 0;
+    value /= 1024;
+    while (value >= 1024 && unit + 1 < sizeof(suffixes) - 1) {
+      value /= 1024;
+      ++unit;
+    }
+    // round up like the other du implementations do, so that a size is
+    // never reported smaller than it is
+    if (value < 10 && std::ceil(value * 10) < 100)
+      out.format("{:.1f}{}", std::ceil(value * 10) / 10, suffixes[unit]);
+    else
+      out.format("{:.0f}{}", std::ceil(value), suffixes[unit]);
+  }
+
+  void write_line(
+    coreutils::output_buffer& out, const option_data& config, uint64_t blocks,
+    std::string_view path) {
+    write_size(out, config, blocks);
+    out.put('\t');
+    out.write(path);
+    out.put('\n');
+  }
+
+  // writes the tree in the same order as a serial depth-first walk would
+  void write_tree(
+    coreutils::output_buffer& out, const option_data& config,
+    const walk::node& dir) {
+    if (config.all_files && dir.depth < config.max_depth) {
+      for (auto& e : dir.entries) {
+        if (e.child != walk::entry::no_child) {
+          if (dir.children[e.child])
+            write_tree(out, config, *dir.children[e.child]);
+        }
+        else if (e.selected) {
+          write_line(out, config, e.total, dir.child_path(e.name));
+        }
+      }
+    }
+    else {
+      for (auto& child : dir.children) {
+        if (child) write_tree(out, config, *child);
+      }
+    }
+    if (dir.depth <= config.max_depth)
+      write_line(out, config, dir.total.load(), dir.path);
+  }
+
+  // Where a file with several links was met: its operand, the entry
+  // indices of the directories on the way down to it, and its own index.
+  struct link_pos {
+    size_t operand = 0;
+    // shared by all files met in one directory; null for an operand
+    std::shared_ptr<const std::vector<size_t>> dirs;
+    size_t entry = 0;
+    // the nearest directory whose total is kept, or null for an operand
+    walk::node* charged = nullptr;
+    // whether the file is in charged->entries, to be written with -a
+    bool listed = false;
+
+    // Whether a serial walk would have met this file before other.
+    bool before(const link_pos& other) const {
+      if (operand != other.operand) return operand < other.operand;
+      auto& a  = *dirs;
+      auto& b  = *other.dirs;
+      size_t n = std::min(a.size(), b.size());
+      for (size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i]) return a[i] < b[i];
+      }
+      // one directory contains the other, or they are the same
+      size_t next_a = a.size() > n ? a[n] : entry;
+      size_t next_b = b.size() > n ? b[n] : other.entry;
+      return next_a < next_b;
+    }
+  };
+
+  // The visit a file with several links is charged to, so far.
+  struct link_claim {
+    link_pos owner;
+    uint64_t blocks = 0;
+  };
+
+  coreutils::file_id id_of(const struct statx& stx) {
+    return {makedev(stx.stx_dev_major, stx.stx_dev_minor), stx.stx_ino};
+  }
+
+  // Whether one of the ancestors of the directory at path is in dirs.
+  bool below_any(const coreutils::inode_set& dirs, const std::string& path) {
+    int fd = open(path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool found = false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) st.st_ino = 0;
+    while (st.st_ino != 0) {
+      int up = openat(fd, "..", O_PATH | O_DIRECTORY | O_CLOEXEC);
+      struct stat up_st;
+      if (up < 0 || fstat(up, &up_st) != 0) {
+        if (up >= 0) close(up);
+        break;
+      }
+      close(fd);
+      fd = up;
+      // the root is its own parent
+      if (up_st.st_dev == st.st_dev && up_st.st_ino == st.st_ino) break;
+      if (dirs.contains({up_st.st_dev, up_st.st_ino})) {
+        found = true;
+        break;
+      }
+      st = up_st;
+    }
+    close(fd);
+    return found;
+  }
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+
+  std::mutex err_lock;
+  std::atomic<int> status {0};
+  auto report = [&](std::string_view what, std::string_view path, int err) {
+    std::lock_guard guard(err_lock);
+    std::cerr << fmt::format(
+      "{}: {} '{}': {}\n", argv[0], what, path, std::strerror(err));
+    status = 1;
+  };
+
+  // operands are walked concurrently, but written in order
+  struct root {
+    std::string path;
+    struct statx stat;
+    uint64_t blocks = 0;
+    bool valid      = false;
+    std::unique_ptr<walk::node> tree;
+  };
+  std::vector<root> roots(config.paths.size());
+
+  // Directories are only counted once, even if operands overlap: an
+  // operand inside one already given is skipped, and walks skip the
+  // operands given before them. Both only need the directory operands,
+  // which are all known before any walk starts.
+  coreutils::inode_set walked;
+  std::unordered_map<coreutils::file_id, size_t, coreutils::file_id_hash>
+    operand_of;
+  for (size_t i = 0; i < config.paths.size(); ++i) {
+    auto& r = roots[i];
+    r.path  = config.paths[i];
+    if (statx(
+          AT_FDCWD, r.path.c_str(), AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+          du_stat_mask, &r.stat) != 0) {
+      report("cannot access", r.path, errno);
+      continue;
+    }
+    r.valid = true;
+    if (!S_ISDIR(r.stat.stx_mode)) continue;
+    if (walked.contains(id_of(r.stat)) || below_any(walked, r.path)) {
+      r.valid = false;
+      continue;
+    }
+    walked.insert(id_of(r.stat));
+    operand_of.emplace(id_of(r.stat), i);
+  }
+  bool overlap = operand_of.size() > 1;
+
+  // Files with several links are counted once, at the visit a serial walk
+  // would make first. The first visit to get to a file is charged for it;
+  // should a visit that comes before it in that order turn up later, the
+  // charge moves there and the earlier one is refunded after the walk.
+  coreutils::inode_map<link_claim> claims;
+  std::mutex refunds_lock;
+  std::vector<link_claim> refunds;
+  auto claim = [&](const coreutils::file_id& id, link_pos pos,
+                   uint64_t blocks) {
+    bool charged = false;
+    claims.update(id, [&](link_claim& c, bool inserted) {
+      if (!inserted && !pos.before(c.owner)) return;
+      if (!inserted) {
+        std::lock_guard guard(refunds_lock);
+        refunds.push_back(std::move(c));
+      }
+      c.owner  = std::move(pos);
+      c.blocks = blocks;
+      charged  = true;
+    });
+    return charged;
+  };
+
+  coreutils::thread_pool pool;
+  walk::options walk_opts;
+  walk_opts.stat_mask    = du_stat_mask;
+  walk_opts.same_device  = config.same_device;
+  walk_opts.retain_depth = config.max_depth;
+  walk_opts.keep_entries = config.all_files;
+
+  walk::walker walker(walk_opts);
+  walker.on_error = [&](const walk::node& dir) {
+    report("cannot read directory", dir.path, dir.error);
+  };
+  walker.on_directory = [&](walk::node& dir) {
+    uint64_t sum = dir.stat.stx_blocks;
+    // where files with several links are, worked out for the first one
+    link_pos here;
+    for (auto& e : dir.entries) {
+      // subdirectories add their own totals once they are complete
+      if (e.descend) {
+        if (!overlap || !walked.contains(id_of(e.stat))) continue;
+        e.descend = false;
+      }
+      e.selected = false;
+      if (!e.has_stat && !walk::walker::stat_entry(dir, e, du_stat_mask)) {
+        report("cannot access", dir.child_path(e.name), errno);
+        continue;
+      }
+      // directories on other file systems (-x), or given as operands, are
+      // not counted here at all
+      if (S_ISDIR(e.stat.stx_mode)) continue;
+      if (e.stat.stx_nlink > 1) {
+        if (!here.dirs) {
+          auto dirs           = std::make_shared<std::vector<size_t>>();
+          const walk::node* n = &dir;
+          for (; n->parent; n = n->parent)
+            dirs->push_back(n->index);
+          std::reverse(dirs->begin(), dirs->end());
+          here.dirs    = std::move(dirs);
+          here.operand = operand_of.at(id_of(n->stat));
+          // subtrees below max_depth are freed once they are complete
+          here.charged = &dir;
+          while (here.charged->depth > config.max_depth)
+            here.charged = here.charged->parent;
+          here.listed = here.charged == &dir && config.all_files;
+        }
+        link_pos pos = here;
+        pos.entry    = size_t(&e - dir.entries.data());
+        if (!claim(id_of(e.stat), std::move(pos), e.stat.stx_blocks))
+          continue;
+      }
+      e.selected = true;
+      e.total    = e.stat.stx_blocks;
+      sum += e.total;
+    }
+    dir.total.fetch_add(sum, std::memory_order_relaxed);
+  };
+  walker.on_complete = [&](walk::node& dir) {
+    if (dir.parent)
+      dir.parent->total.fetch_add(
+        dir.total.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  };
+
+  for (size_t i = 0; i < roots.size(); ++i) {
+    auto& r = roots[i];
+    if (!r.valid) continue;
+    if (S_ISDIR(r.stat.stx_mode)) {
+      r.tree = walker.start(pool, r.path, r.stat);
+      continue;
+    }
+    r.blocks = r.stat.stx_blocks;
+    if (r.stat.stx_nlink > 1) {
+      link_pos pos;
+      pos.operand = i;
+      // an operand already counted is not written at all
+      if (!claim(id_of(r.stat), std::move(pos), r.blocks)) r.valid = false;
+    }
+  }
+  pool.wait();
+
+  for (auto& c : refunds) {
+    auto& pos = c.owner;
+    if (!pos.charged) {
+      roots[pos.operand].valid = false;
+      continue;
+    }
+    if (pos.listed) pos.charged->entries[pos.entry].selected = false;
+    for (walk::node* n = pos.charged; n; n = n->parent)
+      n->total.fetch_sub(c.blocks, std::memory_order_relaxed);
+  }
+
+  try {
+    coreutils::output_buffer out;
+    for (auto& r : roots) {
+      if (!r.valid) continue;
+      if (r.tree)
+        write_tree(out, config, *r.tree);
+      else
+        write_line(out, config, r.blocks, r.path);
+    }
+    out.flush();
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.what());
+    return 1;
+  }
+  return status;
+}
@@ -1,15 +1,16 @@
 #include <cstdlib>
-#include <iostream>
 #include <string_view>
 
-#include <fmt/core.h>
+#include <unistd.h>
+
+#include "details/raw_write.hpp"
 
 using namespace std::string_view_literals;
 
 void usage(std::string_view argv0) {
-  std::cout << fmt::format(R"msg(
-usage: {0} [ignored]...
-   or: {0} --help
+  coreutils::write_all(
+    STDOUT_FILENO, {"usage: "sv, argv0, " [ignored]...\n   or: "sv, argv0,
+                    R"msg( --help
 Returns with an exit code indicating failure.
 
 Options:
@@ -17,7 +18,7 @@ Options:
   
 NOTE: Some shells have false as a builtin command, which will likely override 
 this one. Please check your shell's manual for information on its version.
-)msg"sv.substr(1), argv0);
+)msg"sv});
 }
 
 int main(int argc, char* argv[]) {
@@ -25,4 +26,4 @@ int main(int argc, char* argv[]) {
     usage(argv[0]);
   }
   return EXIT_FAILURE;
-}
\ No newline at end of file
+}
@@ -0,0 +1,747 @@
+#include <charconv>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "details/output_buffer.hpp"
+#include "details/parse_error.hpp"
+#include "details/test_helpers.hpp"
+#include "details/thread_pool.hpp"
+#include "details/walker.hpp"
+
+using namespace std::string_view_literals;
+
+using args_t = std::vector<std::string_view>;
+
+void usage(std::string_view argv0) {
+  std::cout << fmt::format(R"msg(
+usage: {0} [PATH...] [EXPRESSION]
+   or: {0} --help
+Walks the file trees at each PATH (default: .) and evaluates EXPRESSION for
+every file. If EXPRESSION contains no action, -print is implied.
+
+Global options:
+  -maxdepth N       do not evaluate files more than N levels below a PATH
+  -mindepth N       do not evaluate files less than N levels below a PATH
+  -unordered        write results as soon as they are found, instead of in
+                    the order of a serial depth-first walk
+  -xdev             do not descend into other file systems
+
+Tests:
+  -name PATTERN     base name matches the shell PATTERN
+  -iname PATTERN    like -name, but ignores case
+  -newer FILE       modified more recently than FILE
+  -perm MODE        permission bits are exactly MODE (octal)
+  -perm -MODE       all of the bits of MODE are set
+  -perm /MODE       any of the bits of MODE are set
+  -size [+-]N[ckMGb]
+                    size is more than (+), less than (-) or exactly N units,
+                    rounded up; units are 512-byte blocks by default
+  -type [bcdflps]   file is of the given type
+  -readable, -writable, -executable
+                    the effective user has the given access to the file
+
+Actions:
+  -print            write the path followed by a newline
+  -print0           write the path followed by a NUL character
+  -prune            do not descend into this directory
+
+Operators, by decreasing precedence:
+  ( EXPR )
+  ! EXPR, -not EXPR
+  EXPR1 EXPR2, EXPR1 -a EXPR2, EXPR1 -and EXPR2
+  EXPR1 -o EXPR2, EXPR1 -or EXPR2
+
+Files are only stat'ed when a test needs more than the file type reported by
+the directory listing.
+)msg"sv.substr(1), argv0);
+}
+
+namespace {
+  namespace walk = coreutils::walk;
+  using coreutils::test::opcode;
+
+  // One step of a compiled expression. Tests set the accumulator; jumps
+  // implement the short-circuiting of -a and -o.
+  struct instr {
+    enum class kind : uint8_t {
+      test_type,    // file type or set-ID bit, from d_type when possible
+      test_access,  // -readable, -writable, -executable
+      name,
+      iname,
+      perm_exact,
+      perm_all,
+      perm_any,
+      newer,
+      size_less,
+      size_equal,
+      size_greater,
+      print,
+      print0,
+      prune,
+      negate,
+      jump_if_false,
+      jump_if_true,
+    };
+
+    instr(kind k) : k(k) {}
+
+    kind k;
+    opcode op       = opcode::file_exists;
+    uint32_t target = 0;
+    uint64_t value  = 0;  // mode, size, unit or timestamp
+    uint64_t unit   = 1;
+    std::string text;
+  };
+
+  struct program {
+    std::vector<instr> code;
+    unsigned stat_mask = 0;  // union of what the tests need from statx
+  };
+
+  struct option_data {
+    std::vector<std::string> paths;
+    program prog;
+    int max_depth    = INT_MAX;
+    int min_depth    = 0;
+    bool unordered   = false;
+    bool same_device = false;
+  };
+
+  class compiler {
+  public:
+    compiler(const args_t& args, size_t pos, option_data& data) :
+      args(args), pos(pos), data(data) {}
+
+    void compile() {
+      const auto& code = data.prog.code;
+      if (pos < args.size()) {
+        parse_or();
+        if (pos < args.size())
+          throw coreutils::parse_error(
+            fmt::format("unexpected '{}'", args[pos]));
+      }
+      if (!has_action) {
+        // ( EXPR ) -print
+        if (code.empty()) {
+          emit({instr::kind::print});
+          return;
+        }
+        size_t jump = emit_jump(instr::kind::jump_if_false);
+        emit({instr::kind::print});
+        patch(jump);
+      }
+    }
+
+  private:
+    bool at(std::string_view tok) const {
+      return pos < args.size() && args[pos] == tok;
+    }
+
+    std::string_view next_arg(std::string_view opt) {
+      if (pos >= args.size())
+        throw coreutils::parse_error(
+          fmt::format("missing argument to '{}'", opt));
+      return args[pos++];
+    }
+
+    void emit(instr i) { data.prog.code.push_back(std::move(i)); }
+
+    size_t emit_jump(instr::kind k) {
+      emit({k});
+      return data.prog.code.size() - 1;
+    }
+
+    void patch(size_t jump) {
+      data.prog.code[jump].target = uint32_t(data.prog.code.size());
+    }
+
+    void parse_or() {
+      parse_and();
+      std::vector<size_t> jumps;
+      while (at("-o") || at("-or")) {
+        ++pos;
+        jumps.push_back(emit_jump(instr::kind::jump_if_true));
+        parse_and();
+      }
+      for (size_t j : jumps)
+        patch(j);
+    }
+
+    void parse_and() {
+      parse_not();
+      std::vector<size_t> jumps;
+      for (;;) {
+        if (at("-a") || at("-and"))
+          ++pos;
+        else if (pos >= args.size() || at(")") || at("-o") || at("-or"))
+          break;
+        jumps.push_back(emit_jump(instr::kind::jump_if_false));
+        parse_not();
+      }
+      for (size_t j : jumps)
+        patch(j);
+    }
+
+    void parse_not() {
+      if (at("!") || at("-not")) {
+        ++pos;
+        parse_not();
+        emit({instr::kind::negate});
+        return;
+      }
+      parse_primary();
+    }
+
+    void parse_primary() {
+      if (pos >= args.size())
+        throw coreutils::parse_error("expected an expression");
+      std::string_view tok = args[pos++];
+
+      if (tok == "(") {
+        parse_or();
+        if (!at(")")) throw coreutils::parse_error("missing ')'");
+        ++pos;
+        return;
+      }
+      if (tok == "-print" || tok == "-print0" || tok == "-prune") {
+        if (tok != "-prune") has_action = true;
+        emit({tok == "-print"  ? instr::kind::print :
+              tok == "-print0" ? instr::kind::print0 :
+                                 instr::kind::prune});
+        return;
+      }
+      if (tok == "-name" || tok == "-iname") {
+        instr i {tok == "-name" ? instr::kind::name : instr::kind::iname};
+        i.text = next_arg(tok);
+        emit(std::move(i));
+        return;
+      }
+      if (tok == "-type") {
+        parse_type(next_arg(tok));
+        return;
+      }
+      if (tok == "-readable" || tok == "-writable" || tok == "-executable") {
+        instr i {instr::kind::test_access};
+        i.op = tok == "-readable" ? opcode::file_readable :
+          tok == "-writable"      ? opcode::file_writable :
+                                    opcode::file_executable;
+        emit(std::move(i));
+        return;
+      }
+      if (tok == "-perm") {
+        parse_perm(next_arg(tok));
+        return;
+      }
+      if (tok == "-newer") {
+        parse_newer(next_arg(tok));
+        return;
+      }
+      if (tok == "-size") {
+        parse_size(next_arg(tok));
+        return;
+      }
+      throw coreutils::parse_error(fmt::format("unknown predicate '{}'", tok));
+    }
+
+    void parse_type(std::string_view arg) {
+      static const std::unordered_map<char, opcode> types {
+        {'b', opcode::file_block_special}, {'c', opcode::file_char_special},
+        {'d', opcode::file_directory},     {'f', opcode::file_regular_file},
+        {'l', opcode::file_symbolic_link}, {'p', opcode::file_fifo},
+        {'s', opcode::file_socket},
+      };
+      auto it = arg.size() == 1 ? types.find(arg[0]) : types.end();
+      if (it == types.end())
+        throw coreutils::parse_error(fmt::format("unknown type '{}'", arg));
+      instr i {instr::kind::test_type};
+      i.op = it->second;
+      emit(std::move(i));
+    }
+
+    void parse_perm(std::string_view arg) {
+      instr i {instr::kind::perm_exact};
+      if (!arg.empty() && arg[0] == '-') {
+        i.k = instr::kind::perm_all;
+        arg.remove_prefix(1);
+      }
+      else if (!arg.empty() && arg[0] == '/') {
+        i.k = instr::kind::perm_any;
+        arg.remove_prefix(1);
+      }
+      auto res = std::from_chars(arg.data(), arg.data() + arg.size(), i.value, 8);
+      if (arg.empty() || res.ec != std::errc {} ||
+          res.ptr != arg.data() + arg.size() || i.value > 07777)
+        throw coreutils::parse_error(
+          fmt::format("invalid mode '{}' (only octal modes are supported)", arg));
+      data.prog.stat_mask |= STATX_MODE;
+      emit(std::move(i));
+    }
+
+    void parse_newer(std::string_view arg) {
+      struct statx stx;
+      std::string path(arg);
+      if (statx(AT_FDCWD, path.c_str(), 0, STATX_MTIME, &stx) != 0)
+        throw coreutils::parse_error(
+          fmt::format("'{}': {}", arg, std::strerror(errno)));
+      instr i {instr::kind::newer};
+      i.value = uint64_t(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+      data.prog.stat_mask |= STATX_MTIME;
+      emit(std::move(i));
+    }
+
+    void parse_size(std::string_view arg) {
+      instr i {instr::kind::size_equal};
+      if (!arg.empty() && (arg[0] == '+' || arg[0] == '-')) {
+        i.k = arg[0] == '+' ? instr::kind::size_greater : instr::kind::size_less;
+        arg.remove_prefix(1);
+      }
+      i.unit = 512;
+      if (!arg.empty()) {
+        switch (arg.back()) {
+        case 'c': i.unit = 1; break;
+        case 'w': i.unit = 2; break;
+        case 'b': i.unit = 512; break;
+        case 'k': i.unit = 1024; break;
+        case 'M': i.unit = 1024 * 1024; break;
+        case 'G': i.unit = 1024 * 1024 * 1024; break;
+        default:
+          if (arg.back() < '0' || arg.back() > '9') {
+            throw coreutils::parse_error(
+              fmt::format("invalid -size type '{}'", arg.back()));
+          }
+          break;
+        }
+        if (arg.back() < '0' || arg.back() > '9') arg.remove_suffix(1);
+      }
+      auto res = std::from_chars(arg.data(), arg.data() + arg.size(), i.value);
+      if (arg.empty() || res.ec != std::errc {} ||
+          res.ptr != arg.data() + arg.size())
+        throw coreutils::parse_error(fmt::format("invalid size '{}'", arg));
+      data.prog.stat_mask |= STATX_SIZE;
+      emit(std::move(i));
+    }
+
+    const args_t& args;
+    size_t pos;
+    option_data& data;
+    bool has_action = false;
+  };
+
+  option_data parse_options(const args_t& args) {
+    option_data data;
+    size_t pos = 1;
+    while (pos < args.size()) {
+      auto arg = args[pos];
+      if (arg == "!" || arg == "(" || (arg.size() > 1 && arg[0] == '-')) break;
+      data.paths.emplace_back(arg);
+      ++pos;
+    }
+    if (data.paths.empty()) data.paths.emplace_back(".");
+
+    // global options come first in the expression
+    args_t rest(args.begin() + pos, args.end());
+    args_t expr;
+    for (size_t i = 0; i < rest.size(); ++i) {
+      auto depth_arg = [&](std::string_view opt) {
+        if (i + 1 >= rest.size())
+          throw coreutils::parse_error(
+            fmt::format("missing argument to '{}'", opt));
+        int n;
+        auto val = rest[++i];
+        auto res = std::from_chars(val.data(), val.data() + val.size(), n);
+        if (res.ec != std::errc {} || res.ptr != val.data() + val.size() || n < 0)
+          throw coreutils::parse_error(
+            fmt::format("invalid argument '{}' to '{}'", val, opt));
+        return n;
+      };
+      if (rest[i] == "-maxdepth")
+        data.max_depth = depth_arg(rest[i]);
+      else if (rest[i] == "-mindepth")
+        data.min_depth = depth_arg(rest[i]);
+      else if (rest[i] == "-unordered")
+        data.unordered = true;
+      else if (rest[i] == "-xdev")
+        data.same_device = true;
+      else
+        expr.push_back(rest[i]);
+    }
+    compiler(expr, 0, data).compile();
+    return data;
+  }
+
+  // What an expression is evaluated against: a directory entry, with its
+  // stat data loaded on demand.
+  struct eval_ctx {
+    const walk::node* dir;  // nullptr for a starting point
+    walk::entry& e;
+    std::string_view path;  // full path, for starting points only
+    int depth;
+    bool prune = false;
+  };
+
+  class finder {
+  public:
+    finder(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {}
+
+    void report(std::string_view path, int err) {
+      std::lock_guard guard(err_lock);
+      std::cerr << fmt::format("{}: '{}': {}\n", argv0, path, std::strerror(err));
+      status = 1;
+    }
+
+    std::string entry_path(const eval_ctx& ctx) const {
+      return ctx.dir ? ctx.dir->child_path(ctx.e.name) : std::string(ctx.path);
+    }
+
+    // Makes sure `mask` is loaded for the entry. A stat call only happens if
+    // the walker didn't already provide the fields.
+    bool need(eval_ctx& ctx, unsigned mask) {
+      auto& e = ctx.e;
+      if (e.has_stat && (e.stat.stx_mask & mask) == mask) return true;
+      bool ok;
+      if (ctx.dir) {
+        ok = walk::walker::stat_entry(*ctx.dir, e, mask);
+      }
+      else {
+        std::string path(ctx.path);
+        ok = statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW, mask | STATX_TYPE,
+                   &e.stat) == 0;
+        e.has_stat = ok;
+      }
+      if (!ok) report(entry_path(ctx), errno);
+      return ok;
+    }
+
+    // Runs the program for one entry, appending actions' output to `out`.
+    void evaluate(eval_ctx& ctx, std::string& out) {
+      const auto& code = config.prog.code;
+      auto& e          = ctx.e;
+      bool acc         = true;
+      for (size_t pc = 0; pc < code.size(); ++pc) {
+        const auto& in = code[pc];
+        switch (in.k) {
+        case instr::kind::test_type: {
+          auto res = coreutils::test::try_test_dtype(in.op, e.type);
+          if (!res && need(ctx, STATX_TYPE))
+            res = coreutils::test::try_test_mode(in.op, e.stat.stx_mode);
+          acc = res.value_or(false);
+        } break;
+        case instr::kind::test_access: {
+          std::optional<bool> res;
+          if (ctx.dir) {
+            res = coreutils::test::try_test_access(in.op, ctx.dir->fd, e.name.c_str());
+          }
+          else {
+            std::string path(ctx.path);
+            res = coreutils::test::try_test_access(in.op, AT_FDCWD, path.c_str());
+          }
+          acc = res.value_or(false);
+        } break;
+        case instr::kind::name:
+          acc = fnmatch(in.text.c_str(), e.name.c_str(), 0) == 0;
+          break;
+        case instr::kind::iname:
+          acc = fnmatch(in.text.c_str(), e.name.c_str(), FNM_CASEFOLD) == 0;
+          break;
+        case instr::kind::perm_exact:
+          acc = need(ctx, STATX_MODE) && (e.stat.stx_mode & 07777) == in.value;
+          break;
+        case instr::kind::perm_all:
+          acc = need(ctx, STATX_MODE) && (e.stat.stx_mode & in.value) == in.value;
+          break;
+        case instr::kind::perm_any:
+          acc = need(ctx, STATX_MODE) &&
+            (in.value == 0 || (e.stat.stx_mode & in.value) != 0);
+          break;
+        case instr::kind::newer:
+          acc = need(ctx, STATX_MTIME) &&
+            uint64_t(e.stat.stx_mtime.tv_sec) * 1000000000 +
+                e.stat.stx_mtime.tv_nsec >
+              in.value;
+          break;
+        case instr::kind::size_less:
+        case instr::kind::size_equal:
+        case instr::kind::size_greater: {
+          if (!need(ctx, STATX_SIZE)) {
+            acc = false;
+            break;
+          }
+          uint64_t units = (e.stat.stx_size + in.unit - 1) / in.unit;
+          acc = in.k == instr::kind::size_less ? units < in.value :
+            in.k == instr::kind::size_equal    ? units == in.value :
+                                                 units > in.value;
+        } break;
+        case instr::kind::print:
+        case instr::kind::print0:
+          if (ctx.dir) {
+            out.append(ctx.dir->path);
+            if (out.back() != '/') out.push_back('/');
+            out.append(e.name);
+          }
+          else {
+            out.append(ctx.path);
+          }
+          out.push_back(in.k == instr::kind::print ? '\n' : '\0');
+          acc = true;
+          break;
+        case instr::kind::prune:
+          ctx.prune = true;
+          acc       = true;
+          break;
+        case instr::kind::negate:
+          acc = !acc;
+          break;
+        case instr::kind::jump_if_false:
+          if (!acc) pc = in.target - 1;
+          break;
+        case instr::kind::jump_if_true:
+          if (acc) pc = in.target - 1;
+          break;
+        }
+      }
+    }
+
+    const option_data& config;
+    const char* argv0;
+    int status = 0;
+
+  private:
+    std::mutex err_lock;
+  };
+
+  // Writes output in the order a serial pre-order walk would produce it.
+  // Each directory's output is split into segments around its
+  // subdirectories; segments are written as soon as everything before them
+  // has been, so output streams while the walk is still running.
+  class ordered_output {
+  public:
+    explicit ordered_output(coreutils::output_buffer& out) : out(out) {}
+
+    // Starting points, in order. Files have their output given directly.
+    void add_root(const walk::node* tree, std::string text = {}) {
+      std::lock_guard guard(lock);
+      roots.push_back({tree, std::move(text)});
+      advance();
+    }
+
+    void add_dir(const walk::node& dir, std::vector<std::string> segments) {
+      std::lock_guard guard(lock);
+      key k = dir.parent ? key {dir.parent, dir.slot} : key {&dir, SIZE_MAX};
+      ready.emplace(k, done_dir {&dir, std::move(segments)});
+      advance();
+    }
+
+    void finish() {
+      std::lock_guard guard(lock);
+      advance();
+    }
+
+  private:
+    // children are looked up through (parent, slot), never through
+    // parent->children, which the walker may still be filling in
+    struct key {
+      const walk::node* node;
+      size_t slot;
+      bool operator==(const key&) const = default;
+    };
+    struct key_hash {
+      size_t operator()(const key& k) const noexcept {
+        return std::hash<const void*> {}(k.node) ^ (k.slot * 0x9E3779B97F4A7C15ull);
+      }
+    };
+    struct done_dir {
+      const walk::node* self;
+      std::vector<std::string> segments;
+    };
+    struct root_item {
+      const walk::node* tree;
+      std::string text;
+    };
+    struct cursor {
+      const walk::node* self;
+      std::vector<std::string> segments;
+      size_t next = 0;
+    };
+
+    bool take(const key& k) {
+      auto it = ready.find(k);
+      if (it == ready.end()) return false;
+      stack.push_back({it->second.self, std::move(it->second.segments)});
+      ready.erase(it);
+      return true;
+    }
+
+    void advance() {
+      for (;;) {
+        if (stack.empty()) {
+          if (next_root >= roots.size()) return;
+          auto& r = roots[next_root];
+          if (!r.tree) {
+            out.write(r.text);
+            ++next_root;
+            continue;
+          }
+          if (!take({r.tree, SIZE_MAX})) return;
+          ++next_root;
+        }
+
+        auto& top = stack.back();
+        if (top.next < top.segments.size()) {
+          out.write(top.segments[top.next]);
+          top.segments[top.next].clear();
+        }
+        // segment i is followed by subdirectory i
+        if (top.next + 1 < top.segments.size()) {
+          if (!take({top.self, top.next})) return;
+          stack[stack.size() - 2].next++;
+          continue;
+        }
+        stack.pop_back();
+      }
+    }
+
+    coreutils::output_buffer& out;
+    std::mutex lock;
+    std::vector<root_item> roots;
+    size_t next_root = 0;
+    std::unordered_map<key, done_dir, key_hash> ready;
+    std::vector<cursor> stack;
+  };
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  args_t args(argv, argv + argc);
+  if (args.size() == 2 && args[1] == "--help") {
+    usage(args[0]);
+    return 0;
+  }
+
+  option_data config;
+  try {
+    config = parse_options(args);
+  }
+  catch (const coreutils::parse_error& e) {
+    std::cerr << fmt::format("{}: {}\n", args[0], e.what());
+    return 1;
+  }
+
+  finder f(config, argv[0]);
+  coreutils::output_buffer out;
+  ordered_output ordered(out);
+  std::mutex out_lock;
+
+  auto write_unordered = [&](const std::string& text) {
+    if (text.empty()) return;
+    std::lock_guard guard(out_lock);
+    out.write(text);
+  };
+
+  walk::options walk_opts;
+  // walking a directory at depth d evaluates entries at depth d + 1
+  walk_opts.max_depth    = config.max_depth - 1;
+  walk_opts.same_device  = config.same_device;
+  walk_opts.keep_entries = false;
+  if (config.unordered) walk_opts.retain_depth = 0;
+
+  walk::walker walker(walk_opts);
+  walker.on_error = [&](const walk::node& dir) { f.report(dir.path, dir.error); };
+  walker.on_directory = [&](walk::node& dir) {
+    std::vector<std::string> segments(1);
+    int depth = dir.depth + 1;
+    for (auto& e : dir.entries) {
+      if (depth >= config.min_depth) {
+        eval_ctx ctx {&dir, e, {}, depth};
+        f.evaluate(ctx, segments.back());
+        if (ctx.prune) e.descend = false;
+      }
+      if (e.descend && !config.unordered) segments.emplace_back();
+    }
+    if (config.unordered) {
+      write_unordered(segments.front());
+      return;
+    }
+    ordered.add_dir(dir, std::move(segments));
+  };
+
+  coreutils::thread_pool pool;
+  std::vector<std::unique_ptr<walk::node>> trees;
+  // output is also written by the workers, whose write errors come back
+  // out of wait()
+  try {
+    for (const auto& path : config.paths) {
+      walk::entry root;
+      std::string_view base = path;
+      while (base.size() > 1 && base.back() == '/')
+        base.remove_suffix(1);
+      if (auto slash = base.rfind('/'); slash != base.npos && base.size() > 1)
+        base.remove_prefix(slash + 1);
+      root.name = base;
+      root.type = DT_UNKNOWN;
+      if (statx(AT_FDCWD, path.c_str(), AT_SYMLINK_NOFOLLOW,
+                STATX_TYPE | STATX_MODE | STATX_INO | config.prog.stat_mask,
+                &root.stat) != 0) {
+        f.report(path, errno);
+        continue;
+      }
+      root.has_stat = true;
+      root.type     = IFTODT(root.stat.stx_mode);
+
+      std::string text;
+      eval_ctx ctx {nullptr, root, path, 0};
+      if (config.min_depth == 0) f.evaluate(ctx, text);
+
+      if (!S_ISDIR(root.stat.stx_mode) || ctx.prune || config.max_depth == 0) {
+        if (config.unordered)
+          write_unordered(text);
+        else
+          ordered.add_root(nullptr, std::move(text));
+        continue;
+      }
+
+      if (config.unordered) {
+        write_unordered(text);
+        trees.push_back(walker.start(pool, path, root.stat));
+      }
+      else {
+        // the starting point's own output goes before its contents
+        ordered.add_root(nullptr, std::move(text));
+        auto tree = walker.start(pool, path, root.stat);
+        ordered.add_root(tree.get());
+        trees.push_back(std::move(tree));
+      }
+    }
+    pool.wait();
+    ordered.finish();
+    out.flush();
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.what());
+    // the walks still running use the trees
+    try {
+      pool.wait();
+    }
+    catch (const std::system_error&) {}
+    return 1;
+  }
+  return f.status;
+}
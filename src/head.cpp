@@ -0,0 +1,451 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/scan.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {} [OPTIONS...] [FILES...]
+
+Writes the first 10 lines of each FILE to standard output. With no FILES, or
+when FILE is -, reads standard input.
+
+Options:
+  -c N    write the first N bytes; with -N, all but the last N bytes
+  -n N    write the first N lines (default 10); with -N, all but the last N
+          lines
+  -q      never write headers with file names
+  -v      always write headers with file names
+  -z      lines end with NUL, not newline
+
+  --help  print this help page and exit
+
+N may end in a multiplier: b for 512, k, M, G, T, P, E for powers of 1024
+(also written KiB, MiB, ...), or kB, MB, GB, ... for powers of 1000.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  enum class headers { automatic, always, never };
+
+  std::vector<std::string> paths;
+
+  uint64_t count           = 10;
+  bool bytes : 1           = false;
+  bool all_but : 1         = false;
+  bool zero_terminated : 1 = false;
+
+  headers header_bhv = headers::automatic;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  // A count is digits followed by an optional multiplier: b (512), k, M,
+  // G, ... for powers of 1024, also written KiB, MiB, ...; or kB, MB, ...
+  // for powers of 1000.
+  auto parse_count = [&](std::string_view text) {
+    auto invalid = [&] {
+      std::cerr << fmt::format(
+        "{}: invalid number of {}: '{}'\n", argv[0],
+        data.bytes ? "bytes" : "lines", text);
+      exit(1);
+    };
+    std::string_view arg = text;
+    data.all_but = !arg.empty() && arg.front() == '-';
+    if (!arg.empty() && (arg.front() == '+' || arg.front() == '-'))
+      arg.remove_prefix(1);
+    auto res = std::from_chars(arg.data(), arg.data() + arg.size(), data.count);
+    bool overflow = res.ec == std::errc::result_out_of_range;
+    if (arg.empty() || (res.ec != std::errc {} && !overflow)) invalid();
+
+    std::string_view suffix(res.ptr, size_t(arg.data() + arg.size() - res.ptr));
+    uint64_t unit = 1;
+    if (suffix == "b") {
+      unit = 512;
+    }
+    else if (!suffix.empty()) {
+      // k and m may also be lowercase
+      static constexpr std::string_view prefixes = "KMGTPEZYRQ";
+      char c = suffix[0] == 'k' || suffix[0] == 'm' ?
+        char(std::toupper(suffix[0])) :
+        suffix[0];
+      auto power = prefixes.find(c);
+      std::string_view rest = suffix.substr(1);
+      uint64_t base = rest == "B" ? 1000 : 1024;
+      if (power == std::string_view::npos ||
+          !(rest.empty() || rest == "B" || rest == "iB"))
+        invalid();
+      for (size_t i = 0; i <= power; ++i) {
+        if (unit > UINT64_MAX / base) overflow = true;
+        unit *= base;
+      }
+    }
+    // counts too large to matter mean "everything"
+    if (overflow || data.count > UINT64_MAX / unit)
+      data.count = UINT64_MAX;
+    else
+      data.count *= unit;
+  };
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-c", 1>([&](std::string_view arg) {
+      data.bytes = true;
+      parse_count(arg);
+    }),
+    option<"-n", 1>([&](std::string_view arg) {
+      data.bytes = false;
+      parse_count(arg);
+    }),
+    option<"-q", 0>([&] { data.header_bhv = option_data::headers::never; }),
+    option<"-v", 0>([&] { data.header_bhv = option_data::headers::always; }),
+    option<"-z", 0>([&] { data.zero_terminated = true; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+
+  if (data.paths.empty()) data.paths.emplace_back("-");
+  return data;
+}
+
+namespace {
+  // Reads start small and double up to block_size, so a file is read about
+  // as far as its output goes.
+  constexpr size_t first_block = 16 * 1024;
+  constexpr size_t block_size  = 64 * 1024;
+  // Files are opened this far ahead of the one being written, each with its
+  // first block already being read in.
+  constexpr size_t prefetch_window = 32;
+  // Readahead is off until this much of a file has been read; most heads
+  // never get here, and readahead would read well past what they need.
+  constexpr off_t readahead_after = 1024 * 1024;
+
+  struct file_state {
+    std::string name;  // as given on the command line
+    int fd        = -1;
+    int error     = 0;  // from opening the file, reported in turn
+    bool seekable = false;
+  };
+
+  class header {
+  public:
+    header(const option_data& config, const char* argv0) :
+      config(config),
+      argv0(argv0),
+      terminator(config.zero_terminated ? '\0' : '\n') {}
+
+    void run() {
+      print_headers = config.header_bhv == option_data::headers::always ||
+        (config.header_bhv == option_data::headers::automatic &&
+         config.paths.size() > 1);
+
+      files.resize(config.paths.size());
+      for (size_t i = 0; i < files.size(); ++i)
+        files[i].name = config.paths[i];
+      size_t opened = 0;
+      for (size_t i = 0; i < files.size(); ++i) {
+        while (opened < files.size() && opened < i + prefetch_window)
+          open_file(files[opened++]);
+
+        auto& f = files[i];
+        if (f.fd < 0) {
+          out.flush();
+          report(fmt::format("cannot open '{}' for reading", f.name), f.error);
+          continue;
+        }
+        write_header(f);
+        head_file(f);
+        if (f.fd != STDIN_FILENO) close(f.fd);
+      }
+      out.flush();
+    }
+
+    coreutils::output_buffer out;
+    int status = 0;
+
+  private:
+    void report(std::string_view what, int err) {
+      std::cerr << fmt::format("{}: {}: {}\n", argv0, what, std::strerror(err));
+      status = 1;
+    }
+
+    void write_header(const file_state& f) {
+      if (!print_headers) return;
+      out.format(
+        "{}==> {} <==\n", first_header ? "" : "\n",
+        f.fd == STDIN_FILENO ? "standard input" : f.name);
+      first_header = false;
+    }
+
+    // Opens a file ahead of its turn. Regular files are told to expect
+    // random access, which keeps the kernel from reading ahead past the
+    // first block, and that block is asked for now, so the reads for the
+    // whole window are in flight together.
+    void open_file(file_state& f) {
+      if (f.name == "-") {
+        f.fd = STDIN_FILENO;
+      }
+      else {
+        f.fd = open(f.name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (f.fd < 0) {
+          f.error = errno;
+          return;
+        }
+      }
+      struct stat st;
+      f.seekable = fstat(f.fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        lseek(f.fd, 0, SEEK_CUR) >= 0;
+      if (!f.seekable || f.fd == STDIN_FILENO) return;
+      posix_fadvise(f.fd, 0, 0, POSIX_FADV_RANDOM);
+      if (!config.all_but && config.count > 0)
+        posix_fadvise(f.fd, 0, off_t(first_block), POSIX_FADV_WILLNEED);
+    }
+
+    void head_file(file_state& f) {
+      if (!f.seekable || (!config.all_but && !config.bytes)) {
+        if (!config.all_but) head_stream(f);
+        else if (config.bytes) all_but_bytes_stream(f);
+        else all_but_lines_stream(f);
+        return;
+      }
+
+      // stdin may be partway through the file already
+      off_t start = lseek(f.fd, 0, SEEK_CUR);
+      struct stat st;
+      fstat(f.fd, &st);
+      off_t size = std::max(st.st_size, start);
+      off_t end;
+      if (!config.all_but)
+        end = uint64_t(size - start) > config.count ?
+          start + off_t(config.count) :
+          size;
+      else if (config.bytes)
+        end = uint64_t(size - start) > config.count ?
+          size - off_t(config.count) :
+          start;
+      else
+        end = coreutils::find_last_lines(
+          f.fd, start, size, terminator, config.count);
+      copy_range(f, start, end);
+    }
+
+    // Writes [start, end) of a seekable file, leaving the file offset at
+    // end for whoever reads the file next (stdin, say, in a shell group).
+    // The kernel copies straight to the output where it can.
+    void copy_range(file_state& f, off_t start, off_t end) {
+      out.flush();
+      off_t pos = start;
+      bool copy = true, send = true;
+      while (pos < end) {
+        size_t len = size_t(end - pos);
+        ssize_t n  = -1;
+        if (copy) {
+          n = copy_file_range(f.fd, &pos, STDOUT_FILENO, nullptr, len, 0);
+          if (n < 0 && errno != EINTR) {
+            // not between these two files: try the next way
+            copy = false;
+            continue;
+          }
+        }
+        else if (send) {
+          n = sendfile(STDOUT_FILENO, f.fd, &pos, len);
+          if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            send = false;
+            continue;
+          }
+        }
+        else {
+          n = read_through_buffer(f, pos, len);
+        }
+        if (n == 0) break;
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          if (!copy && !send) {
+            report(fmt::format("error reading '{}'", f.name), errno);
+            break;
+          }
+          throw std::system_error(errno, std::generic_category(), "write");
+        }
+      }
+      lseek(f.fd, pos, SEEK_SET);
+    }
+
+    ssize_t read_through_buffer(file_state& f, off_t& pos, size_t len) {
+      auto& buf  = out.data();
+      size_t old = buf.size();
+      len        = std::min(len, block_size);
+      buf.resize(old + len);
+      ssize_t n = pread(f.fd, buf.data() + old, len, pos);
+      buf.resize(old + size_t(std::max<ssize_t>(n, 0)));
+      if (n > 0) pos += n;
+      out.maybe_flush();
+      return n;
+    }
+
+    // Reads a block, reporting errors. Returns 0 at the end of the file or
+    // on error.
+    size_t read_block(file_state& f, char* buffer, size_t len) {
+      for (;;) {
+        ssize_t n = read(f.fd, buffer, len);
+        if (n >= 0) return size_t(n);
+        if (errno == EINTR) continue;
+        report(fmt::format("error reading '{}'", f.name), errno);
+        return 0;
+      }
+    }
+
+    // The first N lines (or N bytes of a pipe): reads stop as soon as the
+    // N-th terminator has been seen. Whatever was read past it is given
+    // back to a seekable file, so the next reader starts right after.
+    void head_stream(file_state& f) {
+      if (config.count == 0) return;
+      if (!buffer) buffer.reset(new char[block_size]);
+      uint64_t left = config.count;
+      size_t step   = first_block;
+      off_t total   = 0;
+      bool ahead    = false;
+      while (left > 0) {
+        size_t want = config.bytes ? std::min<uint64_t>(left, step) : step;
+        size_t len  = read_block(f, buffer.get(), want);
+        step        = std::min(step * 2, block_size);
+        if (len == 0) break;
+        std::string_view block(buffer.get(), len);
+        if (config.bytes) {
+          left -= len;
+        }
+        else {
+          size_t n   = left;
+          size_t hit = coreutils::find_nth(block, terminator, n);
+          left       = hit == std::string_view::npos ? n : 0;
+          if (hit != std::string_view::npos) {
+            if (f.seekable) lseek(f.fd, -off_t(len - hit - 1), SEEK_CUR);
+            block = block.substr(0, hit + 1);
+          }
+        }
+        out.write(block);
+
+        total += off_t(len);
+        if (f.seekable && !ahead && total >= readahead_after) {
+          posix_fadvise(f.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+          ahead = true;
+        }
+      }
+    }
+
+    // All but the last N bytes of a pipe: holds back N bytes, writing out
+    // whatever falls behind them.
+    void all_but_bytes_stream(file_state& f) {
+      std::string held;
+      if (!buffer) buffer.reset(new char[block_size]);
+      for (;;) {
+        size_t len = read_block(f, buffer.get(), block_size);
+        if (len == 0) break;
+        if (config.count == 0) {
+          out.write({buffer.get(), len});
+          continue;
+        }
+        held.append(buffer.get(), len);
+        // only move the held bytes once a block's worth can go out
+        if (held.size() > config.count &&
+            held.size() - config.count >= block_size) {
+          size_t ready = held.size() - size_t(config.count);
+          out.write({held.data(), ready});
+          held.erase(0, ready);
+        }
+      }
+      if (held.size() > config.count)
+        out.write({held.data(), held.size() - size_t(config.count)});
+    }
+
+    // All but the last N lines of a pipe: holds back blocks until the ones
+    // after them have more than N lines, as tail does.
+    void all_but_lines_stream(file_state& f) {
+      struct chunk {
+        std::string data;
+        size_t lines;
+      };
+      std::vector<chunk> chunks;
+      size_t lines = 0;
+      if (!buffer) buffer.reset(new char[block_size]);
+      for (;;) {
+        size_t len = read_block(f, buffer.get(), block_size);
+        if (len == 0) break;
+        std::string_view block(buffer.get(), len);
+        if (config.count == 0) {
+          out.write(block);
+          continue;
+        }
+        size_t nl = coreutils::count_char(block, terminator);
+        chunks.push_back({std::string(block), nl});
+        lines += nl;
+        size_t done = 0;
+        while (chunks.size() - done > 1 &&
+               lines - chunks[done].lines > config.count) {
+          out.write(chunks[done].data);
+          lines -= chunks[done].lines;
+          ++done;
+        }
+        chunks.erase(chunks.begin(), chunks.begin() + ptrdiff_t(done));
+      }
+
+      std::string all;
+      for (auto& c : chunks)
+        all.append(c.data);
+      std::string_view scan(all);
+      if (!scan.empty() && scan.back() == terminator) scan.remove_suffix(1);
+      size_t n   = config.count;
+      size_t hit = coreutils::rfind_nth(scan, terminator, n);
+      if (hit != std::string_view::npos) out.write({all.data(), hit + 1});
+    }
+
+    const option_data& config;
+    const char* argv0;
+    char terminator;
+    std::vector<file_state> files;
+    bool print_headers = false;
+    bool first_header  = true;
+    std::unique_ptr<char[]> buffer;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  header h(config, argv[0]);
+  try {
+    h.run();
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.what());
+    return 1;
+  }
+  return h.status;
+}
@@ -0,0 +1,812 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/split.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] FILE1 FILE2
+   or: {0} --help
+For each pair of lines of FILE1 and FILE2 with the same join field, writes the
+join field followed by the other fields of both lines. The inputs must be
+sorted on their join fields, byte by byte. When FILE1 or FILE2 is -, reads
+standard input.
+
+Options:
+  -1 F             join on field F of FILE1 (default 1)
+  -2 F             join on field F of FILE2 (default 1)
+  -j F             join on field F of both files
+  -t C             fields are separated by C, and output fields too; by
+                   default, runs of blanks separate fields and leading blanks
+                   are ignored. With an empty C, the whole line is the field
+  -a N             also write the lines of FILE N (1 or 2) that have no match
+  -v N             write only the lines of FILE N that have no match
+  -o LIST          write the fields in LIST: 0 for the join field, or N.F
+                   for field F of FILE N, separated by commas or blanks. With
+                   auto, the fields of the first line of each file decide
+  -e S             write S for fields that are missing or empty
+  -z               lines end with NUL, not newline
+  --check-order    fail as soon as an input is found to be out of order
+  --nocheck-order  do not check that the inputs are sorted
+  --hash           do not require sorted inputs: load the smaller file (by
+                   size) into a hash table and stream the other past it.
+                   Output follows the streamed file, and lines of the loaded
+                   file that have no match come last
+
+  --help           print this help page and exit
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string> paths;
+  // 0-based
+  size_t key_field[2] = {0, 0};
+
+  enum class field_mode { blanks, delimited, whole_line };
+  field_mode mode = field_mode::blanks;
+  char delim      = ' ';
+
+  // -o: file 0 stands for the join field, 1 and 2 for the files
+  struct out_field {
+    size_t file;
+    size_t field;
+  };
+  std::vector<out_field> format;
+  std::string filler;
+
+  enum class order_check { normal, strict, none };
+  order_check check = order_check::normal;
+
+  bool unpaired[2] = {false, false};
+  bool paired : 1          = true;
+  bool has_format : 1      = false;
+  bool auto_format : 1     = false;
+  bool zero_terminated : 1 = false;
+  bool hash : 1            = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+
+  size_t parse_field(const char* argv0, std::string_view str) {
+    size_t value = 0;
+    auto [ptr, ec] =
+      std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc {} || ptr != str.data() + str.size() || value == 0)
+      fail(argv0, fmt::format("invalid field number: '{}'", str));
+    return value - 1;
+  }
+
+  size_t parse_file(const char* argv0, std::string_view str) {
+    if (str != "1" && str != "2")
+      fail(argv0, fmt::format("invalid field number: '{}'", str));
+    return size_t(str[0] - '1');
+  }
+
+  void parse_format(
+    const char* argv0, std::string_view list, option_data& data) {
+    data.has_format = true;
+    if (list == "auto") {
+      data.auto_format = true;
+      return;
+    }
+    while (!list.empty()) {
+      size_t end           = list.find_first_of(", \t");
+      std::string_view spec = list.substr(0, end);
+      list.remove_prefix(end == list.npos ? list.size() : end + 1);
+      if (spec == "0") {
+        data.format.push_back({0, 0});
+        continue;
+      }
+      if (spec.empty() || (spec[0] != '1' && spec[0] != '2')) {
+        fail(
+          argv0, fmt::format("invalid file number in field spec: '{}'", spec));
+      }
+      if (spec.size() < 3 || spec[1] != '.')
+        fail(argv0, fmt::format("invalid field specifier: '{}'", spec));
+      data.format.push_back(
+        {size_t(spec[0] - '0'), parse_field(argv0, spec.substr(2))});
+    }
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  using check = option_data::order_check;
+  option_data data;
+
+  // values are often attached to their options (-t, or -j1), so those are
+  // split off first
+  std::vector<const char*> args {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    bool attached        = arg.size() > 2 && arg[0] == '-' && arg[1] != '-' &&
+      std::string_view("12jtaveo").find(arg[1]) != std::string_view::npos;
+    if (!attached) {
+      args.push_back(argv[i]);
+      continue;
+    }
+    static const char* const names[] = {
+      "-1", "-2", "-j", "-t", "-a", "-v", "-e", "-o"};
+    args.push_back(names[std::string_view("12jtaveo").find(arg[1])]);
+    args.push_back(argv[i] + 2);
+  }
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-1", 1>([&](std::string_view arg) {
+      data.key_field[0] = parse_field(argv[0], arg);
+    }),
+    option<"-2", 1>([&](std::string_view arg) {
+      data.key_field[1] = parse_field(argv[0], arg);
+    }),
+    option<"-j", 1>([&](std::string_view arg) {
+      data.key_field[0] = data.key_field[1] = parse_field(argv[0], arg);
+    }),
+    option<"-t", 1>([&](std::string_view arg) {
+      if (arg.size() > 1)
+        fail(argv[0], fmt::format("multi-character tab '{}'", arg));
+      data.mode  = arg.empty() ? option_data::field_mode::whole_line :
+                                 option_data::field_mode::delimited;
+      data.delim = arg.empty() ? '\0' : arg[0];
+    }),
+    option<"-a", 1>([&](std::string_view arg) {
+      data.unpaired[parse_file(argv[0], arg)] = true;
+    }),
+    option<"-v", 1>([&](std::string_view arg) {
+      data.unpaired[parse_file(argv[0], arg)] = true;
+      data.paired                             = false;
+    }),
+    option<"-o", 1>(
+      [&](std::string_view arg) { parse_format(argv[0], arg, data); }),
+    option<"-e", 1>([&](std::string_view arg) { data.filler = arg; }),
+    option<"-z", 0>([&] { data.zero_terminated = true; }),
+    option<"--check-order", 0>([&] { data.check = check::strict; }),
+    option<"--nocheck-order", 0>([&] { data.check = check::none; }),
+    option<"--hash", 0>([&] { data.hash = true; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(int(args.size()), args.data());
+
+  if (data.paths.empty()) fail(argv[0], "missing operand");
+  if (data.paths.size() == 1)
+    fail(argv[0], fmt::format("missing operand after '{}'", data.paths[0]));
+  if (data.paths.size() > 2)
+    fail(argv[0], fmt::format("extra operand '{}'", data.paths[2]));
+  return data;
+}
+
+namespace {
+  // Byte order, as in the C locale.
+  int compare(std::string_view a, std::string_view b) {
+    size_t len = std::min(a.size(), b.size());
+    int res    = len ? std::memcmp(a.data(), b.data(), len) : 0;
+    if (res != 0) return res;
+    return a.size() < b.size() ? -1 : a.size() > b.size() ? 1 : 0;
+  }
+
+  // Same as in uniq: different lengths never match, so the length is mixed
+  // in first, and the key is taken 8 bytes at a time.
+  uint64_t hash_key(std::string_view key) {
+    const char* ptr = key.data();
+    size_t size     = key.size();
+    uint64_t hash   = size * 0x9E3779B97F4A7C15;
+    size_t i        = 0;
+    for (; i + 8 <= size; i += 8) {
+      uint64_t word;
+      std::memcpy(&word, ptr + i, 8);
+      hash = (hash ^ word) * 0xFF51AFD7ED558CCD;
+      hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+      hash = (hash ^ static_cast<unsigned char>(ptr[i])) * 0x100000001B3;
+    return hash ^ (hash >> 29);
+  }
+
+  // How lines are cut into fields. All fields are views into the line.
+  class field_rules {
+  public:
+    explicit field_rules(const option_data& config) :
+      mode(config.mode), delim(config.delim) {}
+
+    // Field n of line, or an empty view if the line has no such field.
+    std::string_view field(std::string_view line, size_t n) const {
+      if (line.empty()) return {};
+      switch (mode) {
+        case option_data::field_mode::whole_line:
+          return n == 0 ? line : std::string_view();
+        case option_data::field_mode::delimited: {
+          size_t start, end;
+          if (!locate(line, n, start, end)) return {};
+          return line.substr(start, end - start);
+        }
+        default: {
+          std::string_view res;
+          size_t i = 0;
+          for_each_blank_field(line, [&](std::string_view field) {
+            if (i++ < n) return true;
+            res = field;
+            return false;
+          });
+          return res;
+        }
+      }
+    }
+
+    // With -t: where field n of line is, as [start, end). Returns false if
+    // the line has no such field. Lines are short, so this is a plain memchr
+    // walk rather than a field_splitter.
+    bool locate(
+      std::string_view line, size_t n, size_t& start, size_t& end) const {
+      if (line.empty()) return false;
+      size_t pos = 0;
+      for (size_t i = 0;; ++i) {
+        auto next = static_cast<const char*>(
+          std::memchr(line.data() + pos, delim, line.size() - pos));
+        size_t stop = next ? size_t(next - line.data()) : line.size();
+        if (i == n) {
+          start = pos;
+          end   = stop;
+          return true;
+        }
+        if (!next) return false;
+        pos = stop + 1;
+      }
+    }
+
+    // All the fields of line, into out. An empty line has none.
+    void split(
+      std::string_view line, std::vector<std::string_view>& out) const {
+      out.clear();
+      if (line.empty()) return;
+      switch (mode) {
+        case option_data::field_mode::whole_line:
+          out.push_back(line);
+          return;
+        case option_data::field_mode::delimited: {
+          const char* ptr = line.data();
+          const char* end = ptr + line.size();
+          for (;;) {
+            auto next = static_cast<const char*>(
+              std::memchr(ptr, delim, size_t(end - ptr)));
+            out.emplace_back(ptr, size_t((next ? next : end) - ptr));
+            if (!next) return;
+            ptr = next + 1;
+          }
+        }
+        default:
+          for_each_blank_field(line, [&](std::string_view field) {
+            out.push_back(field);
+            return true;
+          });
+      }
+    }
+
+  private:
+    static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\n'; }
+
+    // Fields separated by runs of blanks, ignoring leading ones. Trailing
+    // blanks end in one empty field, as they do in other joins. Stops when
+    // f returns false.
+    template <class F>
+    static void for_each_blank_field(std::string_view line, F&& f) {
+      size_t pos = 0;
+      while (pos < line.size() && is_blank(line[pos]))
+        ++pos;
+      if (pos == line.size()) return;
+      for (;;) {
+        size_t start = pos;
+        while (pos < line.size() && !is_blank(line[pos]))
+          ++pos;
+        if (!f(line.substr(start, pos - start)) || pos == line.size()) return;
+        while (pos < line.size() && is_blank(line[pos]))
+          ++pos;
+        if (pos == line.size()) {
+          f(line.substr(pos));
+          return;
+        }
+      }
+    }
+
+    option_data::field_mode mode;
+    char delim;
+  };
+
+  // Writes joined and unpaired lines in the configured format.
+  class line_writer {
+  public:
+    line_writer(const option_data& config, const field_rules& rules) :
+      config(config),
+      rules(rules),
+      format(config.format),
+      separator(config.mode == option_data::field_mode::delimited ?
+                  config.delim :
+                  ' '),
+      terminator(config.zero_terminated ? '\0' : '\n'),
+      verbatim(
+        config.mode == option_data::field_mode::delimited &&
+        !config.has_format && config.filler.empty()) {}
+
+    // -o auto: the join field, then every other field of the first line of
+    // each file.
+    void set_auto_format(std::string_view first1, std::string_view first2) {
+      std::string_view first[2] = {first1, first2};
+      for (size_t f = 0; f < 2; ++f) {
+        rules.split(first[f], fields[f]);
+        for (size_t i = 0; i < fields[f].size(); ++i) {
+          if (i != config.key_field[f]) format.push_back({f + 1, i});
+        }
+      }
+      format.insert(format.begin(), {0, 0});
+    }
+
+    // Writes a line made of line1 and line2 (either of which may be
+    // missing, for unpaired lines), whose join field is key.
+    void write(
+      std::string_view key, const std::string_view* line1,
+      const std::string_view* line2) {
+      const std::string_view* lines[2] = {line1, line2};
+      if (verbatim) {
+        write_verbatim(key, lines);
+        return;
+      }
+      for (size_t f = 0; f < 2; ++f) {
+        if (lines[f]) rules.split(*lines[f], fields[f]);
+      }
+
+      if (config.has_format) {
+        bool first = true;
+        for (auto spec : format) {
+          if (!first) out.put(separator);
+          first = false;
+          if (spec.file == 0) {
+            put_field(key);
+            continue;
+          }
+          auto& list = fields[spec.file - 1];
+          put_field(
+            lines[spec.file - 1] && spec.field < list.size() ?
+              list[spec.field] :
+              std::string_view());
+        }
+      }
+      else {
+        put_field(key);
+        for (size_t f = 0; f < 2; ++f) {
+          if (!lines[f]) continue;
+          for (size_t i = 0; i < fields[f].size(); ++i) {
+            if (i == config.key_field[f]) continue;
+            out.put(separator);
+            put_field(fields[f][i]);
+          }
+        }
+      }
+      out.put(terminator);
+    }
+
+    void flush() { out.flush(); }
+
+  private:
+    // With -t, the default format and no -e, each line is written as it is,
+    // but for its join field: the fields before it and the fields after it
+    // are each one piece of the line, delimiters and all.
+    void write_verbatim(
+      std::string_view key, const std::string_view* const lines[2]) {
+      out.write(key);
+      for (size_t f = 0; f < 2; ++f) {
+        if (!lines[f] || lines[f]->empty()) continue;
+        std::string_view line = *lines[f];
+        size_t start, end;
+        if (!rules.locate(line, config.key_field[f], start, end)) {
+          out.put(separator);
+          out.write(line);
+          continue;
+        }
+        if (start > 0) {
+          out.put(separator);
+          out.write(line.substr(0, start - 1));
+        }
+        out.write(line.substr(end));
+      }
+      out.put(terminator);
+    }
+
+    void put_field(std::string_view field) {
+      out.write(field.empty() ? std::string_view(config.filler) : field);
+    }
+
+    const option_data& config;
+    const field_rules& rules;
+    std::vector<option_data::out_field> format;
+    char separator;
+    char terminator;
+    bool verbatim;
+    std::vector<std::string_view> fields[2];
+    coreutils::output_buffer out;
+  };
+
+  int open_input(const char* argv0, const std::string& path) {
+    if (path == "-") return STDIN_FILENO;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      std::cerr << fmt::format(
+        "{}: {}: {}\n", argv0, path, std::strerror(errno));
+      exit(1);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return fd;
+  }
+
+  // The sort-merge join. Both inputs are streamed with line_reader, whose
+  // lines are views into its buffer that stay valid for one more line.
+  // That is enough to compare keys and check the order; only when several
+  // lines share a key are all but the newest copied aside, into one buffer
+  // per input that is reused from group to group.
+  class merge_join {
+  public:
+    merge_join(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0), rules(config), writer(config, rules) {}
+
+    int run(int fd1, int fd2) {
+      input in[2] = {input(fd1, config, 0), input(fd2, config, 1)};
+      advance(in[0]);
+      advance(in[1]);
+      if (config.auto_format) writer.set_auto_format(in[0].line, in[1].line);
+
+      while (in[0].has && in[1].has) {
+        int cmp = compare(in[0].key, in[1].key);
+        if (cmp != 0) {
+          auto& in_n = in[cmp < 0 ? 0 : 1];
+          if (config.unpaired[in_n.index]) write_unpaired(in_n);
+          advance(in_n);
+          seen_unpairable = true;
+          continue;
+        }
+        gather(in[0]);
+        gather(in[1]);
+        if (!config.paired) continue;
+        for (auto& l1 : in[0].group) {
+          for (auto& l2 : in[1].group)
+            writer.write(l1.key, &l1.line, &l2.line);
+        }
+      }
+      // the rest of the longer input is read to write it, or to check its
+      // order; the check only needs it up to the first disorder
+      for (auto& rest : in) {
+        bool write = config.unpaired[rest.index];
+        if (!write && config.check == option_data::order_check::none)
+          continue;
+        while (rest.has && (write || !rest.disordered)) {
+          if (write) write_unpaired(rest);
+          advance(rest);
+        }
+      }
+
+      writer.flush();
+      if (disordered) {
+        std::cerr << fmt::format("{}: input is not in sorted order\n", argv0);
+        return 1;
+      }
+      return 0;
+    }
+
+  private:
+    struct group_line {
+      std::string_view line;
+      std::string_view key;
+      // where the line was copied to in held, or npos if it was not
+      size_t held    = std::string::npos;
+      size_t key_off = 0;
+    };
+
+    struct input {
+      input(int fd, const option_data& config, size_t index) :
+        reader(fd, config.zero_terminated ? '\0' : '\n'),
+        path(config.paths[index]),
+        index(index) {}
+
+      coreutils::line_reader reader;
+      const std::string& path;
+      size_t index;
+      std::string_view line;
+      std::string_view key;
+      size_t number   = 0;
+      bool has        = false;
+      bool disordered = false;
+      std::vector<group_line> group;
+      std::string held;
+    };
+
+    void write_unpaired(input& in) {
+      writer.write(
+        in.key, in.index == 0 ? &in.line : nullptr,
+        in.index == 1 ? &in.line : nullptr);
+    }
+
+    void advance(input& in) {
+      std::string_view prev = in.key;
+      bool had              = in.has;
+      in.has                = in.reader.next(in.line);
+      if (!in.has) return;
+      ++in.number;
+      in.key = rules.field(in.line, config.key_field[in.index]);
+      if (!had || in.disordered ||
+          config.check == option_data::order_check::none)
+        return;
+      if (config.check == option_data::order_check::normal && !seen_unpairable)
+        return;
+      if (compare(prev, in.key) > 0) {
+        writer.flush();
+        std::cerr << fmt::format(
+          "{}: {}:{}: is not sorted: {}\n", argv0, in.path, in.number,
+          in.line);
+        if (config.check == option_data::order_check::strict) exit(1);
+        in.disordered = true;
+        disordered    = true;
+      }
+    }
+
+    // Collects the current line and all that follow it with the same key,
+    // leaving the first line with another key current.
+    void gather(input& in) {
+      in.group.clear();
+      in.held.clear();
+      in.group.push_back({in.line, in.key});
+      for (;;) {
+        // reading on invalidates all but the newest line
+        if (in.group.size() >= 2) hold(in, in.group[in.group.size() - 2]);
+        advance(in);
+        if (!in.has || compare(in.key, in.group.back().key) != 0) break;
+        in.group.push_back({in.line, in.key});
+      }
+      for (auto& l : in.group) {
+        if (l.held == std::string::npos) continue;
+        l.line = std::string_view(in.held).substr(l.held, l.line.size());
+        l.key  = l.line.substr(l.key_off, l.key.size());
+      }
+    }
+
+    // The views are fixed up once the group is complete, since held may
+    // still move.
+    static void hold(input& in, group_line& l) {
+      l.key_off = l.key.empty() ? 0 : size_t(l.key.data() - l.line.data());
+      l.held    = in.held.size();
+      in.held.append(l.line);
+    }
+
+    const option_data& config;
+    const char* argv0;
+    field_rules rules;
+    line_writer writer;
+    bool seen_unpairable = false;
+    bool disordered      = false;
+  };
+
+  // The whole of an input: mapped if it is a regular file, read otherwise.
+  class whole_input {
+  public:
+    explicit whole_input(int fd) {
+      struct stat st;
+      if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size = size_t(st.st_size);
+        map  = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+          madvise(map, size, MADV_WILLNEED);
+          return;
+        }
+        map = nullptr;
+      }
+      constexpr size_t block = 256 * 1024;
+      size                   = 0;
+      for (;;) {
+        buffer.resize(size + block);
+        ssize_t len = read(fd, buffer.data() + size, block);
+        if (len < 0) {
+          if (errno == EINTR) continue;
+          throw std::system_error(errno, std::generic_category(), "read");
+        }
+        if (len == 0) break;
+        size += size_t(len);
+      }
+      buffer.resize(size);
+    }
+
+    whole_input(const whole_input&) = delete;
+    ~whole_input() {
+      if (map) munmap(map, size);
+    }
+
+    std::string_view data() const {
+      return map ? std::string_view(static_cast<const char*>(map), size) :
+                   std::string_view(buffer);
+    }
+
+  private:
+    void* map   = nullptr;
+    size_t size = 0;
+    std::string buffer;
+  };
+
+  // The hash join, for inputs in any order. The smaller input is loaded
+  // whole and its lines are put in an open-addressing table (linear
+  // probing, at most half full), with the lines sharing a key chained in
+  // input order. The other input is streamed past it.
+  class hash_join {
+  public:
+    hash_join(const option_data& config) :
+      config(config), rules(config), writer(config, rules) {}
+
+    // build is the index of the input to load.
+    int run(int fds[2], size_t build) {
+      size_t probe = 1 - build;
+      whole_input loaded(fds[build]);
+      load(loaded.data(), build);
+
+      coreutils::line_reader reader(fds[probe], terminator());
+      std::string_view line;
+      bool has = reader.next(line);
+      if (config.auto_format) {
+        std::string_view first = lines.empty() ? "" : lines[0].line;
+        if (build == 0)
+          writer.set_auto_format(first, line);
+        else
+          writer.set_auto_format(line, first);
+      }
+
+      for (; has; has = reader.next(line)) {
+        auto key = rules.field(line, config.key_field[probe]);
+        size_t i = find(key, hash_key(key));
+        if (i == none) {
+          if (config.unpaired[probe]) write_one(probe, key, line);
+          continue;
+        }
+        for (; i != none; i = lines[i].next) {
+          lines[i].matched = true;
+          if (!config.paired) continue;
+          if (build == 0)
+            writer.write(key, &lines[i].line, &line);
+          else
+            writer.write(key, &line, &lines[i].line);
+        }
+      }
+
+      if (config.unpaired[build]) {
+        for (auto& l : lines) {
+          if (!l.matched) write_one(build, l.key, l.line);
+        }
+      }
+      writer.flush();
+      return 0;
+    }
+
+  private:
+    static constexpr size_t none = SIZE_MAX;
+
+    struct entry {
+      std::string_view line;
+      std::string_view key;
+      // the next line with the same key
+      size_t next  = none;
+      bool matched = false;
+    };
+
+    struct slot {
+      uint64_t hash = 0;
+      // the first and last line with this key, or none if the slot is free
+      size_t head = none;
+      size_t tail = none;
+    };
+
+    char terminator() const { return config.zero_terminated ? '\0' : '\n'; }
+
+    void write_one(size_t file, std::string_view key, std::string_view line) {
+      writer.write(
+        key, file == 0 ? &line : nullptr, file == 1 ? &line : nullptr);
+    }
+
+    void load(std::string_view data, size_t file) {
+      char term = terminator();
+      lines.reserve(size_t(std::count(data.begin(), data.end(), term)) + 1);
+      while (!data.empty()) {
+        size_t end = data.find(term);
+        auto line  = data.substr(0, end);
+        data.remove_prefix(end == data.npos ? data.size() : end + 1);
+        lines.push_back({line, rules.field(line, config.key_field[file])});
+      }
+
+      size_t capacity = 16;
+      while (capacity < 2 * lines.size())
+        capacity *= 2;
+      slots.resize(capacity);
+      mask = capacity - 1;
+      for (size_t i = 0; i < lines.size(); ++i) {
+        uint64_t hash = hash_key(lines[i].key);
+        slot& s       = locate(lines[i].key, hash);
+        if (s.head == none) {
+          s.hash = hash;
+          s.head = i;
+        }
+        else {
+          lines[s.tail].next = i;
+        }
+        s.tail = i;
+      }
+    }
+
+    // The slot holding key, or the free slot where it would go.
+    slot& locate(std::string_view key, uint64_t hash) {
+      for (size_t at = hash & mask;; at = (at + 1) & mask) {
+        slot& s = slots[at];
+        if (s.head == none) return s;
+        if (s.hash == hash && lines[s.head].key == key) return s;
+      }
+    }
+
+    size_t find(std::string_view key, uint64_t hash) {
+      return slots.empty() ? none : locate(key, hash).head;
+    }
+
+    const option_data& config;
+    field_rules rules;
+    line_writer writer;
+    std::vector<entry> lines;
+    std::vector<slot> slots;
+    size_t mask = 0;
+  };
+
+  // The input to load for --hash: the smaller of two regular files, or the
+  // only regular file; the second file when neither size is known.
+  size_t pick_build_side(int fds[2]) {
+    struct stat st[2];
+    bool known[2];
+    for (size_t i = 0; i < 2; ++i)
+      known[i] = fstat(fds[i], &st[i]) == 0 && S_ISREG(st[i].st_mode);
+    if (known[0] && (!known[1] || st[0].st_size < st[1].st_size)) return 0;
+    return 1;
+  }
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  int fds[2]  = {
+    open_input(argv[0], config.paths[0]), open_input(argv[0], config.paths[1])};
+
+  try {
+    if (config.hash) return hash_join(config).run(fds, pick_build_side(fds));
+    return merge_join(config, argv[0]).run(fds[0], fds[1]);
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.code().message());
+    return 1;
+  }
+}
@@ -1,16 +1,51 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>
-#include <filesystem>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <span>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <fmt/core.h>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pwd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
 #include <mtap/mtap.hpp>
 
-namespace fs = std::filesystem;
+#include "details/arena.hpp"
+#include "details/digits.hpp"
+#include "details/quoting.hpp"
+#include "details/output_buffer.hpp"
+#include "details/thread_pool.hpp"
+#include "details/walker.hpp"
+
+namespace walk = coreutils::walk;
 
 void usage(std::string_view argv0) {
   using namespace std::string_view_literals;
@@ -23,10 +58,12 @@ Lists the files/directories in FILES. If no FILES are specified, lists the curre
 Options:
   -A      do not ignore entries beginning with .
   -a      Like -A, but list implied . and .. as well
+  -b      write non-printable characters as C-style escapes (\n, \ooo)
   -C      write output in columns, sorted vertically
   -c      use 'last file status change' instead of 'last modified' for [-l, -t]
   -d      do not list directory contents
-  -F      add indicator chars after each filename
+  -F, --classify
+          add indicator chars after each filename
   -f      don't sort, enable -a
   -g      don't write file owner info (enables -l)
   -H      dereference symlinks specified as arguments
@@ -38,7 +75,7 @@ Options:
   -n      write user/group id instead of name (enables -l)
   -o      don't write file group info (enables -l)
   -p      like -F, but only for directories
-  -q      replace non-printable characters with ?
+  -q      replace non-printable characters with ? (default on a terminal)
   -R      recursively list all subdirectories
   -r      for options [-s, -t], reverse order of sorting
   -S      sort entries by file size, largest first
@@ -47,6 +84,14 @@ Options:
   -u      use 'last accessed' instead of 'last modified' for [-l, -t]
   -x      write output in columns, sorted horizontally
   -1      write output line-by-line
+
+  --zero  end each name with NUL instead of newline, and don't quote names
+  --json  write one JSON object per entry and line, with its name, type, and
+          the fields asked for by other options (-i, -s, -l, -S, -t, -u, -c)
+  --watch after the listing, keep watching the listed directories (all of
+          them with -R) and report changes: on a terminal the listing is
+          redrawn, otherwise each change is written as a line starting
+          with "+ " (added), "- " (removed) or "~ " (changed)
   
   --help  print this help page and exit
 )msg"sv.substr(1),
@@ -54,15 +99,16 @@ Options:
 }
 
 struct option_data {
-  enum class format { lines, columns_v, columns_h, details, csv };
+  enum class format { lines, columns_v, columns_h, details, csv, zero, json };
   enum class time_src { last_modified, last_accessed, last_stat_change };
   enum class list_values { basic, list_hidden, list_all };
   enum class indicators { none, slash, all };
   enum class sort_key { name, none, time, size };
   enum class resolve_links { none, specified, listed };
-  enum class escape_chars { none, qmark, cstyle };
+  using escape_chars = coreutils::quote_style;
 
-  std::vector<fs::path> paths;
+  // views into argv, so no operand is copied before it's needed
+  std::pmr::vector<std::string_view> paths {coreutils::arena()};
 
   format format          = format::lines;
   indicators indicators  = indicators::none;
@@ -75,13 +121,16 @@ struct option_data {
   // list content flags
   bool list_dir_contents : 1 = true;
   bool recursive : 1         = false;
+  bool watch : 1             = false;
 
-  // detail flags
-  bool print_user : 1   = true;
-  bool print_group : 1  = true;
-  bool print_ids : 1    = false;
-  bool print_size : 1   = false;
-  bool print_serial : 1 = false;
+  // detail flags (print_details is kept when a later option changes the
+  // format, so that --json knows which fields were asked for)
+  bool print_details : 1 = false;
+  bool print_user : 1    = true;
+  bool print_group : 1   = true;
+  bool print_ids : 1     = false;
+  bool print_size : 1    = false;
+  bool print_serial : 1  = false;
 
   // sorting options
   bool sort_reverse : 1 = false;
@@ -95,6 +144,12 @@ struct option_data {
 option_data parse_options(const int argc, const char** argv) {
   using mtap::option, mtap::pos_arg;
   option_data data;
+  // like other implementations, default to columns and safe names when
+  // writing to a terminal
+  if (isatty(STDOUT_FILENO)) {
+    data.format    = option_data::format::columns_v;
+    data.esc_chars = option_data::escape_chars::qmark;
+  }
   mtap::parser opts(
     option<"--help", 0>([&] {
       usage(argv[0]);
@@ -104,46 +159,1482 @@ option_data parse_options(const int argc, const char** argv) {
       [&] { data.contents = option_data::list_values::list_hidden; }),
     option<"-a", 0>(
       [&] { data.contents = option_data::list_values::list_all; }),
+    option<"-b", 0>(
+      [&] { data.esc_chars = option_data::escape_chars::cstyle; }),
     option<"-C", 0>([&] { data.format = option_data::format::columns_v; }),
     option<"-c", 0>(
       [&] { data.timestamp = option_data::time_src::last_stat_change; }),
     option<"-d", 0>([&] { data.list_dir_contents = false; }),
     option<"-F", 0>([&] { data.indicators = option_data::indicators::all; }),
+    option<"--classify", 0>(
+      [&] { data.indicators = option_data::indicators::all; }),
     option<"-f", 0>([&] {
       data.sort_key = option_data::sort_key::none;
       data.contents = option_data::list_values::list_all;
     }),
     option<"-g", 0>([&] {
-      data.print_user = false;
-      data.format     = option_data::format::details;
+      data.print_user    = false;
+      data.print_details = true;
+      data.format        = option_data::format::details;
     }),
     option<"-H", 0>(
       [&] { data.link_bhv = option_data::resolve_links::specified; }),
     option<"-i", 0>([&] { data.print_serial = true; }),
     option<"-k", 0>([&] { data.size_block = 10; }),
-    option<"-L", 0>([&] { data.size_block = 10; }),
-    option<"-l", 0>([&] { data.format = option_data::format::details; }),
+    option<"-L", 0>(
+      [&] { data.link_bhv = option_data::resolve_links::listed; }),
+    option<"-l", 0>([&] {
+      data.print_details = true;
+      data.format        = option_data::format::details;
+    }),
     option<"-m", 0>([&] { data.format = option_data::format::csv; }),
-    option<"-n", 0>([&] { data.print_ids = true; }),
-    option<"-o", 0>([&] { data.print_group = false; }),
+    option<"-n", 0>([&] {
+      data.print_ids     = true;
+      data.print_details = true;
+      data.format        = option_data::format::details;
+    }),
+    option<"-o", 0>([&] {
+      data.print_group   = false;
+      data.print_details = true;
+      data.format        = option_data::format::details;
+    }),
     option<"-p", 0>([&] { data.indicators = option_data::indicators::slash; }),
     option<"-q", 0>([&] { data.esc_chars = option_data::escape_chars::qmark; }),
     option<"-R", 0>([&] { data.recursive = true; }),
     option<"-r", 0>([&] { data.sort_reverse = true; }),
     option<"-S", 0>([&] { data.sort_key = option_data::sort_key::size; }),
-    option<"-s", 0>([&] { data.size_block = 20; }),
+    option<"-s", 0>([&] { data.print_size = true; }),
     option<"-t", 0>([&] { data.sort_key = option_data::sort_key::time; }),
     option<"-u", 0>(
       [&] { data.timestamp = option_data::time_src::last_accessed; }),
     option<"-x", 0>([&] { data.format = option_data::format::columns_h; }),
     option<"-1", 0>([&] { data.format = option_data::format::lines; }),
+    option<"--zero", 0>([&] { data.format = option_data::format::zero; }),
+    option<"--json", 0>([&] { data.format = option_data::format::json; }),
+    option<"--watch", 0>([&] { data.watch = true; }),
     pos_arg([&](std::string_view arg) { data.paths.push_back(arg); }));
   opts.parse(argc, argv);
   return data;
 }
 
-int main(const int argc, const char* argv[]) {
-  using namespace std::string_view_literals;
 
+namespace {
+  // Where a rendered name lives in the name buffer.
+  struct name_span {
+    size_t offset;
+    size_t length;
+    size_t width;
+  };
+
+  unsigned terminal_width() {
+    winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+      return ws.ws_col;
+    if (const char* columns = std::getenv("COLUMNS")) {
+      char* end;
+      unsigned long value = std::strtoul(columns, &end, 10);
+      if (*columns != '\0' && *end == '\0' && value > 0) return unsigned(value);
+    }
+    return 80;
+  }
+
+  std::string_view type_name(unsigned char type) {
+    switch (type) {
+      case DT_REG: return "file";
+      case DT_DIR: return "directory";
+      case DT_LNK: return "symlink";
+      case DT_FIFO: return "fifo";
+      case DT_SOCK: return "socket";
+      case DT_CHR: return "char";
+      case DT_BLK: return "block";
+      default: return "unknown";
+    }
+  }
+
+  // Same as the walker's paths for its children.
+  std::string join_path(const std::string& dir, std::string_view name) {
+    std::string res = dir;
+    if (res.empty() || res.back() != '/') res.push_back('/');
+    res.append(name);
+    return res;
+  }
+
+  bool stat_at(
+    int dirfd, const char* path, walk::entry& e, unsigned mask, int flags) {
+    if (statx(dirfd, path, flags | AT_NO_AUTOMOUNT, mask | STATX_TYPE,
+              &e.stat) != 0)
+      return false;
+    e.has_stat = true;
+    e.type     = IFTODT(e.stat.stx_mode);
+    return true;
+  }
+}  // namespace
+
+// Formats timestamps the way ls -l does: "Oct 18 14:03" for recent files,
+// "Oct 18  2025" for files from more than six months ago or the future.
+// The date part is computed with localtime_r once per day and cached; each
+// entry only derives its hour and minute from the offset into its day.
+class time_formatter {
+public:
+  static constexpr size_t width = 12;
+
+  explicit time_formatter(int64_t now) { set_now(now); }
+
+  // Cached days stay valid; only the recent/old cutoff moves.
+  void set_now(int64_t t) {
+    now = t;
+    // half of an average Gregorian year
+    six_months_ago = t - 31556952 / 2;
+  }
+
+  // Writes exactly `width` characters to out.
+  void format(char* out, int64_t t) {
+    const day& d = lookup(t);
+    std::memcpy(out, d.date, 6);
+    out[6] = ' ';
+    if (t > six_months_ago && t <= now) {
+      int64_t minutes = d.base_minutes + (t - d.begin) / 60;
+      coreutils::write_two_digits(out + 7, unsigned(minutes / 60));
+      out[9] = ':';
+      coreutils::write_two_digits(out + 10, unsigned(minutes % 60));
+    }
+    else {
+      out[7] = ' ';
+      std::memcpy(out + 8, d.year, 4);
+    }
+  }
+
+private:
+  // A span of time with one UTC offset, starting at local time base_minutes
+  // past midnight.
+  struct day {
+    int64_t begin    = 0;
+    int64_t end      = 0;
+    int base_minutes = 0;
+    char date[6];  // "Oct 18"
+    char year[4];
+  };
+
+  const day& lookup(int64_t t) {
+    // the key only picks the slot; the range check decides hits
+    int64_t local = t + offset;
+    int64_t key   = local / 86400 - (local % 86400 < 0);
+    day& d        = cache[size_t(key) % cache.size()];
+    if (t >= d.begin && t < d.end) return d;
+
+    static constexpr char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    time_t tt = time_t(t);
+    struct tm tm;
+    if (localtime_r(&tt, &tm) == nullptr) {
+      std::memcpy(d.date, "??? ??", 6);
+      std::memcpy(d.year, "????", 4);
+      d.begin = t;
+      d.end   = t + 1;
+      return d;
+    }
+    offset = tm.tm_gmtoff;
+
+    int64_t since_midnight = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+    d.begin        = t - since_midnight;
+    d.end          = d.begin + 86400;
+    d.base_minutes = 0;
+    // around a DST change, only trust the current hour
+    struct tm first, last;
+    time_t begin = time_t(d.begin), end = time_t(d.end - 1);
+    if (localtime_r(&begin, &first) == nullptr ||
+        localtime_r(&end, &last) == nullptr ||
+        first.tm_gmtoff != tm.tm_gmtoff || last.tm_gmtoff != tm.tm_gmtoff) {
+      d.begin        = t - tm.tm_min * 60 - tm.tm_sec;
+      d.end          = d.begin + 3600;
+      d.base_minutes = tm.tm_hour * 60;
+    }
+
+    std::memcpy(d.date, months + 3 * tm.tm_mon, 3);
+    d.date[3] = ' ';
+    if (tm.tm_mday < 10) {
+      d.date[4] = ' ';
+      d.date[5] = char('0' + tm.tm_mday);
+    }
+    else {
+      coreutils::write_two_digits(d.date + 4, unsigned(tm.tm_mday));
+    }
+    char digits[coreutils::max_decimal_digits];
+    char* end_ptr = digits + sizeof(digits);
+    char* start   = coreutils::format_decimal(
+      end_ptr, uint64_t(std::clamp(tm.tm_year + 1900, 0, 9999)));
+    std::memset(d.year, ' ', 4);
+    std::memcpy(d.year + 4 - (end_ptr - start), start, size_t(end_ptr - start));
+    return d;
+  }
+
+  std::array<day, 64> cache {};
+  int64_t now;
+  int64_t six_months_ago;
+  long offset = 0;
+};
+
+class lister;
+
+// Orders entries for display, by the lister's sort options.
+struct display_order {
+  const lister* owner;
+  bool operator()(const walk::entry& a, const walk::entry& b) const;
+};
+
+// A directory kept up to date by --watch. Entries are kept in display order
+// and indexed by name, so that an event doesn't scan the whole directory.
+struct watched_dir {
+  using entry_set = std::multiset<walk::entry, display_order>;
+
+  explicit watched_dir(display_order order) : entries(order) {}
+
+  entry_set::iterator find(std::string_view name) {
+    auto it = by_name.find(name);
+    return it == by_name.end() ? entries.end() : it->second;
+  }
+  // Equal entries (all of them, when unsorted) go after the existing ones.
+  entry_set::iterator insert(walk::entry e) {
+    auto it = entries.insert(std::move(e));
+    by_name.emplace(it->name, it);
+    return it;
+  }
+  void erase(entry_set::iterator it) {
+    by_name.erase(it->name);
+    entries.erase(it);
+  }
+
+  std::string path;
+  entry_set entries;
+  // the keys point into the names in `entries`
+  std::unordered_map<std::string_view, entry_set::iterator> by_name;
+};
+
+// A change seen by --watch, reported once its batch of events is applied.
+// Removed entries are kept, since they can't be looked up afterwards.
+struct watch_change {
+  std::string dir;
+  std::string name;
+  char kind;  // '+', '-', '~', or '\0' if it cancelled out
+  walk::entry removed;
+};
+
+// Scratch space for rendering a listing, one per thread.
+struct render_state {
+  explicit render_state(int64_t now) : times(now) {}
+
+  // names rendered for column layout
+  fmt::memory_buffer names;
+  std::vector<name_span> spans;
+  time_formatter times;
+};
+
+class lister {
+public:
+  lister(const char* argv0, const option_data& opts) :
+    argv0(argv0),
+    opts(opts),
+    now(int64_t(std::time(nullptr))),
+    width(terminal_width()) {}
+
+  int run();
+
+private:
+  friend struct display_order;
+
+  bool wants_time() const;
+  unsigned stat_mask() const;
+  int operand_flags() const;
+  const statx_timestamp& entry_time(const walk::entry& e) const;
+
+  void stat_operands(std::vector<walk::entry>& operands, std::vector<int>& errors);
+  void list_directory(walk::node& dir);
+  void write_tree(walk::node& dir, bool& first, bool headers);
+  bool entry_before(const walk::entry& a, const walk::entry& b) const;
+  bool entry_before_fwd(const walk::entry& a, const walk::entry& b) const;
+  void sort_entries(std::vector<walk::entry>& entries) const;
+
+  coreutils::quote_style quoting() const;
+  char indicator(const walk::entry& e) const;
+  char indicator(unsigned char type, bool executable) const;
+  size_t append_name(fmt::memory_buffer& buf, const walk::entry& e) const;
+  void prefix_widths(
+    std::span<const walk::entry> entries, size_t& ino_w,
+    size_t& blocks_w) const;
+  size_t append_prefix(
+    fmt::memory_buffer& buf, const walk::entry& e, size_t ino_w,
+    size_t blocks_w) const;
+  void append_total(fmt::memory_buffer& buf, uint64_t blocks) const;
+
+  void write_entries(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+    std::string_view dir = {}, int dirfd = AT_FDCWD);
+  void write_lines(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries);
+  void write_details(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+    bool total, int dirfd);
+  void write_columns(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+    bool across);
+  void write_csv(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries);
+  void write_zero(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries);
+  void write_json(
+    fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+    std::string_view dir);
+
+  render_state& scratch();
+  std::string_view time_key() const;
+  uint64_t display_blocks(uint64_t blocks) const;
+  const std::string& user_name(uint32_t uid);
+  const std::string& group_name(uint32_t gid);
+  void raise_status(int level);
+  void report(std::string_view what, std::string_view path, int err, int level);
+  void defer_report(
+    std::string& errors, std::string_view what, std::string_view path,
+    int err, int level);
+
+  // --watch
+  uint32_t watch_mask() const;
+  void add_watch(walk::node& dir);
+  void adopt_tree(walk::node& dir, bool notify);
+  void add_subtree(
+    const std::string& path, const struct statx& stat, bool notify);
+  void remove_subtree(const std::string& path);
+  void apply_event(const inotify_event& ev);
+  void note_change(const watched_dir& dir, const walk::entry& e, char kind);
+  void write_changes(fmt::memory_buffer& buf);
+  void write_change(
+    fmt::memory_buffer& buf, char kind, const std::string& dir,
+    const walk::entry& e);
+  void redraw();
+  void redraw_dir(const std::string& path, bool& first);
+  void rescan(fmt::memory_buffer& buf);
+  [[noreturn]] void watch();
+
+  const char* argv0;
+  const option_data& opts;
+  int64_t now;
+  unsigned width;
+  walk::options walk_opts;
+  bool headers = false;
+
+  coreutils::output_buffer out;
+  coreutils::thread_pool pool;
+
+  std::mutex names_lock;
+  std::unordered_map<uint32_t, std::string> users, groups;
+  std::atomic<int> status {0};
+
+  // --watch state, keyed by watch descriptor and by path
+  int inotify_fd = -1;
+  std::vector<walk::entry> watch_roots;
+  std::unordered_map<int, watched_dir> watched;
+  std::unordered_map<std::string, int> watch_paths;
+  std::vector<watch_change> changes;
+  std::unordered_map<std::string, size_t> change_index;
+  std::string last_change_dir;
+};
+
+bool lister::wants_time() const {
+  return opts.sort_key == option_data::sort_key::time ||
+    opts.format == option_data::format::details ||
+    (opts.format == option_data::format::json &&
+     (opts.print_details ||
+      opts.timestamp != option_data::time_src::last_modified));
+}
+
+unsigned lister::stat_mask() const {
+  unsigned mask = 0;
+  if (wants_time()) {
+    switch (opts.timestamp) {
+      case option_data::time_src::last_modified: mask |= STATX_MTIME; break;
+      case option_data::time_src::last_accessed: mask |= STATX_ATIME; break;
+      case option_data::time_src::last_stat_change: mask |= STATX_CTIME; break;
+    }
+  }
+  if (opts.sort_key == option_data::sort_key::size) mask |= STATX_SIZE;
+  if (opts.indicators == option_data::indicators::all) mask |= STATX_MODE;
+  if (opts.format == option_data::format::details) {
+    mask |= STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | STATX_SIZE |
+      STATX_BLOCKS;
+  }
+  if (opts.print_size) mask |= STATX_BLOCKS;
+  if (opts.format == option_data::format::json) {
+    if (opts.print_details)
+      mask |= STATX_MODE | STATX_NLINK | STATX_UID | STATX_GID | STATX_SIZE;
+  }
+  return mask;
+}
+
+const statx_timestamp& lister::entry_time(const walk::entry& e) const {
+  switch (opts.timestamp) {
+    case option_data::time_src::last_accessed: return e.stat.stx_atime;
+    case option_data::time_src::last_stat_change: return e.stat.stx_ctime;
+    default: return e.stat.stx_mtime;
+  }
+}
+
+// Follow symlinks given as operands unless the link itself is what the
+// output shows.
+int lister::operand_flags() const {
+  bool follow = opts.link_bhv != option_data::resolve_links::none ||
+    (opts.list_dir_contents &&
+     opts.indicators != option_data::indicators::all &&
+     opts.format != option_data::format::details);
+  return follow ? 0 : AT_SYMLINK_NOFOLLOW;
+}
+
+// Stats all operands in parallel, in chunks so that a long list of cheap
+// stat calls doesn't drown in scheduling overhead. errors[i] is set to the
+// errno of operand i, or 0.
+void lister::stat_operands(
+  std::vector<walk::entry>& operands, std::vector<int>& errors) {
+  constexpr size_t chunk = 64;
+  const unsigned mask    = stat_mask() | STATX_MODE | STATX_INO;
+  const int flags        = operand_flags();
+
+  operands.resize(opts.paths.size());
+  errors.assign(opts.paths.size(), 0);
+  auto stat_range = [&, mask, flags](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      auto& e = operands[i];
+      e.name  = opts.paths[i];
+      bool ok = stat_at(AT_FDCWD, e.name.c_str(), e, mask, flags);
+      // a dangling symlink is still listed as the link
+      if (!ok && flags == 0 && errno == ENOENT)
+        ok = stat_at(AT_FDCWD, e.name.c_str(), e, mask, AT_SYMLINK_NOFOLLOW);
+      if (!ok) errors[i] = errno;
+    }
+  };
+  if (operands.size() <= chunk) {
+    stat_range(0, operands.size());
+    return;
+  }
+  for (size_t i = 0; i < operands.size(); i += chunk) {
+    size_t end = std::min(operands.size(), i + chunk);
+    pool.submit([=] { stat_range(i, end); });
+  }
+  pool.wait();
+}
+
+// Called by the walker for each directory, on a worker thread: fills in
+// what the walker didn't stat, sorts the entries (which also orders the
+// subdirectories for -R), and renders them into dir.output.
+void lister::list_directory(walk::node& dir) {
+  if (dir.error != 0) return;
+  if (opts.watch) add_watch(dir);
+  auto& entries = dir.entries;
+
+  switch (opts.contents) {
+    case option_data::list_values::basic:
+      std::erase_if(entries, [](const walk::entry& e) { return e.name[0] == '.'; });
+      break;
+    case option_data::list_values::list_hidden: break;
+    case option_data::list_values::list_all: {
+      entries.insert(entries.begin(), 2, walk::entry {});
+      entries[0].name = ".";
+      entries[1].name = "..";
+      entries[0].type = entries[1].type = DT_DIR;
+    } break;
+  }
+
+  unsigned mask = stat_mask();
+  bool follow   = opts.link_bhv == option_data::resolve_links::listed;
+  bool need_type = opts.indicators != option_data::indicators::none ||
+    opts.format == option_data::format::json;
+  for (auto& e : entries) {
+    if (mask == 0 && (!need_type || e.type != DT_UNKNOWN)) continue;
+    bool ok = walk::walker::stat_entry(dir, e, mask, follow);
+    if (!ok && follow && errno == ENOENT)
+      ok = walk::walker::stat_entry(dir, e, mask, false);
+    if (!ok)
+      defer_report(dir.errors, "cannot access", dir.child_path(e.name), errno, 1);
+  }
+
+  if (opts.recursive && follow) {
+    // Symlinks can form loops. A directory that is also one of its own
+    // ancestors is a loop; the walker has stat'ed both with their inode
+    // numbers, so no extra calls are needed.
+    for (auto& e : entries) {
+      if (!e.descend) continue;
+      for (const walk::node* up = &dir; up != nullptr; up = up->parent) {
+        if (up->stat.stx_ino == e.stat.stx_ino &&
+            up->stat.stx_dev_major == e.stat.stx_dev_major &&
+            up->stat.stx_dev_minor == e.stat.stx_dev_minor) {
+          e.descend = false;
+          fmt::format_to(
+            std::back_inserter(dir.errors),
+            "{}: {}: not listing already-listed directory\n", argv0,
+            dir.child_path(e.name));
+          raise_status(2);
+          break;
+        }
+      }
+    }
+  }
+
+  sort_entries(entries);
+  fmt::memory_buffer buf;
+  write_entries(buf, entries, dir.path, dir.fd);
+  dir.output.assign(buf.data(), buf.size());
+}
+
+// Display order of two entries. Sorting goes through here too, so that
+// --watch can insert single entries in the same order.
+bool lister::entry_before(const walk::entry& a, const walk::entry& b) const {
+  if (opts.sort_reverse) return entry_before_fwd(b, a);
+  return entry_before_fwd(a, b);
+}
+
+bool lister::entry_before_fwd(
+  const walk::entry& a, const walk::entry& b) const {
+  switch (opts.sort_key) {
+    case option_data::sort_key::none: return false;
+    case option_data::sort_key::name: break;
+    case option_data::sort_key::time: {
+      auto& ta = entry_time(a);
+      auto& tb = entry_time(b);
+      if (ta.tv_sec != tb.tv_sec) return ta.tv_sec > tb.tv_sec;
+      if (ta.tv_nsec != tb.tv_nsec) return ta.tv_nsec > tb.tv_nsec;
+    } break;
+    case option_data::sort_key::size: {
+      if (a.stat.stx_size != b.stat.stx_size)
+        return a.stat.stx_size > b.stat.stx_size;
+    } break;
+  }
+  return a.name < b.name;
+}
+
+void lister::sort_entries(std::vector<walk::entry>& entries) const {
+  if (opts.sort_key == option_data::sort_key::none) return;
+  std::sort(
+    entries.begin(), entries.end(),
+    [this](const walk::entry& a, const walk::entry& b) {
+      return entry_before(a, b);
+    });
+}
+
+bool display_order::operator()(
+  const walk::entry& a, const walk::entry& b) const {
+  return owner->entry_before(a, b);
+}
+
+coreutils::quote_style lister::quoting() const {
+  // --zero output is for programs, which want the names as they are
+  if (opts.format == option_data::format::zero)
+    return coreutils::quote_style::none;
+  return opts.esc_chars;
+}
+
+char lister::indicator(const walk::entry& e) const {
+  return indicator(e.type, e.has_stat && (e.stat.stx_mode & 0111) != 0);
+}
+
+char lister::indicator(unsigned char type, bool executable) const {
+  if (opts.indicators == option_data::indicators::none) return '\0';
+  if (type == DT_DIR) return '/';
+  if (opts.indicators == option_data::indicators::slash) return '\0';
+  switch (type) {
+    case DT_LNK: return '@';
+    case DT_FIFO: return '|';
+    case DT_SOCK: return '=';
+    case DT_REG: return executable ? '*' : '\0';
+    default: return '\0';
+  }
+}
+
+size_t lister::append_name(
+  fmt::memory_buffer& buf, const walk::entry& e) const {
+  size_t w = coreutils::append_quoted(buf, e.name, quoting());
+  if (char c = indicator(e); c != '\0') {
+    buf.push_back(c);
+    ++w;
+  }
+  return w;
+}
+
+void lister::write_entries(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+  std::string_view dir, int dirfd) {
+  // -s puts the total in front of a directory's entries in these formats
+  // too; the details format has its own
+  bool short_format = opts.format == option_data::format::lines ||
+    opts.format == option_data::format::columns_v ||
+    opts.format == option_data::format::columns_h ||
+    opts.format == option_data::format::csv;
+  if (opts.print_size && short_format && !dir.empty()) {
+    uint64_t blocks = 0;
+    for (auto& e : entries) {
+      if (e.has_stat) blocks += e.stat.stx_blocks;
+    }
+    append_total(buf, blocks);
+  }
+
+  switch (opts.format) {
+    case option_data::format::lines: write_lines(buf, entries); break;
+    case option_data::format::details:
+      write_details(buf, entries, !dir.empty(), dirfd);
+      break;
+    case option_data::format::columns_v:
+      write_columns(buf, entries, false);
+      break;
+    case option_data::format::columns_h:
+      write_columns(buf, entries, true);
+      break;
+    case option_data::format::csv: write_csv(buf, entries); break;
+    case option_data::format::zero: write_zero(buf, entries); break;
+    case option_data::format::json: write_json(buf, entries, dir); break;
+  }
+}
+
+void lister::write_lines(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries) {
+  size_t ino_w, blocks_w;
+  prefix_widths(entries, ino_w, blocks_w);
+  for (auto& e : entries) {
+    append_prefix(buf, e, ino_w, blocks_w);
+    append_name(buf, e);
+    buf.push_back('\n');
+  }
+}
+
+uint64_t lister::display_blocks(uint64_t blocks) const {
+  // stx_blocks counts 512-byte units; the default unit is 1024 bytes
+  unsigned shift = opts.size_block != 0 ? unsigned(opts.size_block) : 10;
+  if (shift <= 9) return blocks << (9 - shift);
+  uint64_t unit = uint64_t(1) << (shift - 9);
+  return (blocks + unit - 1) / unit;
+}
+
+render_state& lister::scratch() {
+  thread_local std::optional<render_state> state;
+  if (!state)
+    state.emplace(now);
+  else
+    state->times.set_now(now);
+  return *state;
+}
+
+// Names are looked up once per id. Map nodes don't move, so the references
+// stay valid after the lock is released.
+const std::string& lister::user_name(uint32_t uid) {
+  std::lock_guard guard(names_lock);
+  auto [it, inserted] = users.try_emplace(uid);
+  if (inserted) {
+    struct passwd pw, *res = nullptr;
+    char buf[1024];
+    if (!opts.print_ids && getpwuid_r(uid, &pw, buf, sizeof(buf), &res) == 0 &&
+        res != nullptr)
+      it->second = pw.pw_name;
+    else
+      it->second = fmt::format("{}", uid);
+  }
+  return it->second;
+}
+
+const std::string& lister::group_name(uint32_t gid) {
+  std::lock_guard guard(names_lock);
+  auto [it, inserted] = groups.try_emplace(gid);
+  if (inserted) {
+    struct group gr, *res = nullptr;
+    char buf[1024];
+    if (!opts.print_ids && getgrgid_r(gid, &gr, buf, sizeof(buf), &res) == 0 &&
+        res != nullptr)
+      it->second = gr.gr_name;
+    else
+      it->second = fmt::format("{}", gid);
+  }
+  return it->second;
+}
+
+namespace {
+  char type_char(uint32_t mode) {
+    switch (mode & S_IFMT) {
+      case S_IFDIR: return 'd';
+      case S_IFLNK: return 'l';
+      case S_IFCHR: return 'c';
+      case S_IFBLK: return 'b';
+      case S_IFIFO: return 'p';
+      case S_IFSOCK: return 's';
+      default: return '-';
+    }
+  }
+
+  void write_mode(char* out, uint32_t mode) {
+    out[0] = type_char(mode);
+    for (int i = 0; i < 3; ++i) {
+      uint32_t bits = mode >> (6 - 3 * i);
+      out[1 + 3 * i] = (bits & 4) ? 'r' : '-';
+      out[2 + 3 * i] = (bits & 2) ? 'w' : '-';
+      out[3 + 3 * i] = (bits & 1) ? 'x' : '-';
+    }
+    if (mode & S_ISUID) out[3] = (mode & S_IXUSR) ? 's' : 'S';
+    if (mode & S_ISGID) out[6] = (mode & S_IXGRP) ? 's' : 'S';
+    if (mode & S_ISVTX) out[9] = (mode & S_IXOTH) ? 't' : 'T';
+  }
+
+  bool is_device(const walk::entry& e) {
+    return e.has_stat && (S_ISCHR(e.stat.stx_mode) || S_ISBLK(e.stat.stx_mode));
+  }
+
+  // Appends a number right-aligned in a field of the given width.
+  void append_digits(fmt::memory_buffer& buf, uint64_t v, size_t width) {
+    char digits[coreutils::max_decimal_digits];
+    char* end   = digits + sizeof(digits);
+    char* start = coreutils::format_decimal(end, v);
+    for (size_t n = size_t(end - start); n < width; ++n)
+      buf.push_back(' ');
+    buf.append(start, end);
+  }
+
+  void append_number(fmt::memory_buffer& buf, uint64_t v, size_t width) {
+    append_digits(buf, v, width);
+    buf.push_back(' ');
+  }
+
+  void append_padded(
+    fmt::memory_buffer& buf, std::string_view str, size_t width, bool right) {
+    if (!right) buf.append(str.data(), str.data() + str.size());
+    for (size_t n = str.size(); n < width; ++n)
+      buf.push_back(' ');
+    if (right) buf.append(str.data(), str.data() + str.size());
+    buf.push_back(' ');
+  }
+}  // namespace
+
+// The inode number and block count that -i and -s put in front of a name
+// in the formats without details. Widths of 0 leave them unpadded.
+void lister::prefix_widths(
+  std::span<const walk::entry> entries, size_t& ino_w,
+  size_t& blocks_w) const {
+  ino_w = blocks_w = 0;
+  for (auto& e : entries) {
+    if (opts.print_serial) {
+      ino_w = std::max(
+        ino_w, coreutils::decimal_width(e.has_stat ? e.stat.stx_ino : e.ino));
+    }
+    if (opts.print_size) {
+      blocks_w = std::max(
+        blocks_w,
+        e.has_stat ? coreutils::decimal_width(display_blocks(e.stat.stx_blocks))
+                   : 1);
+    }
+  }
+}
+
+size_t lister::append_prefix(
+  fmt::memory_buffer& buf, const walk::entry& e, size_t ino_w,
+  size_t blocks_w) const {
+  size_t start = buf.size();
+  if (opts.print_serial)
+    append_number(buf, e.has_stat ? e.stat.stx_ino : e.ino, ino_w);
+  if (opts.print_size) {
+    if (e.has_stat)
+      append_number(buf, display_blocks(e.stat.stx_blocks), blocks_w);
+    else
+      append_padded(buf, "?", blocks_w, true);
+  }
+  return buf.size() - start;
+}
+
+void lister::append_total(fmt::memory_buffer& buf, uint64_t blocks) const {
+  buf.append(std::string_view("total "));
+  char digits[coreutils::max_decimal_digits];
+  char* end = digits + sizeof(digits);
+  buf.append(coreutils::format_decimal(end, display_blocks(blocks)), end);
+  buf.push_back('\n');
+}
+
+void lister::write_details(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+  bool total, int dirfd) {
+  // first pass: column widths (and the total)
+  size_t ino_w = 0, blocks_w = 0, nlink_w = 0, user_w = 0, group_w = 0;
+  size_t size_w = 0, major_w = 0, minor_w = 0;
+  uint64_t total_blocks = 0;
+  for (auto& e : entries) {
+    auto& st = e.stat;
+    if (opts.print_serial)
+      ino_w = std::max(ino_w, coreutils::decimal_width(e.has_stat ? st.stx_ino : e.ino));
+    if (!e.has_stat) continue;
+    total_blocks += st.stx_blocks;
+    if (opts.print_size)
+      blocks_w = std::max(blocks_w, coreutils::decimal_width(display_blocks(st.stx_blocks)));
+    nlink_w = std::max(nlink_w, coreutils::decimal_width(st.stx_nlink));
+    if (opts.print_user) user_w = std::max(user_w, user_name(st.stx_uid).size());
+    if (opts.print_group)
+      group_w = std::max(group_w, group_name(st.stx_gid).size());
+    if (is_device(e)) {
+      major_w = std::max(major_w, coreutils::decimal_width(st.stx_rdev_major));
+      minor_w = std::max(minor_w, coreutils::decimal_width(st.stx_rdev_minor));
+    }
+    else {
+      size_w = std::max(size_w, coreutils::decimal_width(st.stx_size));
+    }
+  }
+  if (major_w > 0) size_w = std::max(size_w, major_w + 2 + minor_w);
+
+  if (total) append_total(buf, total_blocks);
+
+  // second pass: one line per entry, straight into the output buffer
+  auto& times = scratch().times;
+  char link_target[PATH_MAX];
+  for (auto& e : entries) {
+    auto& st = e.stat;
+    if (opts.print_serial)
+      append_number(buf, e.has_stat ? st.stx_ino : e.ino, ino_w);
+    if (!e.has_stat) {
+      // the entry vanished or can't be accessed; show what we know
+      if (opts.print_size) append_padded(buf, "?", blocks_w, true);
+      buf.append(std::string_view("?????????? "));
+      append_padded(buf, "?", nlink_w, true);
+      if (opts.print_user) append_padded(buf, "?", user_w, false);
+      if (opts.print_group) append_padded(buf, "?", group_w, false);
+      append_padded(buf, "?", size_w, true);
+      append_padded(buf, "?", time_formatter::width, true);
+      append_name(buf, e);
+      buf.push_back('\n');
+      continue;
+    }
+
+    if (opts.print_size) append_number(buf, display_blocks(st.stx_blocks), blocks_w);
+    char mode[11];
+    write_mode(mode, st.stx_mode);
+    mode[10] = ' ';
+    buf.append(mode, mode + 11);
+    append_number(buf, st.stx_nlink, nlink_w);
+    if (opts.print_user) append_padded(buf, user_name(st.stx_uid), user_w, false);
+    if (opts.print_group)
+      append_padded(buf, group_name(st.stx_gid), group_w, false);
+
+    if (is_device(e)) {
+      // "major, minor", right-aligned as a whole in the size column
+      for (size_t n = major_w + 2 + minor_w; n < size_w; ++n)
+        buf.push_back(' ');
+      append_digits(buf, st.stx_rdev_major, major_w);
+      buf.append(std::string_view(", "));
+      append_number(buf, st.stx_rdev_minor, minor_w);
+    }
+    else {
+      append_number(buf, st.stx_size, size_w);
+    }
+
+    char date[time_formatter::width + 1];
+    times.format(date, entry_time(e).tv_sec);
+    date[time_formatter::width] = ' ';
+    buf.append(date, date + sizeof(date));
+
+    if (S_ISLNK(st.stx_mode))
+      coreutils::append_quoted(buf, e.name, quoting());
+    else
+      append_name(buf, e);
+    if (S_ISLNK(st.stx_mode)) {
+      ssize_t len =
+        readlinkat(dirfd, e.name.c_str(), link_target, sizeof(link_target));
+      if (len >= 0) {
+        buf.append(std::string_view(" -> "));
+        coreutils::append_quoted(
+          buf, std::string_view(link_target, size_t(len)), quoting());
+        // the target gets the indicator of what it is, if it exists
+        struct stat target;
+        if (opts.indicators == option_data::indicators::all &&
+            fstatat(dirfd, e.name.c_str(), &target, 0) == 0) {
+          char c = indicator(
+            IFTODT(target.st_mode), (target.st_mode & 0111) != 0);
+          if (c != '\0') buf.push_back(c);
+        }
+      }
+    }
+    buf.push_back('\n');
+  }
+}
+
+void lister::write_columns(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+  bool across) {
+  const size_t n = entries.size();
+  if (n == 0) return;
+
+  // render every name once; the layout only needs their widths
+  auto& state = scratch();
+  auto& names = state.names;
+  auto& spans = state.spans;
+  names.clear();
+  spans.clear();
+  size_t ino_w, blocks_w;
+  prefix_widths(entries, ino_w, blocks_w);
+  for (auto& e : entries) {
+    size_t offset = names.size();
+    size_t w      = append_prefix(names, e, ino_w, blocks_w);
+    w += append_name(names, e);
+    spans.push_back({offset, names.size() - offset, w});
+  }
+
+  // Try the widest layouts first. Every column but the last is followed by
+  // two spaces, and the line must stay shorter than the terminal.
+  std::vector<size_t> col_widths;
+  size_t cols = 1, rows = n;
+  for (size_t c = std::min<size_t>(n, std::max(width / 3, 1u)); c > 1; --c) {
+    size_t r    = (n + c - 1) / c;
+    size_t used = across ? c : (n + r - 1) / r;
+    col_widths.assign(used, 0);
+    for (size_t i = 0; i < n; ++i) {
+      size_t col      = across ? i % c : i / r;
+      col_widths[col] = std::max(col_widths[col], spans[i].width);
+    }
+    size_t line = 2 * (used - 1);
+    for (size_t w : col_widths)
+      line += w;
+    if (line < width) {
+      cols = used;
+      rows = r;
+      break;
+    }
+  }
+  if (cols == 1) col_widths.assign(1, 0);
+
+  for (size_t row = 0; row < rows; ++row) {
+    for (size_t col = 0; col < cols; ++col) {
+      size_t i = across ? row * cols + col : col * rows + row;
+      if (i >= n) break;
+      auto& span = spans[i];
+      buf.append(
+        names.data() + span.offset, names.data() + span.offset + span.length);
+
+      size_t next = across ? i + 1 : i + rows;
+      if (col + 1 < cols && next < n) {
+        for (size_t pad = span.width; pad < col_widths[col] + 2; ++pad)
+          buf.push_back(' ');
+      }
+    }
+    buf.push_back('\n');
+  }
+}
+
+void lister::write_csv(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries) {
+  size_t pos = 0;
+  for (size_t i = 0; i < entries.size(); ++i) {
+    size_t sep = buf.size();
+    if (i > 0) buf.append(std::string_view(", "));
+    // no padding here, as in other ls implementations
+    size_t len = append_prefix(buf, entries[i], 0, 0);
+    len += append_name(buf, entries[i]);
+    // the separator becomes a line break if the name would run past the
+    // terminal
+    if (i > 0 && pos + len + 2 >= width) {
+      buf.data()[sep + 1] = '\n';
+      pos = 0;
+    }
+    else if (i > 0) {
+      pos += 2;
+    }
+    pos += len;
+  }
+  if (!entries.empty()) buf.push_back('\n');
+}
+
+void lister::write_zero(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries) {
+  for (auto& e : entries) {
+    append_name(buf, e);
+    buf.push_back('\0');
+  }
+}
+
+void lister::write_json(
+  fmt::memory_buffer& buf, std::span<const walk::entry> entries,
+  std::string_view dir) {
+  using coreutils::quote_style;
+  auto it = std::back_inserter(buf);
+
+  for (auto& e : entries) {
+    auto& st = e.stat;
+    buf.append(std::string_view(R"({"name":")"));
+    coreutils::append_quoted(buf, e.name, quote_style::json);
+    if (!dir.empty()) {
+      buf.append(std::string_view(R"(","dir":")"));
+      coreutils::append_quoted(buf, dir, quote_style::json);
+    }
+    fmt::format_to(it, R"(","type":"{}")", type_name(e.type));
+
+    if (opts.print_serial)
+      fmt::format_to(it, R"(,"ino":{})", e.has_stat ? st.stx_ino : e.ino);
+    if (e.has_stat) {
+      if (opts.print_size) fmt::format_to(it, R"(,"blocks":{})", st.stx_blocks);
+      if (opts.print_details ||
+          opts.sort_key == option_data::sort_key::size)
+        fmt::format_to(it, R"(,"size":{})", st.stx_size);
+      if (opts.print_details) {
+        fmt::format_to(it, R"(,"mode":{},"nlink":{})", st.stx_mode & 07777,
+                       st.stx_nlink);
+        if (opts.print_user) fmt::format_to(it, R"(,"uid":{})", st.stx_uid);
+        if (opts.print_group) fmt::format_to(it, R"(,"gid":{})", st.stx_gid);
+      }
+      if (wants_time()) {
+        auto& ts = entry_time(e);
+        fmt::format_to(it, R"(,"{}":{}.{:09})", time_key(), ts.tv_sec,
+                       ts.tv_nsec);
+      }
+    }
+    buf.append(std::string_view("}\n"));
+  }
+}
+
+std::string_view lister::time_key() const {
+  switch (opts.timestamp) {
+    case option_data::time_src::last_accessed: return "atime";
+    case option_data::time_src::last_stat_change: return "ctime";
+    default: return "mtime";
+  }
+}
+
+void lister::raise_status(int level) {
+  int current = status.load(std::memory_order_relaxed);
+  while (current < level && !status.compare_exchange_weak(current, level)) {}
+}
+
+void lister::report(
+  std::string_view what, std::string_view path, int err, int level) {
+  // keep errors in order with the listing when both go to a terminal
+  out.flush();
+  std::cerr << fmt::format(
+    "{}: {} '{}': {}\n", argv0, what, path, std::strerror(err));
+  raise_status(level);
+}
+
+// Errors found on worker threads are kept with their directory and written
+// along with its listing.
+void lister::defer_report(
+  std::string& errors, std::string_view what, std::string_view path, int err,
+  int level) {
+  fmt::format_to(
+    std::back_inserter(errors), "{}: {} '{}': {}\n", argv0, what, path,
+    std::strerror(err));
+  raise_status(level);
+}
+
+void lister::write_tree(walk::node& dir, bool& first, bool headers) {
+  // JSON objects name their directory instead of being grouped under a
+  // header
+  if (!first && opts.format != option_data::format::json) out.put('\n');
+  first = false;
+  if (headers) {
+    coreutils::append_quoted(out.data(), dir.path, quoting());
+    out.write(":\n");
+  }
+  if (dir.error != 0)
+    report("cannot open directory", dir.path, dir.error, dir.parent ? 1 : 2);
+  out.write(dir.output);
+  if (!dir.errors.empty()) {
+    out.flush();
+    std::cerr << dir.errors;
+  }
+  // free the text as soon as it is written
+  std::string().swap(dir.output);
+  std::string().swap(dir.errors);
+
+  for (auto& child : dir.children)
+    write_tree(*child, first, headers);
+}
+
+int lister::run() {
+  std::vector<walk::entry> operands;
+  std::vector<int> errors;
+  stat_operands(operands, errors);
+
+  // one pass in operand order: report errors, split files from directories
+  std::vector<walk::entry> files, dirs;
+  for (size_t i = 0; i < operands.size(); ++i) {
+    if (errors[i] != 0) {
+      report("cannot access", operands[i].name, errors[i], 2);
+      continue;
+    }
+    if (operands[i].type == DT_DIR && opts.list_dir_contents)
+      dirs.push_back(std::move(operands[i]));
+    else
+      files.push_back(std::move(operands[i]));
+  }
+  operands.clear();
+  sort_entries(files);
+  sort_entries(dirs);
+
+  walk_opts.stat_mask    = stat_mask();
+  walk_opts.max_depth    = opts.recursive ? INT_MAX : 0;
+  walk_opts.follow_links = opts.link_bhv == option_data::resolve_links::listed;
+  walk_opts.keep_entries = opts.watch;
+  if (opts.watch) {
+    inotify_fd = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd < 0)
+      throw std::system_error(errno, std::generic_category(), "inotify_init1");
+  }
+
+  // Directories are listed concurrently and rendered on the workers; the
+  // main thread writes each operand's tree as soon as it is complete.
+  std::mutex done_lock;
+  std::condition_variable done_cv;
+  std::unordered_set<const walk::node*> done;
+
+  walk::walker walker(walk_opts);
+  walker.on_directory = [this](walk::node& dir) { list_directory(dir); };
+  walker.on_complete  = [&](walk::node& dir) {
+    if (dir.parent != nullptr) return;
+    std::lock_guard guard(done_lock);
+    done.insert(&dir);
+    done_cv.notify_all();
+  };
+
+  std::vector<std::unique_ptr<walk::node>> roots;
+  roots.reserve(dirs.size());
+  for (auto& dir : dirs)
+    roots.push_back(walker.start(pool, dir.name, dir.stat));
+
+  try {
+    write_entries(out.data(), files);
+    out.maybe_flush();
+
+    headers = (opts.paths.size() > 1 || opts.recursive) &&
+      opts.format != option_data::format::json;
+    bool first = files.empty();
+    for (auto& root : roots) {
+      {
+        std::unique_lock guard(done_lock);
+        done_cv.wait(guard, [&] { return done.contains(root.get()); });
+      }
+      write_tree(*root, first, headers);
+      if (opts.watch) adopt_tree(*root, false);
+      root.reset();
+    }
+    out.flush();
+  }
+  catch (...) {
+    // the workers still use the walker
+    pool.wait();
+    throw;
+  }
+  pool.wait();
+  if (opts.watch) {
+    watch_roots = std::move(dirs);
+    watch();
+  }
+  return status;
+}
+
+uint32_t lister::watch_mask() const {
+  uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+  // changes to the entries themselves only matter if we show or sort by
+  // their stat data
+  if (stat_mask() != 0) mask |= IN_ATTRIB | IN_MODIFY;
+  return mask;
+}
+
+// Called from list_directory on a worker thread. The watch descriptor is
+// kept in dir.total until adopt_tree picks it up. The watch is added right
+// after the walker read the directory, so changes in between are missed.
+void lister::add_watch(walk::node& dir) {
+  int wd = inotify_add_watch(inotify_fd, dir.path.c_str(), watch_mask());
+  if (wd < 0) {
+    defer_report(dir.errors, "cannot watch", dir.path, errno, 1);
+    return;
+  }
+  dir.total.store(uint64_t(wd), std::memory_order_relaxed);
+}
+
+// Moves the sorted entries of a walked tree into the watch tables.
+void lister::adopt_tree(walk::node& dir, bool notify) {
+  int wd = int(dir.total.load(std::memory_order_relaxed));
+  if (dir.error == 0 && wd > 0) {
+    auto& w = watched.try_emplace(wd, display_order {this}).first->second;
+    w.path  = dir.path;
+    w.entries.clear();
+    w.by_name.clear();
+    for (auto& e : dir.entries)
+      w.insert(std::move(e));
+    dir.entries.clear();
+    watch_paths[w.path] = wd;
+    if (notify) {
+      for (auto& e : w.entries)
+        note_change(w, e, '+');
+    }
+  }
+  for (auto& child : dir.children)
+    adopt_tree(*child, notify);
+}
+
+// Lists and watches a directory that appeared while watching (all of it,
+// under -R).
+void lister::add_subtree(
+  const std::string& path, const struct statx& stat, bool notify) {
+  walk::walker walker(walk_opts);
+  walker.on_directory = [this](walk::node& dir) { list_directory(dir); };
+  auto root = walker.start(pool, path, stat);
+  pool.wait();
+  adopt_tree(*root, notify);
+  if (!root->errors.empty()) {
+    out.flush();
+    std::cerr << root->errors;
+  }
+}
+
+void lister::remove_subtree(const std::string& path) {
+  auto it = watch_paths.find(path);
+  if (it == watch_paths.end()) return;
+  int wd = it->second;
+  watch_paths.erase(it);
+
+  auto dir = watched.find(wd);
+  if (dir == watched.end()) return;
+  for (auto& e : dir->second.entries) {
+    if (e.type == DT_DIR) remove_subtree(join_path(path, e.name));
+  }
+  inotify_rm_watch(inotify_fd, wd);
+  watched.erase(dir);
+}
+
+// Folds a change into the current batch, so that e.g. creating and then
+// writing a file shows up as a single addition.
+void lister::note_change(
+  const watched_dir& dir, const walk::entry& e, char kind) {
+  std::string key = join_path(dir.path, e.name);
+  auto [it, added] = change_index.try_emplace(std::move(key), changes.size());
+  if (added) {
+    auto& c = changes.emplace_back();
+    c.dir   = dir.path;
+    c.name  = e.name;
+    c.kind  = kind;
+    if (kind == '-') c.removed = e;
+    return;
+  }
+
+  auto& c = changes[it->second];
+  if (kind == '-') {
+    c.kind    = c.kind == '+' ? '\0' : '-';
+    c.removed = e;
+  }
+  else if (c.kind == '-') {
+    c.kind = '~';
+  }
+  else if (c.kind == '\0') {
+    c.kind = '+';
+  }
+}
+
+void lister::write_changes(fmt::memory_buffer& buf) {
+  for (auto& c : changes) {
+    if (c.kind == '-') {
+      write_change(buf, '-', c.dir, c.removed);
+      continue;
+    }
+    if (c.kind == '\0') continue;
+    auto wd = watch_paths.find(c.dir);
+    if (wd == watch_paths.end()) continue;
+    auto& dir = watched.at(wd->second);
+    auto pos  = dir.find(c.name);
+    if (pos != dir.entries.end()) write_change(buf, c.kind, c.dir, *pos);
+  }
+  changes.clear();
+  change_index.clear();
+  last_change_dir.clear();
+}
+
+void lister::write_change(
+  fmt::memory_buffer& buf, char kind, const std::string& dir,
+  const walk::entry& e) {
+  if (opts.format == option_data::format::json) {
+    fmt::memory_buffer obj;
+    write_json(obj, std::span(&e, 1), dir);
+    std::string_view event = kind == '+' ? "add" :
+      kind == '-'                        ? "remove" :
+                                           "change";
+    fmt::format_to(std::back_inserter(buf), R"({{"event":"{}",)", event);
+    buf.append(obj.data() + 1, obj.data() + obj.size());
+    return;
+  }
+
+  // changes are grouped under their directory's name, like a listing
+  if (headers && dir != last_change_dir) {
+    coreutils::append_quoted(buf, dir, quoting());
+    buf.append(std::string_view(":\n"));
+    last_change_dir = dir;
+  }
+  buf.push_back(kind);
+  buf.push_back(' ');
+  switch (opts.format) {
+    case option_data::format::details: {
+      int fd = open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+      write_details(buf, std::span(&e, 1), false, fd);
+      if (fd >= 0) close(fd);
+    } break;
+    case option_data::format::zero: write_zero(buf, std::span(&e, 1)); break;
+    default: write_lines(buf, std::span(&e, 1)); break;
+  }
+}
+
+void lister::apply_event(const inotify_event& ev) {
+  auto it = watched.find(ev.wd);
+  if (it == watched.end()) return;
+  auto& dir = it->second;
+  if (ev.mask & IN_IGNORED) {
+    watch_paths.erase(dir.path);
+    watched.erase(it);
+    return;
+  }
+  // removals of watched directories show up in their parent as well
+  if (ev.len == 0 || (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF))) return;
+
+  std::string_view name(ev.name);
+  if (name[0] == '.' && opts.contents == option_data::list_values::basic)
+    return;
+
+  auto pos    = dir.find(name);
+  auto remove = [&] {
+    if (pos == dir.entries.end()) return;
+    note_change(dir, *pos, '-');
+    if (opts.recursive && pos->type == DT_DIR)
+      remove_subtree(join_path(dir.path, pos->name));
+    dir.erase(pos);
+  };
+  if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+    remove();
+    return;
+  }
+
+  // created, moved in, or changed: stat just this entry
+  walk::entry e;
+  e.name    = name;
+  auto path = join_path(dir.path, e.name);
+  int flags = opts.link_bhv == option_data::resolve_links::listed ?
+    0 :
+    AT_SYMLINK_NOFOLLOW;
+  if (!stat_at(AT_FDCWD, path.c_str(), e, stat_mask(), flags)) {
+    // gone again before we got to it
+    remove();
+    return;
+  }
+
+  bool existed = pos != dir.entries.end();
+  if (existed) dir.erase(pos);
+  auto at = dir.insert(std::move(e));
+  note_change(dir, *at, existed ? '~' : '+');
+
+  if (!existed && opts.recursive && at->type == DT_DIR) {
+    // the walk may add watches, which invalidates `dir`
+    auto stat = at->stat;
+    add_subtree(path, stat, true);
+  }
+}
+
+void lister::redraw_dir(const std::string& path, bool& first) {
+  auto it = watch_paths.find(path);
+  if (it == watch_paths.end()) return;
+  auto& dir = watched.at(it->second);
+
+  if (!first) out.put('\n');
+  first = false;
+  if (headers) {
+    coreutils::append_quoted(out.data(), dir.path, quoting());
+    out.write(":\n");
+  }
+  int fd = open(dir.path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+  std::vector<walk::entry> shown(dir.entries.begin(), dir.entries.end());
+  write_entries(out.data(), shown, dir.path, fd);
+  if (fd >= 0) close(fd);
+  out.maybe_flush();
+
+  if (!opts.recursive) return;
+  for (auto& e : dir.entries) {
+    if (e.type == DT_DIR && e.name != "." && e.name != "..")
+      redraw_dir(join_path(dir.path, e.name), first);
+  }
+}
+
+void lister::redraw() {
+  // home the cursor and clear the screen
+  out.write("\x1b[H\x1b[2J");
+  bool first = true;
+  for (auto& root : watch_roots)
+    redraw_dir(root.name, first);
+  out.flush();
+}
+
+// The kernel dropped events, so start over from a fresh listing.
+// Everything is reported as added again, after a line saying so.
+void lister::rescan(fmt::memory_buffer& buf) {
+  for (auto& [wd, dir] : watched)
+    inotify_rm_watch(inotify_fd, wd);
+  watched.clear();
+  watch_paths.clear();
+  changes.clear();
+  change_index.clear();
+
+  if (opts.format == option_data::format::json)
+    buf.append(std::string_view("{\"event\":\"reset\"}\n"));
+  else
+    buf.append(std::string_view("=\n"));
+  for (auto& root : watch_roots)
+    add_subtree(root.name, root.stat, true);
+}
+
+void lister::watch() {
+  bool tty = isatty(STDOUT_FILENO);
+  alignas(inotify_event) char events[64 * 1024];
+  fmt::memory_buffer buf;
+  pollfd pfd {inotify_fd, POLLIN, 0};
+
+  while (true) {
+    if (poll(&pfd, 1, -1) < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error(errno, std::generic_category(), "poll");
+    }
+    // Apply everything that arrives in a short burst as one batch, so that
+    // a busy directory is redrawn once rather than once per event.
+    do {
+      ssize_t len = read(inotify_fd, events, sizeof(events));
+      if (len < 0) {
+        if (errno == EINTR || errno == EAGAIN) continue;
+        throw std::system_error(errno, std::generic_category(), "read");
+      }
+      for (ssize_t off = 0; off < len;) {
+        auto& ev = *reinterpret_cast<const inotify_event*>(events + off);
+        off += ssize_t(sizeof(inotify_event) + ev.len);
+        if (ev.mask & IN_Q_OVERFLOW) {
+          rescan(buf);
+          break;
+        }
+        apply_event(ev);
+      }
+    } while (poll(&pfd, 1, 50) > 0);
+
+    // new entries shouldn't look like they're from the future
+    now = int64_t(std::time(nullptr));
+    if (tty) {
+      buf.clear();
+      changes.clear();
+      change_index.clear();
+      redraw();
+    }
+    else {
+      write_changes(buf);
+      out.write(std::string_view(buf.data(), buf.size()));
+      buf.clear();
+      out.flush();
+    }
+  }
+}
+
+int main(const int argc, const char* argv[]) {
   auto config = parse_options(argc, argv);
-}
\ No newline at end of file
+  if (config.paths.empty()) config.paths.emplace_back(".");
+
+  try {
+    lister ls(argv[0], config);
+    return ls.run();
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.what());
+    return 2;
+  }
+}
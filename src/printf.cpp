@@ -0,0 +1,591 @@
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fmt/core.h>
+#include <fmt/format.h>
+
+#include <unistd.h>
+
+#include "details/arena.hpp"
+#include "details/args.hpp"
+#include "details/escapes.hpp"
+#include "details/output_buffer.hpp"
+#include "details/raw_write.hpp"
+
+using namespace std::literals::string_view_literals;
+
+void usage(std::string_view argv0) {
+  coreutils::write_all(
+    STDOUT_FILENO, {"usage: "sv, argv0, " FORMAT [ARGUMENT]...\n   or: "sv,
+                    argv0, R"msg( --help
+Writes the ARGUMENTs to standard output as FORMAT directs. FORMAT is used
+again as many times as it takes to use up every ARGUMENT.
+
+FORMAT is copied as it is, except for backslash escapes and conversions.
+Each conversion writes the next ARGUMENT:
+  %%        a single %
+  %b        ARGUMENT with its backslash escapes interpreted; octal escapes
+            may also be written \0NNN
+  %c        the first character of ARGUMENT
+  %s        ARGUMENT as it is
+  %d, %i    ARGUMENT as a signed decimal integer
+  %o, %u, %x, %X
+            ARGUMENT as an unsigned octal, decimal or hexadecimal integer
+  %f, %F, %e, %E, %g, %G, %a, %A
+            ARGUMENT as a floating-point number
+All but %b take flags (-+ #0), a field width and a precision, as in C. The
+width and precision may be *, which takes them from the next ARGUMENT.
+
+Numeric ARGUMENTs may be written as in C (0x1F, 017, 1e-3), or as a quote
+followed by a character, which stands for the character's value. Missing
+ARGUMENTs count as empty strings or zero.
+
+Supported escape sequences are:
+  \\        backslash
+  \"        double quote
+  \a        alert (BEL)
+  \b        backspace
+  \c        produce no further output
+  \e        escape
+  \f        form feed
+  \n        newline (LF)
+  \r        carriage return (CR)
+  \t        tab
+  \v        vertical tab
+  \NNN      octal escape for value NNN (1-3 digits)
+  \xHH      hexadecimal escape for value HH (1-2 digits)
+  \uHHHH    Unicode character HHHH, as UTF-8
+  \UHHHHHHHH
+            Unicode character HHHHHHHH, as UTF-8
+
+NOTE: Some shells have printf as a builtin command, which will likely
+override this one. Please check your shell's manual for information on its
+version.
+)msg"sv});
+}
+
+namespace {
+  void report(std::string_view argv0, std::string_view msg) {
+    coreutils::write_all(STDERR_FILENO, {argv0, ": "sv, msg, "\n"sv});
+  }
+
+  // One step of a compiled FORMAT.
+  struct step {
+    enum class kind : uint8_t {
+      text,     // copy the text
+      convert,  // convert the next argument
+      escaped,  // %b: the next argument, with its escapes decoded
+      stop,     // \c: produce no further output
+      fail,     // report the text as an error and exit
+    };
+    kind op;
+    char conversion = '\0';
+
+    bool left : 1          = false;
+    bool plus : 1          = false;
+    bool space : 1         = false;
+    bool alternate : 1     = false;
+    bool zero : 1          = false;
+    bool width_arg : 1     = false;
+    bool precision_arg : 1 = false;
+
+    int width     = 0;
+    int precision = -1;
+
+    // where the step's text is in the program's text: literal text, an
+    // error message, or the printf format for a floating-point conversion
+    uint32_t offset = 0;
+    uint32_t size   = 0;
+  };
+
+  bool is_float(char conversion) {
+    return "fFeEgGaA"sv.find(conversion) != std::string_view::npos;
+  }
+
+  // FORMAT, parsed once into a list of steps that is then run as many times
+  // as the arguments need. Adjacent literal text (escapes included) is
+  // merged into one step.
+  class program {
+  public:
+    explicit program(std::string_view format) {
+      size_t i = 0;
+      while (i < format.size()) {
+        size_t next = format.find_first_of("%\\", i);
+        if (next == std::string_view::npos) next = format.size();
+        add_text(format.substr(i, next - i));
+        if (next == format.size()) break;
+        i = next + 1;
+
+        if (format[next] == '\\') {
+          auto esc = coreutils::decode_escape(
+            format.substr(i), coreutils::escape_syntax::printf);
+          if (esc.invalid) {
+            add_fail("missing hexadecimal number in escape");
+            return;
+          }
+          if (esc.stop) {
+            steps.push_back({step::kind::stop});
+            return;
+          }
+          add_text({esc.bytes, esc.size});
+          i += esc.length;
+          continue;
+        }
+
+        if (i < format.size() && format[i] == '%') {
+          add_text("%"sv);
+          ++i;
+          continue;
+        }
+        if (i < format.size() && format[i] == 'b') {
+          steps.push_back({step::kind::escaped});
+          uses_args = true;
+          ++i;
+          continue;
+        }
+        if (!add_conversion(format, next, i)) return;
+      }
+    }
+
+    std::span<const step> steps_view() const { return steps; }
+
+    std::string_view text_of(const step& s) const {
+      return {text.data() + s.offset, s.size};
+    }
+
+    // whether any step takes an argument; if none does, FORMAT runs once
+    bool uses_args = false;
+
+  private:
+    void add_text(std::string_view str) {
+      if (str.empty()) return;
+      if (
+        !steps.empty() && steps.back().op == step::kind::text &&
+        steps.back().offset + steps.back().size == text.size()) {
+        steps.back().size += uint32_t(str.size());
+      }
+      else {
+        step s {step::kind::text};
+        s.offset = uint32_t(text.size());
+        s.size   = uint32_t(str.size());
+        steps.push_back(s);
+      }
+      text.append(str);
+    }
+
+    void add_fail(std::string_view msg) {
+      step s {step::kind::fail};
+      s.offset = uint32_t(text.size());
+      s.size   = uint32_t(msg.size());
+      text.append(msg);
+      steps.push_back(s);
+    }
+
+    // Parses the conversion that starts at format[start] ('%'), continuing
+    // from i. Like GNU printf, rejects flags that C leaves undefined for
+    // the conversion. Returns false (after adding a fail step) if it is
+    // invalid.
+    bool add_conversion(std::string_view format, size_t start, size_t& i) {
+      step s {step::kind::convert};
+      // the conversions still allowed by what has been seen so far
+      std::string allowed = "diouxXfFeEgGaAcs";
+      auto disallow       = [&](std::string_view convs) {
+        for (char c : convs) {
+          if (auto pos = allowed.find(c); pos != std::string::npos)
+            allowed.erase(pos, 1);
+        }
+      };
+      std::string flags;
+      for (; i < format.size(); ++i) {
+        char c = format[i];
+        if (c == '\'' || c == 'I') {
+          // digit grouping and locale digits, which do nothing here
+          disallow("aAceEosxX");
+          continue;
+        }
+        if ("-+ #0"sv.find(c) == npos) break;
+        switch (c) {
+          case '-': s.left = true; break;
+          case '+': s.plus = true; break;
+          case ' ': s.space = true; break;
+          case '#':
+            s.alternate = true;
+            disallow("cdisu");
+            break;
+          case '0':
+            s.zero = true;
+            disallow("cs");
+            break;
+        }
+        flags.push_back(c);
+      }
+
+      bool too_big = false;
+      auto number  = [&](int& value) {
+        int64_t res = 0;
+        for (; i < format.size() && format[i] >= '0' && format[i] <= '9'; ++i)
+          res = std::min<int64_t>(res * 10 + (format[i] - '0'), INT_MAX + 1LL);
+        too_big |= res > INT_MAX;
+        value = int(res);
+      };
+      if (i < format.size() && format[i] == '*') {
+        s.width_arg = true;
+        uses_args   = true;
+        ++i;
+      }
+      else {
+        number(s.width);
+      }
+      if (i < format.size() && format[i] == '.') {
+        ++i;
+        disallow("c");
+        if (i < format.size() && format[i] == '*') {
+          s.precision_arg = true;
+          uses_args       = true;
+          ++i;
+        }
+        else {
+          number(s.precision);
+        }
+      }
+      while (i < format.size() && "hlLqjzt"sv.find(format[i]) != npos)
+        ++i;
+
+      auto directive = format.substr(start, i + 1 - start);
+      if (too_big) {
+        add_fail(
+          fmt::format("{}: field width or precision is too large", directive));
+        return false;
+      }
+      if (i >= format.size() || allowed.find(format[i]) == std::string::npos) {
+        add_fail(
+          fmt::format("{}: invalid conversion specification", directive));
+        return false;
+      }
+      s.conversion = format[i++];
+      uses_args    = true;
+
+      // floating point goes through snprintf, with the width and precision
+      // always passed as arguments
+      if (is_float(s.conversion)) {
+        s.offset = uint32_t(text.size());
+        fmt::format_to(
+          std::back_inserter(text), "%{}*.*L{}", flags, s.conversion);
+        s.size = uint32_t(text.size() - s.offset);
+      }
+      steps.push_back(s);
+      return true;
+    }
+
+    static constexpr auto npos = std::string_view::npos;
+
+    std::pmr::vector<step> steps {coreutils::arena()};
+    std::pmr::string text {coreutils::arena()};
+  };
+
+  // Runs a program over the arguments, writing into one output buffer.
+  class printer {
+  public:
+    printer(
+      std::string_view argv0, const program& prog,
+      std::span<const std::string_view> args) :
+      argv0(argv0), prog(prog), args(args) {}
+
+    int run() {
+      do {
+        for (const auto& s : prog.steps_view()) {
+          if (!run_step(s)) {
+            out.flush();
+            return status;
+          }
+        }
+      } while (prog.uses_args && next < args.size());
+
+      out.flush();
+      if (next < args.size()) {
+        report(
+          argv0,
+          fmt::format(
+            "warning: ignoring excess arguments, starting with '{}'",
+            args[next]));
+      }
+      return status;
+    }
+
+  private:
+    // Returns false once output should stop.
+    bool run_step(const step& s) {
+      switch (s.op) {
+        case step::kind::text: out.write(prog.text_of(s)); return true;
+        case step::kind::escaped: return put_escaped(arg());
+        case step::kind::stop: return false;
+        case step::kind::fail:
+          out.flush();
+          report(argv0, prog.text_of(s));
+          exit(1);
+        case step::kind::convert: break;
+      }
+
+      bool left     = s.left;
+      int width     = s.width;
+      int precision = s.precision;
+      if (s.width_arg) {
+        auto str       = arg();
+        intmax_t value = to_number<intmax_t>(str, strtoimax);
+        if (value < INT_MIN || value > INT_MAX)
+          fatal(fmt::format("invalid field width: '{}'", str));
+        width = int(value);
+        if (width < 0) {
+          left  = true;
+          width = width == INT_MIN ? INT_MAX : -width;
+        }
+      }
+      if (s.precision_arg) {
+        auto str       = arg();
+        intmax_t value = to_number<intmax_t>(str, strtoimax);
+        if (value > INT_MAX)
+          fatal(fmt::format("invalid precision: '{}'", str));
+        precision = value < 0 ? -1 : int(value);
+      }
+
+      switch (s.conversion) {
+        case 's': {
+          auto str = arg();
+          if (precision >= 0) str = str.substr(0, size_t(precision));
+          pad_text(str, left, width);
+        } break;
+        case 'c': {
+          auto str = arg();
+          // an empty argument is its terminating NUL
+          char c = str.empty() ? '\0' : str[0];
+          pad_text({&c, 1}, left, width);
+        } break;
+        case 'd':
+        case 'i': {
+          intmax_t value = to_number<intmax_t>(arg(), strtoimax);
+          uintmax_t magnitude =
+            value < 0 ? 0 - uintmax_t(value) : uintmax_t(value);
+          char sign = value < 0 ? '-' : s.plus ? '+' : s.space ? ' ' : '\0';
+          put_integer(s, left, width, precision, sign, magnitude);
+        } break;
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X': {
+          uintmax_t value = to_number<uintmax_t>(arg(), strtoumax);
+          put_integer(s, left, width, precision, '\0', value);
+        } break;
+        default: {
+          long double value = to_number<long double>(arg(), strtold);
+          put_float(s, left ? -width : width, precision, value);
+        } break;
+      }
+      return true;
+    }
+
+    std::string_view arg() {
+      // missing arguments are empty, which is also zero
+      return next < args.size() ? args[next++] : ""sv;
+    }
+
+    [[noreturn]] void fatal(std::string_view msg) {
+      out.flush();
+      report(argv0, msg);
+      exit(1);
+    }
+
+    // Parses a numeric argument. As in C, a leading quote stands for the
+    // value of the character after it. Bad arguments are reported, and
+    // whatever could be parsed is used; they only change the exit status.
+    // The argument views come from argv, so they are NUL-terminated.
+    template <typename T, typename Parse>
+    T to_number(std::string_view str, Parse parse) {
+      if (str.size() >= 2 && (str[0] == '\'' || str[0] == '"')) {
+        if (str.size() > 2) {
+          report(
+            argv0,
+            fmt::format(
+              "warning: {}: character(s) following character constant have "
+              "been ignored",
+              str.substr(2)));
+        }
+        return T(static_cast<unsigned char>(str[1]));
+      }
+
+      char* end;
+      errno = 0;
+      T value;
+      if constexpr (std::is_floating_point_v<T>)
+        value = parse(str.data(), &end);
+      else
+        value = parse(str.data(), &end, 0);
+      int error = errno;
+      if (error != 0) {
+        report(argv0, fmt::format("'{}': {}", str, std::strerror(error)));
+        status = 1;
+      }
+      else if (*end != '\0') {
+        report(
+          argv0,
+          fmt::format(
+            "'{}': {}", str,
+            end == str.data() ? "expected a numeric value" :
+                                "value not completely converted"));
+        status = 1;
+      }
+      return value;
+    }
+
+    void pad_text(std::string_view str, bool left, int width) {
+      auto& buf  = out.data();
+      size_t pad = size_t(width) > str.size() ? size_t(width) - str.size() : 0;
+      if (!left) fill(buf, pad, ' ');
+      buf.append(str.data(), str.data() + str.size());
+      if (left) fill(buf, pad, ' ');
+      out.maybe_flush();
+    }
+
+    // appends count copies of c to buf
+    static void fill(fmt::memory_buffer& buf, size_t count, char c) {
+      size_t used = buf.size();
+      buf.resize(used + count);
+      std::memset(buf.data() + used, c, count);
+    }
+
+    void put_integer(
+      const step& s, bool left, int width, int precision, char sign,
+      uintmax_t value) {
+      char digits[32];
+      char* end = digits;
+      switch (s.conversion) {
+        case 'o': end = fmt::format_to(digits, "{:o}", value); break;
+        case 'x': end = fmt::format_to(digits, "{:x}", value); break;
+        case 'X': end = fmt::format_to(digits, "{:X}", value); break;
+        default: {
+          fmt::format_int str(value);
+          end = std::copy(str.data(), str.data() + str.size(), digits);
+        } break;
+      }
+      // a precision of zero prints nothing for zero
+      size_t count = precision == 0 && value == 0 ? 0 : size_t(end - digits);
+
+      char prefix[3];
+      size_t prefix_size = 0;
+      if (sign != '\0') prefix[prefix_size++] = sign;
+      if (s.alternate && value != 0 && (s.conversion | 0x20) == 'x') {
+        prefix[prefix_size++] = '0';
+        prefix[prefix_size++] = s.conversion;
+      }
+      size_t zeros =
+        precision > 0 && size_t(precision) > count ? precision - count : 0;
+      // the alternate octal form starts with a 0
+      if (s.alternate && s.conversion == 'o' && zeros == 0 &&
+          (count == 0 || digits[0] != '0'))
+        zeros = 1;
+
+      size_t body = prefix_size + zeros + count;
+      size_t pad  = size_t(width) > body ? size_t(width) - body : 0;
+      bool zero_pad = s.zero && !left && precision < 0;
+
+      auto& buf = out.data();
+      if (!left && !zero_pad) fill(buf, pad, ' ');
+      buf.append(prefix, prefix + prefix_size);
+      fill(buf, zero_pad ? zeros + pad : zeros, '0');
+      buf.append(digits, digits + count);
+      if (left) fill(buf, pad, ' ');
+      out.maybe_flush();
+    }
+
+    // fmt cannot be relied on for long double here (it gets %f and %#g
+    // wrong for some values), so these go through snprintf, straight into
+    // the buffer.
+    void put_float(const step& s, int width, int precision, long double value) {
+      const std::string_view format = prog.text_of(s);
+      char spec[16];
+      *std::copy(format.begin(), format.end(), spec) = '\0';
+
+      auto& buf   = out.data();
+      size_t used = buf.size();
+      size_t room = 64 + size_t(std::abs(width));
+      for (;;) {
+        buf.resize(used + room);
+        int res =
+          std::snprintf(buf.data() + used, room, spec, width, precision, value);
+        if (res < 0) {
+          buf.resize(used);
+          return;
+        }
+        if (size_t(res) < room) {
+          buf.resize(used + size_t(res));
+          break;
+        }
+        room = size_t(res) + 1;
+      }
+      out.maybe_flush();
+    }
+
+    bool put_escaped(std::string_view str) {
+      auto& buf  = out.data();
+      size_t pos = 0;
+      while (pos < str.size()) {
+        size_t next = str.find('\\', pos);
+        if (next == std::string_view::npos) next = str.size();
+        buf.append(str.data() + pos, str.data() + next);
+        if (next == str.size()) break;
+        auto esc = coreutils::decode_escape(
+          str.substr(next + 1), coreutils::escape_syntax::printf_arg);
+        if (esc.invalid) fatal("missing hexadecimal number in escape");
+        if (esc.stop) return false;
+        buf.append(esc.bytes, esc.bytes + esc.size);
+        pos = next + 1 + esc.length;
+      }
+      out.maybe_flush();
+      return true;
+    }
+
+    std::string_view argv0;
+    const program& prog;
+    std::span<const std::string_view> args;
+    size_t next = 0;
+    int status  = 0;
+    coreutils::output_buffer out;
+  };
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  auto args = coreutils::arg_view(argc, argv);
+  if (args.size() == 2 && args[1] == "--help") {
+    usage(args[0]);
+    return 0;
+  }
+
+  auto argv0    = args[0];
+  auto operands = args.subspan(1);
+  if (!operands.empty() && operands[0] == "--") operands = operands.subspan(1);
+  if (operands.empty()) {
+    report(argv0, "missing operand");
+    return 1;
+  }
+
+  program prog(operands[0]);
+  try {
+    return printer(argv0, prog, operands.subspan(1)).run();
+  }
+  catch (const std::system_error& e) {
+    report(argv0, fmt::format("write error: {}", e.code().message()));
+    return 1;
+  }
+}
@@ -0,0 +1,744 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/raw_write.hpp"
+
+using namespace std::string_view_literals;
+
+void usage(std::string_view argv0) {
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] LAST
+   or: {0} [OPTIONS...] FIRST LAST
+   or: {0} [OPTIONS...] FIRST INCREMENT LAST
+   or: {0} --help
+Prints the numbers from FIRST (default 1) to LAST in steps of INCREMENT
+(default 1). FIRST, INCREMENT and LAST may be negative and have fractional
+parts; the output has as many decimal places as FIRST or INCREMENT.
+
+Options:
+  -f, --format FORMAT
+                print each number with the printf floating-point FORMAT
+  -s, --separator STRING
+                separate the numbers with STRING instead of a newline
+  -w, --equal-width
+                pad the numbers with leading zeros to the same width
+
+  --help        print this help page and exit
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string> operands;
+  std::string separator = "\n";
+  std::string format;
+
+  bool has_format : 1  = false;
+  bool equal_width : 1 = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+
+  // Negative numbers look like options, so operands are picked out before
+  // the options are parsed, keeping their order.
+  bool is_negative_number(std::string_view arg) {
+    return arg.size() > 1 && arg[0] == '-' &&
+      ((arg[1] >= '0' && arg[1] <= '9') || arg[1] == '.');
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  std::vector<const char*> args {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--"sv) {
+      for (++i; i < argc; ++i)
+        data.operands.emplace_back(argv[i]);
+      break;
+    }
+    if (arg.size() < 2 || arg[0] != '-' || is_negative_number(arg)) {
+      data.operands.emplace_back(arg);
+      continue;
+    }
+    args.push_back(argv[i]);
+    bool takes_value = arg == "-f"sv || arg == "--format"sv ||
+      arg == "-s"sv || arg == "--separator"sv;
+    if (takes_value && i + 1 < argc) args.push_back(argv[++i]);
+  }
+
+  auto set_format = [&](std::string_view arg) {
+    data.format     = arg;
+    data.has_format = true;
+  };
+  auto set_separator = [&](std::string_view arg) { data.separator = arg; };
+  auto set_equal     = [&] { data.equal_width = true; };
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-f", 1>(set_format),
+    option<"--format", 1>(set_format),
+    option<"-s", 1>(set_separator),
+    option<"--separator", 1>(set_separator),
+    option<"-w", 0>(set_equal),
+    option<"--equal-width", 0>(set_equal),
+    pos_arg([&](std::string_view arg) { data.operands.emplace_back(arg); }));
+  opts.parse(int(args.size()), args.data());
+
+  if (data.operands.empty()) fail(argv[0], "missing operand");
+  if (data.operands.size() > 3)
+    fail(argv[0], fmt::format("extra operand '{}'", data.operands[3]));
+  if (data.has_format && data.equal_width) {
+    fail(
+      argv[0],
+      "format string may not be specified when printing equal width strings");
+  }
+  return data;
+}
+
+namespace {
+  using u128 = unsigned __int128;
+
+  // Scaled values are kept below this, so that sums never overflow.
+  constexpr u128 max_scaled =
+    u128(1000000000000000000ULL) * 1000000000000000000ULL;
+
+  // An operand written in plain decimal: sign, digits, and how many of the
+  // digits come after the point.
+  struct decimal {
+    bool negative = false;
+    std::string digits;
+    size_t scale = 0;
+
+    // digits * 10^(to - scale); nullopt if it gets too big
+    std::optional<u128> scaled(size_t to) const {
+      u128 res = 0;
+      for (char c : digits) {
+        res = res * 10 + unsigned(c - '0');
+        if (res >= max_scaled) return std::nullopt;
+      }
+      for (size_t i = scale; i < to; ++i) {
+        res *= 10;
+        if (res >= max_scaled) return std::nullopt;
+      }
+      return res;
+    }
+  };
+
+  std::optional<decimal> parse_decimal(std::string_view str) {
+    decimal res;
+    if (!str.empty() && (str[0] == '-' || str[0] == '+')) {
+      res.negative = str[0] == '-';
+      str.remove_prefix(1);
+    }
+    bool point = false, any = false;
+    for (char c : str) {
+      if (c == '.' && !point) {
+        point = true;
+      }
+      else if (c >= '0' && c <= '9') {
+        res.digits.push_back(c);
+        res.scale += point;
+        any = true;
+      }
+      else {
+        return std::nullopt;
+      }
+    }
+    if (!any) return std::nullopt;
+    return res;
+  }
+
+  // A printf floating-point directive with whatever surrounds it.
+  struct format_spec {
+    std::string prefix, suffix;
+    std::string flags;
+    int width     = 0;
+    int precision = -1;
+    char conversion = 0;
+
+    bool left() const { return flags.find('-') != std::string::npos; }
+    bool zero() const { return flags.find('0') != std::string::npos; }
+    // flags that only printf knows how to apply
+    bool special() const {
+      return flags.find_first_of("#'") != std::string::npos;
+    }
+    char sign() const {
+      if (flags.find('+') != std::string::npos) return '+';
+      if (flags.find(' ') != std::string::npos) return ' ';
+      return 0;
+    }
+  };
+
+  format_spec parse_format(const char* argv0, std::string_view format) {
+    constexpr auto npos = std::string_view::npos;
+    auto is_digit       = [](char c) { return c >= '0' && c <= '9'; };
+
+    format_spec res;
+    std::string* text = &res.prefix;
+    bool found        = false;
+    for (size_t i = 0; i < format.size(); ++i) {
+      if (format[i] != '%') {
+        text->push_back(format[i]);
+        continue;
+      }
+      if (i + 1 < format.size() && format[i + 1] == '%') {
+        text->push_back('%');
+        ++i;
+        continue;
+      }
+      if (found) {
+        fail(
+          argv0, fmt::format("format '{}' has too many % directives", format));
+      }
+      found        = true;
+      size_t start = i++;
+      while (i < format.size() && "-+ #0'"sv.find(format[i]) != npos)
+        res.flags.push_back(format[i++]);
+      for (; i < format.size() && is_digit(format[i]); ++i)
+        res.width = res.width * 10 + (format[i] - '0');
+      if (i < format.size() && format[i] == '.') {
+        res.precision = 0;
+        for (++i; i < format.size() && is_digit(format[i]); ++i)
+          res.precision = res.precision * 10 + (format[i] - '0');
+      }
+      if (i >= format.size() || "aAeEfFgG"sv.find(format[i]) == npos) {
+        auto directive = format.substr(start, i + 1 - start);
+        fail(
+          argv0,
+          fmt::format(
+            "format '{}' has unknown {} directive", format, directive));
+      }
+      res.conversion = format[i];
+      text           = &res.suffix;
+    }
+    if (!found)
+      fail(argv0, fmt::format("format '{}' has no % directive", format));
+    return res;
+  }
+
+  // Accumulates output and writes it in whole pages, keeping the remainder
+  // for the next block.
+  class block_writer {
+  public:
+    static constexpr size_t page  = 4096;
+    static constexpr size_t block = 64 * page;
+
+    // room is the most that is appended between calls to reserve()
+    explicit block_writer(size_t room) :
+      capacity(block + room), buffer(new char[capacity]) {}
+
+    char* reserve(size_t n) {
+      if (used + n > capacity) flush_pages();
+      return buffer.get() + used;
+    }
+    void commit(char* end) { used = size_t(end - buffer.get()); }
+
+    char* limit() { return buffer.get() + capacity; }
+
+    void flush_pages() {
+      size_t n = used & ~(page - 1);
+      write(n);
+      std::memmove(buffer.get(), buffer.get() + n, used - n);
+      used -= n;
+    }
+    void flush() { write(used), used = 0; }
+
+  private:
+    void write(size_t n) {
+      if (!coreutils::write_all(STDOUT_FILENO, {{buffer.get(), n}}))
+        throw std::system_error(errno, std::generic_category(), "write");
+    }
+
+    size_t capacity;
+    std::unique_ptr<char[]> buffer;
+    size_t used = 0;
+  };
+
+  class sequence {
+  public:
+    sequence(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {}
+
+    int run() {
+      std::vector<std::optional<decimal>> ops;
+      for (const auto& op : config.operands)
+        ops.push_back(parse_decimal(op));
+
+      const char* first_str = config.operands.size() > 1 ?
+        config.operands[0].c_str() :
+        "1";
+      const char* step_str = config.operands.size() > 2 ?
+        config.operands[1].c_str() :
+        "1";
+      const char* last_str = config.operands.back().c_str();
+
+      if (config.has_format) spec = parse_format(argv0, config.format);
+      if (auto fast = try_fixed(first_str, step_str, last_str); fast)
+        return *fast;
+      return run_general(first_str, step_str, last_str);
+    }
+
+  private:
+    // The fixed-point path: every number is an integer number of units of
+    // 10^-scale, written from the counter.
+    std::optional<int> try_fixed(
+      const char* first_str, const char* step_str, const char* last_str) {
+      auto first = parse_decimal(first_str);
+      auto step  = parse_decimal(step_str);
+      auto last  = parse_decimal(last_str);
+      if (!first || !step || !last) return std::nullopt;
+
+      scale = std::max(first->scale, step->scale);
+      auto first_v = first->scaled(scale);
+      auto step_v  = step->scaled(scale);
+      // LAST only bounds the sequence; it may have more decimal places
+      auto last_v = last->scaled(std::max(scale, last->scale));
+      if (!first_v || !step_v || !last_v) return std::nullopt;
+      if (*step_v == 0)
+        fail(
+          argv0, fmt::format("invalid Zero increment value: '{}'", step_str));
+
+      if (config.has_format && !fits_format(*first, *last))
+        return std::nullopt;
+
+      // count the numbers, working in units of LAST's precision
+      size_t extra = last->scale > scale ? last->scale - scale : 0;
+      u128 unit    = 1;
+      for (size_t i = 0; i < extra; ++i)
+        unit *= 10;
+      if (*first_v >= max_scaled / unit || *step_v >= max_scaled / unit)
+        return std::nullopt;
+
+      bool first_neg = first->negative && *first_v != 0;
+      bool step_neg  = step->negative;
+      bool last_neg  = last->negative && *last_v != 0;
+      auto signed_cmp = [](bool an, u128 a, bool bn, u128 b) {
+        // -1, 0 or 1 for a <=> b
+        if (an != bn) return an ? -1 : 1;
+        if (a == b) return 0;
+        return ((a < b) != an) ? -1 : 1;
+      };
+      u128 f = *first_v * unit, s = *step_v * unit, l = *last_v;
+      int order = signed_cmp(first_neg, f, last_neg, l);
+      if (step_neg ? order < 0 : order > 0) return 0;
+
+      // |last - first|
+      u128 span = first_neg == last_neg ? (f > l ? f - l : l - f) : f + l;
+      u128 count = span / s + 1;
+
+      // width for -w: the widest of FIRST and LAST as they would be printed
+      std::string first_text = fixed_text(first_neg, *first_v, scale);
+      std::string last_text  = fixed_text(last_neg, *last_v / unit, scale);
+      width = config.equal_width ?
+        std::max(first_text.size(), last_text.size()) :
+        0;
+
+      step_digits = fixed_text(false, *step_v, 0);
+      emit(first_neg, *first_v, step_neg, *step_v, count);
+      return 0;
+    }
+
+    // Whether -f FORMAT can be written from the counter: %f with at least
+    // as many decimal places as the numbers have, or %g for integers short
+    // enough that %g would not switch to exponents.
+    bool fits_format(const decimal& first, const decimal& last) {
+      if (spec.special()) return false;
+      int precision = spec.precision < 0 ? 6 : spec.precision;
+      switch (spec.conversion) {
+        case 'f':
+        case 'F':
+          if (size_t(precision) < scale) return false;
+          zeros = size_t(precision) - scale;
+          return true;
+        case 'g':
+        case 'G': {
+          if (scale != 0 || last.scale != 0) return false;
+          auto digits = [](const decimal& d) {
+            size_t lead = d.digits.find_first_not_of('0');
+            return lead == std::string::npos ? 1 : d.digits.size() - lead;
+          };
+          size_t limit = size_t(std::max(precision, 1));
+          return digits(first) <= limit && digits(last) <= limit;
+        }
+        default: return false;
+      }
+    }
+
+    static std::string fixed_text(bool negative, u128 value, size_t scale) {
+      std::string res;
+      do {
+        res.push_back(char('0' + unsigned(value % 10)));
+        value /= 10;
+      } while (value != 0);
+      while (res.size() <= scale)
+        res.push_back('0');
+      if (scale > 0) res.insert(scale, 1, '.');
+      if (negative) res.push_back('-');
+      std::reverse(res.begin(), res.end());
+      return res;
+    }
+
+    // The current number is kept rendered, followed by the separator, and
+    // each step is applied to its digits in place, so most numbers cost a
+    // copy and a change to the last digit or two. It is only rendered again
+    // when its number of digits changes.
+    void emit(
+      bool negative, u128 value, bool step_neg, u128 step, u128 count) {
+      size_t room = config.separator.size() + spec.prefix.size() +
+        spec.suffix.size() + max_digits + 3 + zeros +
+        std::max(width, size_t(std::max(spec.width, 0)));
+      // short lines are copied as one fixed-size block, which needs no call
+      // to memcpy
+      constexpr size_t short_line = 32;
+      room = std::max(room, short_line);
+      block_writer out(room);
+      line.reset(new char[room]);
+
+      auto copy_line = [&](char* p, const char* src, size_t size) {
+        if (size <= short_line)
+          std::memcpy(p, src, short_line);
+        else
+          std::memcpy(p, src, size);
+        return p + size;
+      };
+      auto write_line = [&] {
+        out.commit(copy_line(out.reserve(room), line.get(), line_size));
+      };
+
+      // Writes the rest of a run, as many lines per block as fit. The last
+      // digit is kept in a register and patched into each copy, so the line
+      // is only stored to when a step carries; reading it back right after
+      // a byte store would stall every copy on store forwarding.
+      auto write_run = [&](u128 start, u128 run, bool grows) {
+        const char* src = line.get();
+        size_t size     = line_size;
+        size_t at       = last_digit;
+        char last       = line[at];
+        int digit = step_digits.size() == 1 ? step_digits[0] - '0' : 10;
+        int delta = grows ? digit : -digit;
+        for (u128 i = 1; i < run;) {
+          char* p     = out.reserve(room);
+          char* limit = out.limit() - room;
+          for (; i < run && p <= limit; ++i) {
+            if (unsigned(last + delta - '0') <= 9) {
+              last = char(last + delta);
+            }
+            else {
+              line[at] = last;
+              if (!(grows ? add_step() : sub_step()))
+                render(negative, grows ? start + i * step : start - i * step);
+              size = line_size;
+              at   = last_digit;
+              last = line[at];
+            }
+            char* next = copy_line(p, src, size);
+            p[at]      = last;
+            p          = next;
+          }
+          out.commit(p);
+        }
+        line[at] = last;
+      };
+
+      while (count > 0) {
+        // zero has no sign, so it is printed on its own
+        if (value == 0) {
+          render(false, 0);
+          write_line();
+          --count;
+          value    = step;
+          negative = step_neg;
+          continue;
+        }
+
+        // a run either moves away from zero, adding to the digits, or
+        // towards it, subtracting, and stops short of zero
+        bool grows = negative == step_neg;
+        u128 run   = grows ? count : std::min(count, (value - 1) / step + 1);
+        render(negative, value);
+        write_line();
+        write_run(value, run, grows);
+        value = grows ? value + (run - 1) * step : value - (run - 1) * step;
+        count -= run;
+        if (count == 0) break;
+
+        // one step past the run is zero or on the other side
+        value    = step - value;
+        negative = value != 0 && step_neg;
+      }
+
+      // the last separator becomes the final newline
+      if (line_size > 0) {
+        size_t sep = config.separator.size();
+        char* p    = out.reserve(1) - sep;
+        *p++       = '\n';
+        out.commit(p);
+      }
+      out.flush();
+    }
+
+    void render(bool negative, u128 value) {
+      char digits[max_digits];
+      char* end   = digits + max_digits;
+      char* start = end;
+      do {
+        *--start = char('0' + unsigned(value % 10));
+        value /= 10;
+      } while (value != 0);
+      while (size_t(end - start) <= scale)
+        *--start = '0';
+
+      std::string_view text {start, size_t(end - start)};
+      char* p   = write_number(line.get(), negative, text);
+      p         = put(p, config.separator);
+      line_size = size_t(p - line.get());
+    }
+
+    // Adds the step to the rendered digits. Returns false if the number
+    // needs another digit.
+    bool add_step() {
+      char* p        = line.get() + last_digit;
+      char* first    = line.get() + first_digit;
+      char* dot      = scale > 0 ? line.get() + dot_pos : nullptr;
+      unsigned carry = 0;
+      for (size_t j = step_digits.size(); j-- > 0;) {
+        if (p == dot) --p;
+        if (p < first) return false;
+        unsigned d = unsigned(*p - '0') + unsigned(step_digits[j] - '0');
+        d += carry;
+        carry      = d >= 10;
+        *p--       = char('0' + (carry ? d - 10 : d));
+      }
+      while (carry) {
+        if (p == dot) --p;
+        if (p < first) return false;
+        if (*p == '9') {
+          *p-- = '0';
+        }
+        else {
+          ++*p;
+          carry = 0;
+        }
+      }
+      return true;
+    }
+
+    // Subtracts the step, which is less than the number, from the rendered
+    // digits. Returns false if the number loses a digit.
+    bool sub_step() {
+      char* p         = line.get() + last_digit;
+      char* first     = line.get() + first_digit;
+      char* dot       = scale > 0 ? line.get() + dot_pos : nullptr;
+      unsigned borrow = 0;
+      for (size_t j = step_digits.size(); j-- > 0;) {
+        if (p == dot) --p;
+        int d  = (*p - '0') - (step_digits[j] - '0') - int(borrow);
+        borrow = d < 0;
+        *p--   = char('0' + (borrow ? d + 10 : d));
+      }
+      while (borrow) {
+        if (p == dot) --p;
+        if (*p == '0') {
+          *p-- = '9';
+        }
+        else {
+          --*p;
+          borrow = 0;
+        }
+      }
+      // a leading zero is only kept right before the point
+      bool last_int =
+        scale > 0 ? first + 1 == dot : first == line.get() + last_digit;
+      return *first != '0' || last_int;
+    }
+
+    static char* put(char* p, std::string_view str) {
+      std::memcpy(p, str.data(), str.size());
+      return p + str.size();
+    }
+
+    // Writes one number, recording where its digits are.
+    char* write_number(char* out, bool negative, std::string_view digits) {
+      auto int_part  = digits.substr(0, digits.size() - scale);
+      auto frac_part = digits.substr(digits.size() - scale);
+
+      char sign = negative ? '-' : spec.sign();
+      size_t len =
+        (sign != 0) + int_part.size() + (scale + zeros > 0) + scale + zeros;
+
+      char* p = put(out, spec.prefix);
+      size_t pad = 0;
+      bool zero_pad = config.equal_width;
+      if (config.has_format) {
+        pad      = size_t(std::max(spec.width, 0));
+        zero_pad = spec.zero() && !spec.left();
+      }
+      else {
+        pad = width;
+      }
+      pad = pad > len ? pad - len : 0;
+
+      if (!zero_pad && !spec.left()) p = fill(p, ' ', pad);
+      if (sign != 0) *p++ = sign;
+      if (zero_pad) p = fill(p, '0', pad);
+      first_digit = size_t(p - out);
+      p           = put(p, int_part);
+      if (scale > 0) {
+        dot_pos = size_t(p - out);
+        *p++    = '.';
+        p       = put(p, frac_part);
+      }
+      last_digit = size_t(p - out) - 1;
+      if (scale == 0 && zeros > 0) *p++ = '.';
+      p = fill(p, '0', zeros);
+      if (config.has_format && spec.left()) p = fill(p, ' ', pad);
+      return put(p, spec.suffix);
+    }
+
+    static char* fill(char* p, char c, size_t n) {
+      std::memset(p, c, n);
+      return p + n;
+    }
+
+    // Everything else: numbers in exponent notation, out of range, or with
+    // a format the counter cannot produce. Each number is computed from the
+    // start, so errors do not accumulate.
+    int run_general(
+      const char* first_str, const char* step_str, const char* last_str) {
+      auto parse = [&](const char* str) {
+        char* end;
+        errno          = 0;
+        long double v  = strtold(str, &end);
+        if (end == str || *end != '\0' || errno == ERANGE) {
+          fail(
+            argv0, fmt::format("invalid floating point argument: '{}'", str));
+        }
+        if (std::isnan(v)) {
+          fail(
+            argv0, fmt::format("invalid 'not-a-number' argument: '{}'", str));
+        }
+        return v;
+      };
+      long double first = parse(first_str);
+      long double step  = parse(step_str);
+      long double last  = parse(last_str);
+      if (step == 0)
+        fail(
+          argv0, fmt::format("invalid Zero increment value: '{}'", step_str));
+
+      auto escape = [](std::string_view text) {
+        std::string res;
+        for (char c : text) {
+          res.push_back(c);
+          if (c == '%') res.push_back('%');
+        }
+        return res;
+      };
+      std::string format = "%Lg";
+      if (config.has_format) {
+        format = escape(spec.prefix) + "%" + spec.flags;
+        if (spec.width > 0) format += std::to_string(spec.width);
+        if (spec.precision >= 0)
+          format += "." + std::to_string(spec.precision);
+        format += 'L';
+        format += spec.conversion;
+        format += escape(spec.suffix);
+      }
+
+      auto text = [&](long double v) {
+        char buf[512];
+        int n = std::snprintf(buf, sizeof(buf), format.c_str(), v);
+        return std::string(buf, size_t(std::clamp(n, 0, 511)));
+      };
+      size_t pad_to = config.equal_width ?
+        std::max(text(first).size(), text(last).size()) :
+        0;
+
+      block_writer out(config.separator.size() + 512 + pad_to + 1);
+      bool wrote       = false;
+      long double prev = 0;
+      for (uintmax_t i = 0;; ++i) {
+        long double v = first + step * (long double)(i);
+        if (step > 0 ? v > last : v < last) break;
+        // past the precision of long double the steps stop changing v
+        if (i > 0 && v == prev) break;
+        prev = v;
+        auto str = text(v);
+        char* p  = out.reserve(config.separator.size() + str.size() + pad_to);
+        if (i > 0) p = put(p, config.separator);
+        size_t sign = !str.empty() && str[0] == '-';
+        if (sign) *p++ = '-';
+        if (str.size() < pad_to) p = fill(p, '0', pad_to - str.size());
+        p = put(p, std::string_view(str).substr(sign));
+        out.commit(p);
+        wrote = true;
+        if (v == last) break;
+      }
+      if (wrote) {
+        char* p = out.reserve(1);
+        *p++    = '\n';
+        out.commit(p);
+      }
+      out.flush();
+      return 0;
+    }
+
+    const option_data& config;
+    const char* argv0;
+    format_spec spec;
+
+    size_t scale = 0;
+    size_t zeros = 0;
+    size_t width = 0;
+    std::string step_digits;
+
+    // enough for any scaled value below max_scaled
+    static constexpr size_t max_digits = 40;
+    std::unique_ptr<char[]> line;
+    size_t line_size   = 0;
+    size_t first_digit = 0;
+    size_t last_digit  = 0;
+    size_t dot_pos     = 0;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  try {
+    return sequence(config, argv[0]).run();
+  }
+  catch (const std::system_error& e) {
+    if (e.code().value() == EPIPE) return 1;
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.code().message());
+    return 1;
+  }
+}
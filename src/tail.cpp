@@ -0,0 +1,565 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/scan.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: tail [OPTIONS...] [FILES...]
+
+Writes the last 10 lines of each FILE to standard output. With no FILES, or
+when FILE is -, reads standard input.
+
+Options:
+  -c N    write the last N bytes; with +N, start at byte N
+  -f      keep writing data as it is appended to each file
+  -F      like -f, but follow the file name: reopen files that are rotated,
+          recreated or truncated
+  -n N    write the last N lines (default 10); with +N, start at line N
+  -q      never write headers with file names
+  -v      always write headers with file names
+
+  --help  print this help page and exit
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  enum class follow_mode { none, descriptor, name };
+  enum class headers { automatic, always, never };
+
+  std::vector<std::string> paths;
+
+  uint64_t count   = 10;
+  bool bytes : 1      = false;
+  bool from_start : 1 = false;
+
+  follow_mode follow  = follow_mode::none;
+  headers header_bhv = headers::automatic;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  auto parse_count = [&](std::string_view arg) {
+    data.from_start = !arg.empty() && arg.front() == '+';
+    if (!arg.empty() && (arg.front() == '+' || arg.front() == '-'))
+      arg.remove_prefix(1);
+    auto res = std::from_chars(arg.data(), arg.data() + arg.size(), data.count);
+    if (arg.empty() || res.ec != std::errc {} ||
+        res.ptr != arg.data() + arg.size()) {
+      std::cerr << fmt::format("{}: invalid count '{}'\n", argv[0], arg);
+      exit(1);
+    }
+  };
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-c", 1>([&](std::string_view arg) {
+      data.bytes = true;
+      parse_count(arg);
+    }),
+    option<"-f", 0>(
+      [&] { data.follow = option_data::follow_mode::descriptor; }),
+    option<"-F", 0>([&] { data.follow = option_data::follow_mode::name; }),
+    option<"-n", 1>([&](std::string_view arg) {
+      data.bytes = false;
+      parse_count(arg);
+    }),
+    option<"-q", 0>([&] { data.header_bhv = option_data::headers::never; }),
+    option<"-v", 0>([&] { data.header_bhv = option_data::headers::always; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+
+  if (data.paths.empty()) data.paths.emplace_back("-");
+  return data;
+}
+
+namespace {
+  // backward scans read this much per pread; output-sized work, not file-sized
+  constexpr size_t block_size = 64 * 1024;
+
+  struct file_state {
+    std::string name;  // as given on the command line
+    int fd      = -1;
+    off_t offset = 0;  // where the next read in follow mode starts
+    bool seekable = false;
+    dev_t dev     = 0;
+    ino_t ino     = 0;
+    int wd        = -1;  // inotify watch on the file itself
+  };
+
+  class tailer {
+  public:
+    tailer(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {}
+
+    void report(std::string_view what, int err) {
+      std::cerr << fmt::format("{}: {}: {}\n", argv0, what, std::strerror(err));
+      status = 1;
+    }
+
+    void write_header(size_t index, const file_state& f) {
+      if (!print_headers || last_header == index) return;
+      out.format(
+        "{}==> {} <==\n", first_header ? "" : "\n",
+        f.fd == STDIN_FILENO ? "standard input" : f.name);
+      first_header = false;
+      last_header  = index;
+    }
+
+    bool open_file(file_state& f) {
+      if (f.name == "-") {
+        f.fd = STDIN_FILENO;
+      }
+      else {
+        f.fd = open(f.name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (f.fd < 0) {
+          report(fmt::format("cannot open '{}' for reading", f.name), errno);
+          return false;
+        }
+      }
+      struct stat st;
+      fstat(f.fd, &st);
+      f.dev      = st.st_dev;
+      f.ino      = st.st_ino;
+      f.seekable = S_ISREG(st.st_mode) && lseek(f.fd, 0, SEEK_CUR) >= 0;
+      return true;
+    }
+
+    // Writes [start, end) of a seekable file. The kernel copies straight to
+    // the output where it can.
+    void write_range(file_state& f, off_t start, off_t end) {
+      out.flush();
+      off_t pos = start;
+      while (pos < end) {
+        ssize_t n = sendfile(STDOUT_FILENO, f.fd, &pos, size_t(end - pos));
+        if (n > 0) continue;
+        if (n < 0 && errno == EINTR) continue;
+        if (n == 0) break;
+        // not supported for this output: go through the buffer instead
+        auto& buf = out.data();
+        while (pos < end) {
+          size_t len = std::min<size_t>(block_size, size_t(end - pos));
+          size_t old = buf.size();
+          buf.resize(old + len);
+          ssize_t m = pread(f.fd, buf.data() + old, len, pos);
+          if (m <= 0) {
+            buf.resize(old);
+            if (m < 0 && errno == EINTR) continue;
+            break;
+          }
+          buf.resize(old + size_t(m));
+          pos += m;
+          out.maybe_flush();
+        }
+        break;
+      }
+      f.offset = pos;
+    }
+
+    // Finds where the output of a seekable file starts by reading blocks
+    // backward from the end, so only about as much as is written is read.
+    off_t find_start_seekable(file_state& f, off_t size) {
+      if (config.bytes) {
+        if (config.from_start)
+          return std::min<off_t>(size, off_t(std::max<uint64_t>(config.count, 1) - 1));
+        return size > off_t(config.count) ? size - off_t(config.count) : 0;
+      }
+
+      std::unique_ptr<char[]> buffer(new char[block_size]);
+      if (config.from_start) {
+        size_t n = std::max<uint64_t>(config.count, 1) - 1;
+        if (n == 0) return 0;
+        for (off_t pos = 0; pos < size;) {
+          ssize_t len = pread(f.fd, buffer.get(), block_size, pos);
+          if (len <= 0) break;
+          size_t hit = coreutils::find_nth({buffer.get(), size_t(len)}, '\n', n);
+          if (hit != std::string_view::npos) return pos + off_t(hit) + 1;
+          pos += len;
+        }
+        return size;
+      }
+
+      if (config.count == 0 || size == 0) return size;
+      return coreutils::find_last_lines(f.fd, 0, size, '\n', config.count);
+    }
+
+    // Pipes and other unseekable inputs have to be read to the end, keeping
+    // only as many blocks as may still be needed.
+    void tail_stream(file_state& f) {
+      struct chunk {
+        std::string data;
+        size_t lines;
+      };
+      std::vector<chunk> chunks;
+      size_t lines = 0, bytes = 0;
+      uint64_t skip = config.from_start ? std::max<uint64_t>(config.count, 1) - 1 : 0;
+
+      std::unique_ptr<char[]> buffer(new char[block_size]);
+      for (;;) {
+        ssize_t len = read(f.fd, buffer.get(), block_size);
+        if (len < 0) {
+          if (errno == EINTR) continue;
+          report(fmt::format("error reading '{}'", f.name), errno);
+          break;
+        }
+        if (len == 0) break;
+        std::string_view block(buffer.get(), size_t(len));
+
+        if (config.from_start) {
+          // skip the first N-1 lines or bytes, then copy everything
+          if (skip > 0) {
+            if (config.bytes) {
+              size_t n = std::min<uint64_t>(skip, block.size());
+              block.remove_prefix(n);
+              skip -= n;
+            }
+            else {
+              size_t n   = skip;
+              size_t hit = coreutils::find_nth(block, '\n', n);
+              if (hit == std::string_view::npos) {
+                skip = n;
+                continue;
+              }
+              skip = 0;
+              block.remove_prefix(hit + 1);
+            }
+          }
+          out.write(block);
+          continue;
+        }
+
+        size_t nl = config.bytes ? 0 : coreutils::count_char(block, '\n');
+        chunks.push_back({std::string(block), nl});
+        lines += nl;
+        bytes += block.size();
+        // drop blocks from the front once the rest covers the request
+        while (chunks.size() > 1) {
+          auto& front = chunks.front();
+          bool enough = config.bytes ?
+            bytes - front.data.size() >= config.count :
+            lines - front.lines > config.count;
+          if (!enough) break;
+          lines -= front.lines;
+          bytes -= front.data.size();
+          chunks.erase(chunks.begin());
+        }
+      }
+
+      if (config.from_start) return;
+      std::string all;
+      all.reserve(bytes);
+      for (auto& c : chunks)
+        all.append(c.data);
+      std::string_view view(all);
+      if (config.bytes) {
+        if (view.size() > config.count) view.remove_prefix(view.size() - config.count);
+      }
+      else if (config.count == 0) {
+        view = {};
+      }
+      else {
+        std::string_view scan = view;
+        if (!scan.empty() && scan.back() == '\n') scan.remove_suffix(1);
+        size_t n   = config.count;
+        size_t hit = coreutils::rfind_nth(scan, '\n', n);
+        if (hit != std::string_view::npos) view.remove_prefix(hit + 1);
+      }
+      out.write(view);
+    }
+
+    void tail_file(size_t index, file_state& f) {
+      write_header(index, f);
+      if (f.seekable) {
+        struct stat st;
+        fstat(f.fd, &st);
+        write_range(f, find_start_seekable(f, st.st_size), st.st_size);
+      }
+      else {
+        tail_stream(f);
+      }
+    }
+
+    // Writes whatever was appended to a followed file since the last read.
+    void drain(size_t index, file_state& f) {
+      if (f.fd < 0) return;
+      if (f.seekable) {
+        struct stat st;
+        if (fstat(f.fd, &st) != 0) return;
+        if (st.st_size < f.offset) {
+          out.flush();
+          std::cerr << fmt::format("{}: {}: file truncated\n", argv0, f.name);
+          f.offset = 0;
+        }
+        if (st.st_size == f.offset) return;
+        write_header(index, f);
+        write_range(f, f.offset, st.st_size);
+        return;
+      }
+
+      // pipes are only drained once per wakeup, since a read would block
+      if (!pipe_buffer) pipe_buffer.reset(new char[block_size]);
+      ssize_t len = read(f.fd, pipe_buffer.get(), block_size);
+      if (len <= 0) return;
+      write_header(index, f);
+      out.write({pipe_buffer.get(), size_t(len)});
+    }
+
+    void run();
+
+    const option_data& config;
+    const char* argv0;
+    coreutils::output_buffer out;
+    std::vector<file_state> files;
+    bool print_headers = false;
+    int status         = 0;
+
+  private:
+    void follow();
+    void reopen(size_t index, std::string_view why);
+    void watch_file(size_t index);
+
+    bool first_header  = true;
+    size_t last_header = SIZE_MAX;
+    std::unique_ptr<char[]> pipe_buffer;
+
+    int inotify_fd = -1;
+    int epoll_fd   = -1;
+    std::unordered_map<int, size_t> file_watches;
+    std::unordered_map<int, std::vector<size_t>> dir_watches;
+  };
+
+  std::string_view dir_name(std::string_view path) {
+    auto pos = path.rfind('/');
+    if (pos == std::string_view::npos) return ".";
+    if (pos == 0) return "/";
+    return path.substr(0, pos);
+  }
+
+  std::string_view base_name(std::string_view path) {
+    auto pos = path.rfind('/');
+    return pos == std::string_view::npos ? path : path.substr(pos + 1);
+  }
+
+  constexpr uint64_t inotify_tag = UINT64_MAX;
+
+  void tailer::run() {
+    print_headers = config.header_bhv == option_data::headers::always ||
+      (config.header_bhv == option_data::headers::automatic &&
+       config.paths.size() > 1);
+
+    files.resize(config.paths.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto& f = files[i];
+      f.name  = config.paths[i];
+      if (!open_file(f)) continue;
+      tail_file(i, f);
+    }
+    out.flush();
+
+    if (config.follow != option_data::follow_mode::none) follow();
+  }
+
+  void tailer::watch_file(size_t index) {
+    auto& f = files[index];
+    if (f.fd < 0 || !f.seekable) return;
+    // watching through /proc/self/fd pins the watch to the open file, not to
+    // whatever the name points at later
+    uint32_t mask = IN_MODIFY | IN_ATTRIB;
+    if (config.follow == option_data::follow_mode::name)
+      mask |= IN_MOVE_SELF | IN_DELETE_SELF;
+    auto fd_path = fmt::format("/proc/self/fd/{}", f.fd);
+    f.wd = inotify_add_watch(inotify_fd, fd_path.c_str(), mask);
+    if (f.wd < 0) f.wd = inotify_add_watch(inotify_fd, f.name.c_str(), mask);
+    if (f.wd >= 0) file_watches[f.wd] = index;
+  }
+
+  // Switches a followed name over to whatever file now has that name.
+  void tailer::reopen(size_t index, std::string_view why) {
+    auto& f = files[index];
+    int fd  = open(f.name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    fstat(fd, &st);
+    if (f.fd >= 0 && st.st_dev == f.dev && st.st_ino == f.ino) {
+      close(fd);
+      return;
+    }
+
+    if (f.fd >= 0) {
+      drain(index, f);
+      if (f.wd >= 0) {
+        inotify_rm_watch(inotify_fd, f.wd);
+        file_watches.erase(f.wd);
+      }
+      close(f.fd);
+    }
+    out.flush();
+    std::cerr << fmt::format(
+      "{}: '{}' {}; following new file\n", argv0, f.name, why);
+
+    f.fd       = fd;
+    f.dev      = st.st_dev;
+    f.ino      = st.st_ino;
+    f.offset   = 0;
+    f.seekable = S_ISREG(st.st_mode) && lseek(fd, 0, SEEK_CUR) >= 0;
+    watch_file(index);
+    drain(index, f);
+  }
+
+  // One epoll loop serves every followed file: regular files through a single
+  // inotify instance, pipes directly.
+  void tailer::follow() {
+    bool by_name = config.follow == option_data::follow_mode::name;
+    epoll_fd     = epoll_create1(EPOLL_CLOEXEC);
+    inotify_fd   = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (epoll_fd < 0 || inotify_fd < 0) {
+      report("cannot set up file watches", errno);
+      return;
+    }
+
+    epoll_event ev {};
+    ev.events   = EPOLLIN;
+    ev.data.u64 = inotify_tag;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev);
+
+    size_t active = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+      auto& f = files[i];
+      if (by_name && f.name != "-") {
+        // the directory watch notices the name being created or replaced
+        std::string dir(dir_name(f.name));
+        int wd = inotify_add_watch(
+          inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+        if (wd >= 0) {
+          dir_watches[wd].push_back(i);
+          ++active;
+        }
+      }
+      if (f.fd < 0) continue;
+      if (f.seekable) {
+        watch_file(i);
+        if (!by_name && f.wd >= 0) ++active;
+      }
+      else {
+        ev.events   = EPOLLIN;
+        ev.data.u64 = i;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, f.fd, &ev) == 0) ++active;
+      }
+    }
+
+    std::vector<char> events(64 * (sizeof(inotify_event) + NAME_MAX + 1));
+    epoll_event ready[64];
+    while (active > 0) {
+      int n = epoll_wait(epoll_fd, ready, 64, -1);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        report("epoll_wait", errno);
+        return;
+      }
+
+      for (int r = 0; r < n; ++r) {
+        if (ready[r].data.u64 != inotify_tag) {
+          size_t i = size_t(ready[r].data.u64);
+          drain(i, files[i]);
+          if (ready[r].events & (EPOLLHUP | EPOLLERR)) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, files[i].fd, nullptr);
+            --active;
+          }
+          continue;
+        }
+
+        for (;;) {
+          ssize_t len = read(inotify_fd, events.data(), events.size());
+          if (len <= 0) break;
+          for (ssize_t pos = 0; pos < len;) {
+            auto* ie = reinterpret_cast<inotify_event*>(events.data() + pos);
+            pos += ssize_t(sizeof(inotify_event) + ie->len);
+
+            if (auto it = dir_watches.find(ie->wd); it != dir_watches.end()) {
+              if (ie->len == 0) continue;
+              std::string_view name(ie->name);
+              for (size_t i : it->second) {
+                if (base_name(files[i].name) == name)
+                  reopen(i, files[i].fd < 0 ? "has appeared" : "has been replaced");
+              }
+              continue;
+            }
+
+            auto it = file_watches.find(ie->wd);
+            if (it == file_watches.end()) continue;
+            size_t i = it->second;
+            auto& f  = files[i];
+            if (ie->mask & (IN_MODIFY | IN_ATTRIB)) drain(i, f);
+
+            bool gone = ie->mask & (IN_MOVE_SELF | IN_DELETE_SELF);
+            if (by_name && (ie->mask & IN_ATTRIB)) {
+              struct stat st;
+              gone |= fstat(f.fd, &st) == 0 && st.st_nlink == 0;
+            }
+            if (by_name && gone) {
+              drain(i, f);
+              inotify_rm_watch(inotify_fd, f.wd);
+              file_watches.erase(f.wd);
+              close(f.fd);
+              f.fd = -1;
+              f.wd = -1;
+              out.flush();
+              std::cerr << fmt::format(
+                "{}: '{}' has become inaccessible\n", argv0, f.name);
+              // a rotated log usually already has its replacement in place
+              reopen(i, "has appeared");
+            }
+            if (ie->mask & IN_IGNORED) file_watches.erase(ie->wd);
+          }
+        }
+      }
+      out.flush();
+    }
+  }
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  tailer t(config, argv[0]);
+  try {
+    t.run();
+    t.out.flush();
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.what());
+    return 1;
+  }
+  return t.status;
+}
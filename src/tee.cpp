@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {} [OPTIONS...] [FILES...]
+
+Copies standard input to standard output and to each FILE.
+
+Options:
+  -a      append to the FILEs instead of overwriting them
+  -i      ignore interrupt signals
+  -p      keep going when an output pipe is closed, and do not report it;
+          other write errors are still reported
+
+  --help  print this help page and exit
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string> paths;
+
+  bool append : 1           = false;
+  bool ignore_interrupt : 1 = false;
+  bool pipe_warn : 1        = false;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-a", 0>([&] { data.append = true; }),
+    option<"-i", 0>([&] { data.ignore_interrupt = true; }),
+    option<"-p", 0>([&] { data.pipe_warn = true; }),
+    pos_arg([&](std::string_view arg) { data.paths.emplace_back(arg); }));
+  opts.parse(argc, argv);
+  return data;
+}
+
+namespace {
+  // the most a round moves, and the pipe size asked for
+  constexpr size_t chunk_size = 1024 * 1024;
+  // the userspace buffer
+  constexpr size_t buffer_size = 128 * 1024;
+
+  struct output {
+    std::string name;
+    int fd = -1;
+    // a pipe of our own that the input is duplicated into, or -1
+    int pipe_read  = -1;
+    int pipe_write = -1;
+    bool is_pipe : 1    = false;
+    bool alive : 1      = true;
+    bool can_splice : 1 = true;
+  };
+
+  class teer {
+  public:
+    teer(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0) {}
+
+    void open_outputs() {
+      outputs.push_back({"standard output", STDOUT_FILENO});
+      int flags = O_WRONLY | O_CREAT | O_CLOEXEC |
+        (config.append ? O_APPEND : O_TRUNC);
+      for (auto& path : config.paths) {
+        int fd = open(path.c_str(), flags, 0666);
+        if (fd < 0) {
+          report(path, errno);
+          continue;
+        }
+        outputs.push_back({path, fd});
+      }
+      for (auto& out : outputs) {
+        struct stat st;
+        out.is_pipe = fstat(out.fd, &st) == 0 && S_ISFIFO(st.st_mode);
+      }
+    }
+
+    void run() {
+      struct stat st;
+      if (fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode) &&
+          set_up_pipes()) {
+        if (run_spliced()) return;
+      }
+      run_buffered();
+    }
+
+    int status = 0;
+
+  private:
+    void report(std::string_view what, int err) {
+      std::cerr << fmt::format("{}: {}: {}\n", argv0, what, std::strerror(err));
+      status = 1;
+    }
+
+    // Takes an output out of the fan-out after a failed write. With -p, a
+    // closed pipe is not an error worth reporting.
+    void drop(output& out, int err) {
+      out.alive = false;
+      if (!(config.pipe_warn && err == EPIPE && out.is_pipe))
+        report(out.name, err);
+    }
+
+    size_t live_outputs() const {
+      return size_t(std::count_if(
+        outputs.begin(), outputs.end(), [](auto& o) { return o.alive; }));
+    }
+
+    static bool write_full(int fd, const char* data, size_t size, int& err) {
+      while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          err = errno;
+          return false;
+        }
+        data += n;
+        size -= size_t(n);
+      }
+      return true;
+    }
+
+    // Gives every output but the first a pipe of its own, at least as large
+    // as the input pipe, so that whatever is in the input always fits.
+    bool set_up_pipes() {
+      fcntl(STDIN_FILENO, F_SETPIPE_SZ, int(chunk_size));
+      int in_size = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+      if (in_size < 0) return false;
+      for (size_t i = 1; i < outputs.size(); ++i) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) return false;
+        outputs[i].pipe_read  = fds[0];
+        outputs[i].pipe_write = fds[1];
+        if (fcntl(fds[1], F_SETPIPE_SZ, in_size) < in_size) return false;
+      }
+      return true;
+    }
+
+    // The kernel path. Each round duplicates what is in the input pipe into
+    // every output's own pipe with tee(2), splices the input itself to
+    // standard output, and then splices each output's pipe to the output.
+    // Pages are passed around by reference; none of the data is copied into
+    // this process. Outputs that cannot take a splice (some devices, or
+    // files opened for appending on older kernels) are written from a
+    // buffer instead. Returns false if tee(2) is not available at all, in
+    // which case nothing has been read yet.
+    bool run_spliced() {
+      bool first_round = true;
+      while (live_outputs() > 0) {
+        // duplicate into the first live output's pipe, which also waits for
+        // data and decides how much this round moves
+        size_t n = 0;
+        bool got = false;
+        for (size_t i = 1; i < outputs.size(); ++i) {
+          auto& out = outputs[i];
+          if (!out.alive) continue;
+          ssize_t res;
+          do {
+            res = tee(STDIN_FILENO, out.pipe_write, got ? n : chunk_size, 0);
+          } while (res < 0 && errno == EINTR);
+
+          if (!got) {
+            if (res < 0 && first_round && (errno == EINVAL || errno == ENOSYS))
+              return false;
+            if (res < 0) report("standard input", errno);
+            if (res <= 0) return true;
+            n   = size_t(res);
+            got = true;
+          }
+          // the pipe is empty and as large as the input, so this cannot
+          // fall short
+          else if (res != ssize_t(n)) {
+            report("standard input", res < 0 ? errno : EIO);
+            return true;
+          }
+        }
+        first_round = false;
+
+        // then consume the input, straight into standard output
+        if (!consume(outputs[0], n, got)) return true;
+        for (size_t i = 1; i < outputs.size(); ++i) {
+          if (outputs[i].alive) drain(outputs[i], n);
+        }
+      }
+      return true;
+    }
+
+    // Moves n bytes (or, if n is not known yet, whatever arrives) out of the
+    // input into out. Returns false at the end of the input.
+    bool consume(output& out, size_t& n, bool known) {
+      size_t left = known ? n : chunk_size;
+      while (left > 0) {
+        ssize_t res = -1;
+        if (out.alive && out.can_splice) {
+          res = splice(
+            STDIN_FILENO, nullptr, out.fd, nullptr, left, SPLICE_F_MOVE);
+          if (res < 0 && errno == EINVAL) {
+            out.can_splice = false;
+            continue;
+          }
+          if (res < 0 && errno != EINTR) {
+            drop(out, errno);
+            continue;
+          }
+        }
+        else {
+          // through the buffer, which also throws away data for an output
+          // that has gone away
+          if (!buffer) buffer.reset(new char[buffer_size]);
+          res = read(STDIN_FILENO, buffer.get(), std::min(left, buffer_size));
+          int err;
+          if (res > 0 && out.alive &&
+              !write_full(out.fd, buffer.get(), size_t(res), err))
+            drop(out, err);
+        }
+        if (res < 0) {
+          if (errno == EINTR) continue;
+          report("standard input", errno);
+          return false;
+        }
+        if (res == 0) return known;
+        left -= size_t(res);
+        if (!known) {
+          n = size_t(res);
+          return true;
+        }
+      }
+      return true;
+    }
+
+    // Empties an output's own pipe (n bytes) into the output.
+    void drain(output& out, size_t n) {
+      while (n > 0) {
+        ssize_t res;
+        if (out.alive && out.can_splice) {
+          res = splice(
+            out.pipe_read, nullptr, out.fd, nullptr, n, SPLICE_F_MOVE);
+          if (res < 0 && errno == EINVAL) {
+            out.can_splice = false;
+            continue;
+          }
+        }
+        else {
+          if (!buffer) buffer.reset(new char[buffer_size]);
+          res = read(out.pipe_read, buffer.get(), std::min(n, buffer_size));
+          int err;
+          if (res > 0 && out.alive &&
+              !write_full(out.fd, buffer.get(), size_t(res), err)) {
+            drop(out, err);
+          }
+        }
+        if (res < 0) {
+          if (errno == EINTR) continue;
+          // keep emptying the pipe, so it has room for the next round
+          drop(out, errno);
+          continue;
+        }
+        if (res == 0) break;
+        n -= size_t(res);
+      }
+    }
+
+    // The fallback: one read buffer, written out to every output in turn.
+    void run_buffered() {
+      if (!buffer) buffer.reset(new char[buffer_size]);
+      while (live_outputs() > 0) {
+        ssize_t n = read(STDIN_FILENO, buffer.get(), buffer_size);
+        if (n < 0) {
+          if (errno == EINTR) continue;
+          report("standard input", errno);
+          return;
+        }
+        if (n == 0) return;
+        for (auto& out : outputs) {
+          int err;
+          if (out.alive && !write_full(out.fd, buffer.get(), size_t(n), err))
+            drop(out, err);
+        }
+      }
+    }
+
+    const option_data& config;
+    const char* argv0;
+    std::vector<output> outputs;
+    std::unique_ptr<char[]> buffer;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  if (config.ignore_interrupt) signal(SIGINT, SIG_IGN);
+  if (config.pipe_warn) signal(SIGPIPE, SIG_IGN);
+
+  teer t(config, argv[0]);
+  t.open_outputs();
+  t.run();
+  return t.status;
+}
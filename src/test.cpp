@@ -4,6 +4,7 @@
 #include <filesystem>
 #include <iostream>
 #include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -13,6 +14,7 @@
 
 #include <fmt/core.h>
 
+#include "details/args.hpp"
 #include "details/demangle.hpp"
 #include "details/parse_error.hpp"
 #include "details/test_helpers.hpp"
@@ -25,7 +27,7 @@ using namespace std::string_view_literals;
   #define COREUTILS_IS_LBRACKET false
 #endif
 
-using args_t = std::vector<std::string>;
+using args_t = std::span<const std::string_view>;
 
 void print_exception(const std::exception& e, size_t n = 0) {
   std::cerr << fmt::format(
@@ -140,15 +142,16 @@ int main(int argc, char* argv[]) {
   });
 
   const args_t args = [argc, argv] {
-    if (argc > 1) {
+    auto all = coreutils::arg_view(argc, argv);
+    if (all.size() > 1) {
       if constexpr (COREUTILS_IS_LBRACKET) {
-        if (std::string_view(argv[argc - 1]) != "]"sv) {
+        if (all.back() != "]"sv) {
           throw coreutils::parse_error("Last argument of [ must be ]");
         }
-        return args_t(argv + 1, argv + (argc - 1));
+        return all.subspan(1, all.size() - 2);
       }
       else {
-        return args_t(argv + 1, argv + argc);
+        return all.subspan(1);
       }
     }
     else {
@@ -0,0 +1,366 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/escapes.hpp"
+#include "details/raw_write.hpp"
+#include "details/translate.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] SET1 [SET2]
+   or: {0} --help
+Copies standard input to standard output, translating, squeezing and/or
+deleting characters.
+
+Options:
+  -c, -C  use the complement of SET1
+  -d      delete characters in SET1 instead of translating them
+  -s      replace each run of a character in the last SET given with a
+          single occurrence of it
+  -t      truncate SET1 to the length of SET2 first
+
+  --help  print this help page and exit
+
+SETs are strings of characters. These stand for other characters:
+  \NNN        the byte with octal value NNN (1 to 3 digits)
+  \\ \a \b \e \f \n \r \t \v
+              the same escapes as echo -e
+  CHAR1-CHAR2 all characters from CHAR1 to CHAR2, in ascending order
+  [CHAR*]     in SET2, copies of CHAR until SET2 is as long as SET1
+  [CHAR*N]    N copies of CHAR (octal if N starts with 0)
+  [:CLASS:]   all characters in CLASS, one of: alnum, alpha, blank, cntrl,
+              digit, graph, lower, print, punct, space, upper, xdigit
+  [=CHAR=]    CHAR itself
+
+Translation replaces each character in SET1 with the one at the same position
+in SET2; if SET2 is shorter, its last character is repeated.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::vector<std::string_view> sets;
+
+  bool complement : 1 = false;
+  bool remove : 1     = false;
+  bool squeeze : 1    = false;
+  bool truncate : 1   = false;
+};
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-c", 0>([&] { data.complement = true; }),
+    option<"-C", 0>([&] { data.complement = true; }),
+    option<"-d", 0>([&] { data.remove = true; }),
+    option<"-s", 0>([&] { data.squeeze = true; }),
+    option<"-t", 0>([&] { data.truncate = true; }),
+    pos_arg([&](std::string_view arg) { data.sets.push_back(arg); }));
+  opts.parse(argc, argv);
+  return data;
+}
+
+namespace {
+  // read size; large enough that the per-call overhead of the kernels and of
+  // read/write disappears
+  constexpr size_t buffer_size = 256 * 1024;
+
+  class set_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  // A SET operand, expanded to the list of bytes it stands for.
+  struct char_set {
+    std::string chars;
+    // position of a [c*] fill in SET2, and its character
+    std::optional<size_t> fill_pos;
+    char fill_char = '\0';
+    // classes other than upper and lower can't be translated to
+    bool has_other_class = false;
+  };
+
+  bool class_has(std::string_view name, int c) {
+    if (name == "alnum") return std::isalnum(c);
+    if (name == "alpha") return std::isalpha(c);
+    if (name == "blank") return std::isblank(c);
+    if (name == "cntrl") return std::iscntrl(c);
+    if (name == "digit") return std::isdigit(c);
+    if (name == "graph") return std::isgraph(c);
+    if (name == "lower") return std::islower(c);
+    if (name == "print") return std::isprint(c);
+    if (name == "punct") return std::ispunct(c);
+    if (name == "space") return std::isspace(c);
+    if (name == "upper") return std::isupper(c);
+    if (name == "xdigit") return std::isxdigit(c);
+    throw set_error(fmt::format("invalid character class '{}'", name));
+  }
+
+  // A byte as it would be written in a SET, for error messages.
+  std::string show(uint8_t c) {
+    if (std::isprint(c)) return std::string(1, char(c));
+    return fmt::format("\\{:03o}", c);
+  }
+
+  // Reads one character of a SET at pos, decoding backslash escapes with the
+  // same letters as echo -e, plus tr's \NNN octal form.
+  uint8_t next_char(std::string_view spec, size_t& pos) {
+    char c = spec[pos++];
+    if (c != '\\' || pos == spec.size()) return uint8_t(c);
+
+    char next = spec[pos];
+    if (coreutils::is_octal_digit(next)) {
+      unsigned val = 0;
+      for (int i = 0; i < 3 && pos < spec.size() &&
+           coreutils::is_octal_digit(spec[pos]);
+           ++i) {
+        unsigned digit = unsigned(spec[pos] - '0');
+        if (val * 8 + digit > 0377) break;
+        val = val * 8 + digit;
+        ++pos;
+      }
+      return uint8_t(val);
+    }
+    ++pos;
+    int letter = coreutils::unescape_letter(next);
+    return uint8_t(letter >= 0 ? letter : next);
+  }
+
+  // Parses a [c*n] or [c*] at pos (just after the '['). Returns false if it
+  // isn't one, leaving pos alone.
+  bool parse_repeat(std::string_view spec, size_t& pos, char_set& set) {
+    size_t at = pos;
+    if (at >= spec.size()) return false;
+    uint8_t c = next_char(spec, at);
+    if (at >= spec.size() || spec[at] != '*') return false;
+    size_t close = spec.find(']', at + 1);
+    if (close == std::string_view::npos) return false;
+
+    std::string_view digits = spec.substr(at + 1, close - at - 1);
+    auto invalid            = [&] {
+      return set_error(fmt::format(
+        "invalid repeat count '{}' in [c*n] construct", digits));
+    };
+    int base     = !digits.empty() && digits[0] == '0' ? 8 : 10;
+    size_t count = 0;
+    for (char d : digits) {
+      if (d < '0' || d >= '0' + base) throw invalid();
+      count = count * size_t(base) + size_t(d - '0');
+      if (count > (size_t(1) << 24)) throw invalid();
+    }
+
+    // [c*] and [c*0] fill up SET2
+    if (count == 0) {
+      if (set.fill_pos) {
+        throw set_error(
+          "only one [c*] repeat construct may appear in string2");
+      }
+      set.fill_pos  = set.chars.size();
+      set.fill_char = char(c);
+    }
+    else {
+      set.chars.append(count, char(c));
+    }
+    pos = close + 1;
+    return true;
+  }
+
+  char_set parse_set(std::string_view spec, bool is_set2) {
+    char_set set;
+    size_t pos = 0;
+    while (pos < spec.size()) {
+      if (spec[pos] == '[' && pos + 1 < spec.size()) {
+        char kind = spec[pos + 1];
+        if (kind == ':' || kind == '=') {
+          char close[] = {kind, ']', '\0'};
+          size_t end   = spec.find(close, pos + 2);
+          if (end != std::string_view::npos) {
+            std::string_view inner = spec.substr(pos + 2, end - pos - 2);
+            if (kind == ':') {
+              for (int c = 0; c < 256; ++c) {
+                if (class_has(inner, c)) set.chars.push_back(char(c));
+              }
+              set.has_other_class |= inner != "upper" && inner != "lower";
+            }
+            else {
+              size_t at = 0;
+              if (inner.empty())
+                throw set_error("missing equivalence class character '[==]'");
+              uint8_t c = next_char(inner, at);
+              if (at != inner.size()) {
+                throw set_error(fmt::format(
+                  "{}: equivalence class operand must be a single character",
+                  inner));
+              }
+              set.chars.push_back(char(c));
+            }
+            pos = end + 2;
+            continue;
+          }
+        }
+        size_t at = pos + 1;
+        if (parse_repeat(spec, at, set)) {
+          if (!is_set2) {
+            throw set_error(
+              "the [c*] repeat construct may not appear in string1");
+          }
+          pos = at;
+          continue;
+        }
+      }
+
+      uint8_t lo = next_char(spec, pos);
+      if (pos + 1 < spec.size() && spec[pos] == '-') {
+        ++pos;
+        uint8_t hi = next_char(spec, pos);
+        if (hi < lo) {
+          throw set_error(fmt::format(
+            "range-endpoints of '{}-{}' are in reverse collating sequence "
+            "order",
+            show(lo), show(hi)));
+        }
+        for (unsigned c = lo; c <= hi; ++c)
+          set.chars.push_back(char(c));
+        continue;
+      }
+      set.chars.push_back(char(lo));
+    }
+    return set;
+  }
+
+  coreutils::byte_set make_byte_set(std::string_view chars) {
+    coreutils::byte_set res {};
+    for (char c : chars)
+      res[uint8_t(c)] = true;
+    return res;
+  }
+
+  std::string complement(std::string_view chars) {
+    auto in = make_byte_set(chars);
+    std::string res;
+    for (unsigned c = 0; c < 256; ++c) {
+      if (!in[c]) res.push_back(char(c));
+    }
+    return res;
+  }
+
+  // Builds the byte_map for translating set1 to set2.
+  coreutils::byte_map make_map(
+    std::string& set1, char_set& set2, bool truncate) {
+    if (set2.fill_pos) {
+      size_t have = set2.chars.size();
+      size_t fill = set1.size() > have ? set1.size() - have : 0;
+      set2.chars.insert(*set2.fill_pos, fill, set2.fill_char);
+    }
+    if (truncate && set1.size() > set2.chars.size())
+      set1.resize(set2.chars.size());
+    if (set2.chars.empty() && !set1.empty())
+      throw set_error("when not truncating set1, string2 must be non-empty");
+    if (set2.has_other_class) {
+      throw set_error(
+        "when translating, the only character classes that may appear in "
+        "string2 are 'upper' and 'lower'");
+    }
+
+    coreutils::byte_map map;
+    for (unsigned c = 0; c < 256; ++c)
+      map[c] = uint8_t(c);
+    for (size_t i = 0; i < set1.size(); ++i) {
+      char to = i < set2.chars.size() ? set2.chars[i] : set2.chars.back();
+      map[uint8_t(set1[i])] = uint8_t(to);
+    }
+    return map;
+  }
+
+  struct free_deleter {
+    void operator()(char* p) const { std::free(p); }
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  auto fail   = [&](std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], msg);
+    return 1;
+  };
+
+  const auto& sets = config.sets;
+  bool translate   = !config.remove && sets.size() == 2;
+  if (sets.empty()) return fail("missing operand");
+  if (config.remove && config.squeeze && sets.size() < 2)
+    return fail(fmt::format("missing operand after '{}'", sets[0]));
+  if (!config.remove && !config.squeeze && sets.size() < 2)
+    return fail(fmt::format("missing operand after '{}'", sets[0]));
+  if (sets.size() > 2 || (config.remove && !config.squeeze && sets.size() > 1))
+    return fail(fmt::format("extra operand '{}'", sets.back()));
+
+  std::optional<coreutils::byte_translator> translator;
+  std::optional<coreutils::byte_filter> remover, squeezer;
+  try {
+    std::string set1 = parse_set(sets[0], false).chars;
+    if (config.complement) set1 = complement(set1);
+
+    if (translate) {
+      auto set2 = parse_set(sets[1], true);
+      translator.emplace(make_map(set1, set2, config.truncate));
+      if (config.squeeze) squeezer.emplace(make_byte_set(set2.chars));
+    }
+    else {
+      if (config.remove) remover.emplace(make_byte_set(set1));
+      if (config.squeeze) {
+        std::string squeeze_set =
+          sets.size() == 2 ? parse_set(sets[1], true).chars : set1;
+        squeezer.emplace(make_byte_set(squeeze_set));
+      }
+    }
+  }
+  catch (const set_error& e) {
+    return fail(e.what());
+  }
+
+  std::unique_ptr<char, free_deleter> buffer(
+    static_cast<char*>(std::aligned_alloc(64, buffer_size)));
+  if (!buffer) return fail(std::strerror(ENOMEM));
+
+  int last = -1;
+  for (;;) {
+    ssize_t len = read(STDIN_FILENO, buffer.get(), buffer_size);
+    if (len < 0) {
+      if (errno == EINTR) continue;
+      return fail(fmt::format("read error: {}", std::strerror(errno)));
+    }
+    if (len == 0) break;
+
+    size_t n = size_t(len);
+    if (translator) translator->apply(buffer.get(), n);
+    if (remover) n = remover->remove(buffer.get(), n);
+    if (squeezer) n = squeezer->squeeze(buffer.get(), n, last);
+    if (!coreutils::write_all(STDOUT_FILENO, {{buffer.get(), n}}))
+      return fail(fmt::format("write error: {}", std::strerror(errno)));
+  }
+  return 0;
+}
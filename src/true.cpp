@@ -1,13 +1,14 @@
 #include <cstdlib>
-#include <iostream>
 #include <string_view>
 
-#include <fmt/core.h>
+#include <unistd.h>
+
+#include "details/raw_write.hpp"
 
 using namespace std::string_view_literals;
 
-void usage(std::string_view argv0) {
-  std::cout << fmt::format(R"msg(
+void usage() {
+  coreutils::write_all(STDOUT_FILENO, {R"msg(
 usage: true [ignored]...
    or: true --help
 Returns with an exit code indicating success.
@@ -17,12 +18,12 @@ Options:
   
 NOTE: Some shells have true as a builtin command, which will likely override 
 this one. Please check your shell's manual for information on its version.
-)msg"sv.substr(1), argv0);
+)msg"sv.substr(1)});
 }
 
 int main(int argc, char* argv[]) {
   if (argc == 2 && std::string_view(argv[1]) == "--help") {
-    usage(argv[0]);
+    usage();
   }
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,271 @@
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/output_buffer.hpp"
+#include "details/split.hpp"
+
+void usage(std::string_view argv0) {
+  using namespace std::string_view_literals;
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {0} [OPTIONS...] [INPUT [OUTPUT]]
+   or: {0} --help
+Writes INPUT to OUTPUT, merging each run of adjacent matching lines into its
+first line. With no INPUT, or when INPUT is -, reads standard input; with no
+OUTPUT, writes to standard output.
+
+Options:
+  -c        prefix each line with the number of lines it stands for
+  -d        only write lines that were repeated, once for each run
+  -D        write every line of each repeated run
+  -u        only write lines that were not repeated
+  -f N      ignore the first N fields of each line when comparing
+  -s N      ignore the first N characters (after any fields) when comparing
+  -w N      compare at most N characters
+  -i        compare case-insensitively
+  -z        lines end with NUL, not newline
+
+  --help    print this help page and exit
+
+A field is a run of blanks followed by a run of other characters.
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  std::string input  = "-";
+  std::string output = "-";
+  size_t operands    = 0;
+
+  size_t skip_fields = 0;
+  size_t skip_chars  = 0;
+  size_t max_chars   = SIZE_MAX;
+
+  bool count : 1           = false;
+  bool repeated : 1        = false;
+  bool all_repeated : 1    = false;
+  bool unique : 1          = false;
+  bool ignore_case : 1     = false;
+  bool zero_terminated : 1 = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+
+  size_t parse_count(
+    const char* argv0, std::string_view what, std::string_view str) {
+    size_t value = 0;
+    auto [ptr, ec] =
+      std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec == std::errc::result_out_of_range) return SIZE_MAX;
+    if (ec != std::errc {} || ptr != str.data() + str.size())
+      fail(argv0, fmt::format("invalid number of {}: '{}'", what, str));
+    return value;
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-c", 0>([&] { data.count = true; }),
+    option<"-d", 0>([&] { data.repeated = true; }),
+    option<"-D", 0>([&] { data.all_repeated = true; }),
+    option<"-u", 0>([&] { data.unique = true; }),
+    option<"-i", 0>([&] { data.ignore_case = true; }),
+    option<"-z", 0>([&] { data.zero_terminated = true; }),
+    option<"-f", 1>([&](std::string_view arg) {
+      data.skip_fields = parse_count(argv[0], "fields to skip", arg);
+    }),
+    option<"-s", 1>([&](std::string_view arg) {
+      data.skip_chars = parse_count(argv[0], "bytes to skip", arg);
+    }),
+    option<"-w", 1>([&](std::string_view arg) {
+      data.max_chars = parse_count(argv[0], "bytes to compare", arg);
+    }),
+    pos_arg([&](std::string_view arg) {
+      switch (data.operands++) {
+        case 0: data.input = arg; break;
+        case 1: data.output = arg; break;
+        default: fail(argv[0], fmt::format("extra operand '{}'", arg));
+      }
+    }));
+  opts.parse(argc, argv);
+
+  if (data.count && data.all_repeated) {
+    fail(
+      argv[0],
+      "printing all duplicated lines and repeat counts is meaningless");
+  }
+  return data;
+}
+
+namespace {
+  class uniq {
+  public:
+    uniq(const option_data& config, int out_fd) :
+      config(config),
+      terminator(config.zero_terminated ? '\0' : '\n'),
+      out(out_fd) {}
+
+    void run(int fd) {
+      coreutils::line_reader lines(fd, terminator);
+      std::string_view line;
+      while (lines.next(line)) {
+        auto key      = key_of(line);
+        uint64_t hash = hash_key(key);
+        if (count > 0 && hash == group_hash && same_key(key, group_key)) {
+          // the reader only keeps one line back, so keep the group's first
+          // line around once it has something to be compared with
+          if (++count == 2) {
+            held.assign(group);
+            group     = held;
+            group_key = key_of(group);
+            if (config.all_repeated) write_line(group, 0);
+          }
+          if (config.all_repeated) write_line(line, 0);
+          continue;
+        }
+        end_group();
+        group      = line;
+        group_key  = key;
+        group_hash = hash;
+        count      = 1;
+      }
+      end_group();
+      out.flush();
+    }
+
+  private:
+    std::string_view key_of(std::string_view line) const {
+      auto is_blank = [](char c) { return c == ' ' || c == '\t'; };
+      size_t pos = 0;
+      for (size_t i = 0; i < config.skip_fields && pos < line.size(); ++i) {
+        while (pos < line.size() && is_blank(line[pos]))
+          ++pos;
+        while (pos < line.size() && !is_blank(line[pos]))
+          ++pos;
+      }
+      pos += std::min(config.skip_chars, line.size() - pos);
+      return line.substr(pos, config.max_chars);
+    }
+
+    // Different lengths never match, so the length is mixed in first; the
+    // hash is only a cheap filter before the byte comparison.
+    uint64_t hash_key(std::string_view key) const {
+      const char* ptr = key.data();
+      size_t size     = key.size();
+      uint64_t hash   = size * 0x9E3779B97F4A7C15;
+      size_t i        = 0;
+      if (!config.ignore_case) {
+        for (; i + 8 <= size; i += 8) {
+          uint64_t word;
+          std::memcpy(&word, ptr + i, 8);
+          hash = (hash ^ word) * 0xFF51AFD7ED558CCD;
+          hash ^= hash >> 32;
+        }
+      }
+      for (; i < size; ++i) {
+        auto c = static_cast<unsigned char>(ptr[i]);
+        if (config.ignore_case) c = std::tolower(c);
+        hash = (hash ^ c) * 0x100000001B3;
+      }
+      return hash;
+    }
+
+    bool same_key(std::string_view a, std::string_view b) const {
+      if (a.size() != b.size()) return false;
+      if (!config.ignore_case)
+        return std::memcmp(a.data(), b.data(), a.size()) == 0;
+      for (size_t i = 0; i < a.size(); ++i) {
+        if (
+          std::tolower(static_cast<unsigned char>(a[i])) !=
+          std::tolower(static_cast<unsigned char>(b[i])))
+          return false;
+      }
+      return true;
+    }
+
+    void write_line(std::string_view line, size_t count) {
+      if (config.count) out.format("{:7} ", count);
+      out.write(line);
+      out.put(terminator);
+    }
+
+    void end_group() {
+      if (count == 0 || config.all_repeated) return;
+      bool repeated = count > 1;
+      if (repeated ? !config.unique : !config.repeated)
+        write_line(group, count);
+      count = 0;
+    }
+
+    const option_data& config;
+    char terminator;
+    coreutils::output_buffer out;
+
+    // the first line of the current run of matching lines
+    std::string_view group;
+    std::string_view group_key;
+    uint64_t group_hash = 0;
+    size_t count        = 0;
+    std::string held;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+
+  int in_fd = STDIN_FILENO;
+  if (config.input != "-") {
+    in_fd = open(config.input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+      std::cerr << fmt::format(
+        "{}: {}: {}\n", argv[0], config.input, std::strerror(errno));
+      return 1;
+    }
+  }
+  int out_fd = STDOUT_FILENO;
+  if (config.output != "-") {
+    out_fd = open(
+      config.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out_fd < 0) {
+      std::cerr << fmt::format(
+        "{}: {}: {}\n", argv[0], config.output, std::strerror(errno));
+      return 1;
+    }
+  }
+
+  try {
+    uniq(config, out_fd).run(in_fd);
+  }
+  catch (const std::system_error& e) {
+    std::cerr << fmt::format("{}: {}\n", argv[0], e.code().message());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,803 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <mtap/mtap.hpp>
+
+#include "details/echo.hpp"
+#include "details/parse_error.hpp"
+#include "details/raw_write.hpp"
+#include "details/test_helpers.hpp"
+
+using namespace std::string_view_literals;
+
+extern char** environ;
+
+void usage(std::string_view argv0) {
+  fmt::format_to(
+    std::ostreambuf_iterator(std::cout), R"msg(
+usage: {} [OPTIONS...] [COMMAND [INITIAL-ARGS...]]
+
+Runs COMMAND (echo by default) with INITIAL-ARGS followed by as many items
+read from standard input as fit on a command line. Items are separated by
+blanks and newlines; quotes and backslashes protect them.
+
+Options:
+  -0            items are separated by NUL characters, and quotes and
+                backslashes are not special
+  -I R          run COMMAND once per input line, replacing R in
+                INITIAL-ARGS with the line
+  -L N          use at most N input lines per command line
+  -n N          use at most N items per command line
+  -P N          run up to N commands at a time (0: as many as possible)
+  -r            do not run COMMAND if the input is empty
+  -s N          use at most N characters per command line
+  -t            print each command line to standard error before running it
+  --in-process  run this project's echo, test and [ inside xargs instead of
+                starting a process for each command line
+
+  --help        print this help page and exit
+
+Exit status:
+  0    all commands succeeded
+  123  a command exited with a status from 1 to 125
+  124  a command exited with status 255
+  125  a command was killed by a signal
+  126  COMMAND could not be run
+  127  COMMAND was not found
+  1    any other error
+)msg"sv.substr(1),
+    argv0);
+}
+
+struct option_data {
+  // COMMAND and INITIAL-ARGS; views over argv, so NUL-terminated
+  std::vector<std::string_view> command;
+  std::string_view replace;
+  size_t max_args  = 0;
+  size_t max_lines = 0;
+  size_t max_chars = 0;
+  size_t max_procs = 1;
+
+  bool null_separated : 1  = false;
+  bool replace_mode : 1    = false;
+  bool no_run_if_empty : 1 = false;
+  bool trace : 1           = false;
+  bool in_process : 1      = false;
+};
+
+namespace {
+  [[noreturn]] void fail(const char* argv0, std::string_view msg) {
+    std::cerr << fmt::format("{}: {}\n", argv0, msg);
+    exit(1);
+  }
+
+  size_t parse_count(
+    const char* argv0, std::string_view arg, std::string_view opt,
+    size_t min) {
+    size_t res = 0;
+    auto [end, ec] = std::from_chars(arg.data(), arg.data() + arg.size(), res);
+    if (ec != std::errc() || end != arg.data() + arg.size() || res < min)
+      fail(argv0, fmt::format("invalid number '{}' for {} option", arg, opt));
+    return res;
+  }
+}  // namespace
+
+option_data parse_options(const int argc, const char** argv) {
+  using mtap::option, mtap::pos_arg;
+  option_data data;
+
+  // Options end at COMMAND, whose own options must not be parsed here, so
+  // the command is split off first. Values may be attached (-n2, -I{}); the
+  // rest of such an argument still ends where argv does.
+  std::vector<const char*> args {argv[0]};
+  int i = 1;
+  for (; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--"sv) {
+      ++i;
+      break;
+    }
+    if (arg.size() < 2 || arg[0] != '-') break;
+    bool takes_value = arg.size() >= 2 && arg.substr(0, 2) != "--"sv &&
+      std::string_view("ILnPs").find(arg[1]) != std::string_view::npos;
+    if (takes_value && arg.size() > 2) {
+      static const char* const names[] = {"-I", "-L", "-n", "-P", "-s"};
+      args.push_back(names[std::string_view("ILnPs").find(arg[1])]);
+      args.push_back(argv[i] + 2);
+      continue;
+    }
+    args.push_back(argv[i]);
+    if (takes_value && i + 1 < argc) args.push_back(argv[++i]);
+  }
+  for (; i < argc; ++i)
+    data.command.emplace_back(argv[i]);
+
+  mtap::parser opts(
+    option<"--help", 0>([&] {
+      usage(argv[0]);
+      exit(0);
+    }),
+    option<"-0", 0>([&] { data.null_separated = true; }),
+    option<"-I", 1>([&](std::string_view arg) {
+      data.replace      = arg;
+      data.replace_mode = true;
+      data.max_args     = 0;
+      data.max_lines    = 1;
+    }),
+    option<"-L", 1>([&](std::string_view arg) {
+      data.max_lines    = parse_count(argv[0], arg, "-L", 1);
+      data.max_args     = 0;
+      data.replace_mode = false;
+    }),
+    option<"-n", 1>([&](std::string_view arg) {
+      data.max_args     = parse_count(argv[0], arg, "-n", 1);
+      data.max_lines    = 0;
+      data.replace_mode = false;
+    }),
+    option<"-P", 1>([&](std::string_view arg) {
+      data.max_procs = parse_count(argv[0], arg, "-P", 0);
+    }),
+    option<"-r", 0>([&] { data.no_run_if_empty = true; }),
+    option<"-s", 1>([&](std::string_view arg) {
+      data.max_chars = parse_count(argv[0], arg, "-s", 1);
+    }),
+    option<"-t", 0>([&] { data.trace = true; }),
+    option<"--in-process", 0>([&] { data.in_process = true; }),
+    pos_arg([&](std::string_view arg) {
+      fail(argv[0], fmt::format("unexpected argument '{}'", arg));
+    }));
+  opts.parse(int(args.size()), args.data());
+
+  if (data.replace_mode && data.replace.empty())
+    fail(argv[0], "the replacement string for -I may not be empty");
+  if (data.command.empty()) data.command.push_back("echo"sv);
+  if (data.max_procs == 0) data.max_procs = SIZE_MAX;
+  return data;
+}
+
+namespace {
+  constexpr size_t read_size = 64 * 1024;
+
+  // Splits standard input into items. Without -0, blanks and newlines
+  // separate items, quotes and backslashes protect them, and a line ending
+  // in a blank continues on the next one; with -I, only newlines separate.
+  class item_reader {
+  public:
+    item_reader(int fd, bool null_separated, bool whole_lines) :
+      fd(fd),
+      null_separated(null_separated),
+      whole_lines(whole_lines),
+      buffer(new char[read_size]) {}
+
+    // Reads the next item into item, and sets eol if it ends an input line.
+    // Returns false at the end of the input, or after an error (see error).
+    bool next(std::string& item, bool& eol) {
+      item.clear();
+      eol = false;
+      return null_separated ? next_terminated(item, eol) :
+                              next_delimited(item, eol);
+    }
+
+    // why reading stopped early, if it did
+    std::string_view error;
+
+  private:
+    bool fill() {
+      ssize_t n;
+      do {
+        n = read(fd, buffer.get(), read_size);
+      } while (n < 0 && errno == EINTR);
+      if (n < 0) error = std::strerror(errno);
+      pos = 0;
+      end = n > 0 ? size_t(n) : 0;
+      return end > 0;
+    }
+
+    int get() {
+      if (pos == end && !fill()) return -1;
+      return static_cast<unsigned char>(buffer[pos++]);
+    }
+
+    bool next_terminated(std::string& item, bool& eol) {
+      for (;;) {
+        if (pos == end && !fill()) {
+          eol = true;
+          return !item.empty();
+        }
+        const char* start = buffer.get() + pos;
+        auto nul =
+          static_cast<const char*>(std::memchr(start, '\0', end - pos));
+        if (!nul) {
+          item.append(start, end - pos);
+          pos = end;
+          continue;
+        }
+        item.append(start, size_t(nul - start));
+        pos += size_t(nul - start) + 1;
+        eol = true;
+        return true;
+      }
+    }
+
+    static bool is_blank(int c) { return c == ' ' || c == '\t'; }
+
+    bool next_delimited(std::string& item, bool& eol) {
+      at_item = false;
+      int c;
+      do
+        c = get();
+      while (is_blank(c) || c == '\n');
+
+      for (;; c = get()) {
+        switch (c) {
+          case -1:
+            eol = true;
+            return !item.empty() || at_item;
+          case '\n':
+            eol = true;
+            return true;
+          case ' ':
+          case '\t':
+            if (whole_lines) {
+              item.push_back(char(c));
+              break;
+            }
+            do
+              c = get();
+            while (is_blank(c));
+            // a newline after blanks continues the line
+            if (c < 0)
+              eol = true;
+            else if (c != '\n')
+              --pos;
+            return true;
+          case '\'':
+          case '"': {
+            int quote = c;
+            while ((c = get()) != quote) {
+              if (c < 0 || c == '\n') {
+                error = quote == '\'' ?
+                  "unmatched single quote; by default quotes are special to "
+                  "xargs unless you use the -0 option"sv :
+                  "unmatched double quote; by default quotes are special to "
+                  "xargs unless you use the -0 option"sv;
+                return false;
+              }
+              item.push_back(char(c));
+            }
+            // an empty quoted item is still an item
+            at_item = true;
+            break;
+          }
+          case '\\':
+            c = get();
+            if (c < 0) {
+              eol = true;
+              return true;
+            }
+            item.push_back(char(c));
+            break;
+          default:
+            item.push_back(char(c));
+        }
+      }
+    }
+
+    int fd;
+    bool null_separated;
+    bool whole_lines;
+    bool at_item = false;
+    std::unique_ptr<char[]> buffer;
+    size_t pos = 0;
+    size_t end = 0;
+  };
+
+  // Running children. With more than one job allowed, each child gets a
+  // pidfd registered with one epoll set, so waiting costs the same however
+  // many jobs are out, and every job that finished is reaped in one pass.
+  // Without pidfds (old kernels, or a single job at a time), children are
+  // reaped with a plain waitid().
+  class job_set {
+  public:
+    explicit job_set(size_t limit) : limit(limit), use_pidfd(limit > 1) {}
+    job_set(const job_set&) = delete;
+    ~job_set() {
+      for (auto [pid, fd] : pidfds)
+        close(fd);
+      if (epoll_fd >= 0) close(epoll_fd);
+    }
+
+    bool full() const { return running >= limit; }
+    size_t size() const { return running; }
+
+    void add(pid_t pid) {
+      ++running;
+      if (!use_pidfd) return;
+      if (epoll_fd < 0) epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+      int fd = epoll_fd >= 0 ? int(syscall(SYS_pidfd_open, pid, 0)) : -1;
+      epoll_event ev {};
+      ev.events   = EPOLLIN;
+      ev.data.u64 = uint64_t(uint32_t(pid)) << 32 | uint32_t(fd);
+      if (fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (fd >= 0) close(fd);
+        use_pidfd = false;
+        return;
+      }
+      pidfds.emplace(pid, fd);
+    }
+
+    // Waits until at least one job has finished, and calls done(info) for
+    // every job that has.
+    template <class F>
+    void reap(F&& done) {
+      if (running == 0) return;
+      siginfo_t info;
+      if (use_pidfd) {
+        epoll_event events[64];
+        int n;
+        do {
+          n = epoll_wait(epoll_fd, events, int(std::size(events)), -1);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) throw std::system_error(errno, std::system_category());
+        for (int i = 0; i < n; ++i) {
+          pid_t pid = pid_t(events[i].data.u64 >> 32);
+          int fd    = int(uint32_t(events[i].data.u64));
+          info      = {};
+          int res;
+          do {
+            res = waitid(P_PIDFD, id_t(fd), &info, WEXITED);
+          } while (res < 0 && errno == EINTR);
+          forget(pid, fd);
+          if (res == 0) done(info);
+        }
+        return;
+      }
+
+      info = {};
+      int res;
+      do {
+        res = waitid(P_ALL, 0, &info, WEXITED);
+      } while (res < 0 && errno == EINTR);
+      if (res < 0) {
+        running = 0;
+        return;
+      }
+      // reaped behind the back of its pidfd, from before the fallback
+      if (auto it = pidfds.find(info.si_pid); it != pidfds.end())
+        forget(it->first, it->second);
+      else
+        --running;
+      done(info);
+    }
+
+  private:
+    // posix_spawn can return before exec has closed the new child's copies
+    // of our (close-on-exec) pidfds, and a descriptor only leaves an epoll
+    // set once every copy is closed. So it is taken out explicitly;
+    // otherwise a later pidfd could reuse the number and have the stale
+    // entry reported for it.
+    void forget(pid_t pid, int fd) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+      close(fd);
+      pidfds.erase(pid);
+      --running;
+    }
+
+    size_t limit;
+    size_t running = 0;
+    bool use_pidfd;
+    int epoll_fd = -1;
+    std::unordered_map<pid_t, int> pidfds;
+  };
+
+  // characters that -t leaves unquoted
+  bool shell_safe(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+      (c >= '0' && c <= '9') ||
+      "%+,-./:=@_^"sv.find(c) != std::string_view::npos;
+  }
+
+  // Utilities of this project that --in-process runs without a new process.
+  enum class builtin { none, echo, test, lbracket };
+
+  builtin find_builtin(std::string_view name) {
+    if (name == "echo"sv) return builtin::echo;
+    if (name == "test"sv) return builtin::test;
+    if (name == "["sv) return builtin::lbracket;
+    return builtin::none;
+  }
+
+  class xargs {
+  public:
+    xargs(const option_data& config, const char* argv0) :
+      config(config), argv0(argv0), jobs(config.max_procs) {
+      for (auto arg : config.command)
+        argv.push_back(const_cast<char*>(arg.data()));
+      fixed = argv.size();
+      set_limits();
+
+      // posix_spawn returns only once the child has exec'd (glibc starts
+      // it with CLONE_VM | CLONE_VFORK), so the arguments are never copied
+      // into a forked address space, and the arena holding them can be
+      // reused as soon as it returns
+      arena_block.reset(new std::byte[arena_size]);
+      batch_memory.emplace(arena_block.get(), arena_size);
+      if (config.in_process) kind = find_builtin(config.command[0]);
+
+      posix_spawn_file_actions_init(&actions);
+      posix_spawn_file_actions_addopen(
+        &actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+
+    ~xargs() { posix_spawn_file_actions_destroy(&actions); }
+
+    int run() {
+      item_reader reader(
+        STDIN_FILENO, config.null_separated, config.replace_mode);
+      std::string item;
+      bool eol;
+      while (!stopped && reader.next(item, eol)) {
+        if (config.replace_mode)
+          run_replaced(item);
+        else
+          add(item, eol);
+      }
+      if (!reader.error.empty()) {
+        // what was read before the error still runs
+        if (!stopped && argv.size() > fixed) execute();
+        std::cerr << fmt::format("{}: {}\n", argv0, reader.error);
+        status = std::max(status, 1);
+      }
+      else if (!stopped && !config.replace_mode &&
+               (argv.size() > fixed || (!ran && !config.no_run_if_empty))) {
+        execute();
+      }
+      while (jobs.size() > 0)
+        jobs.reap([&](const siginfo_t& info) { finished(info); });
+      return status;
+    }
+
+  private:
+    // Kernel limits on a command line: the strings of argv and envp plus
+    // their pointers share ARG_MAX (which Linux derives from the stack
+    // limit), and no one string may exceed 32 pages. POSIX asks for 2048
+    // bytes of headroom on top.
+    void set_limits() {
+      long arg_max = sysconf(_SC_ARG_MAX);
+      size_t total = arg_max > 0 ? size_t(arg_max) : 128 * 1024;
+      // both arrays end in a null pointer
+      size_t env = 2 * sizeof(char*);
+      for (char** e = environ; *e; ++e)
+        env += std::strlen(*e) + 1 + sizeof(char*);
+      size_t reserve = env + 2048;
+      byte_limit     = total > reserve ? total - reserve : 0;
+      arena_size     = byte_limit + 4096;
+      long page      = sysconf(_SC_PAGESIZE);
+      string_limit   = 32 * size_t(page > 0 ? page : 4096);
+      char_limit     = config.max_chars ? config.max_chars : SIZE_MAX;
+
+      for (auto arg : config.command) {
+        fixed_bytes += arg.size() + 1 + sizeof(char*);
+        fixed_chars += arg.size() + 1;
+      }
+      bytes = fixed_bytes;
+      chars = fixed_chars;
+      if (bytes > byte_limit || chars > char_limit)
+        fail(argv0, "argument list too long");
+    }
+
+    bool fits(size_t size) const {
+      return bytes + size + 1 + sizeof(char*) <= byte_limit &&
+        chars + size + 1 <= char_limit && size < string_limit;
+    }
+
+    char* copy(std::string_view str) {
+      auto res = static_cast<char*>(batch_memory->allocate(str.size() + 1, 1));
+      std::memcpy(res, str.data(), str.size());
+      res[str.size()] = '\0';
+      return res;
+    }
+
+    void add(const std::string& item, bool eol) {
+      if (!fits(item.size())) {
+        if (argv.size() > fixed) execute();
+        if (!fits(item.size())) {
+          std::cerr << fmt::format("{}: argument line too long\n", argv0);
+          status  = std::max(status, 1);
+          stopped = true;
+          return;
+        }
+      }
+      argv.push_back(copy(item));
+      bytes += item.size() + 1 + sizeof(char*);
+      chars += item.size() + 1;
+      if (config.max_args && argv.size() - fixed >= config.max_args) {
+        execute();
+        return;
+      }
+      if (eol && config.max_lines && ++lines >= config.max_lines) execute();
+    }
+
+    // -I: one command per item, with the item in place of every occurrence
+    // of the replacement string in INITIAL-ARGS
+    void run_replaced(std::string_view item) {
+      std::string_view rep = config.replace;
+      size_t total         = fixed_chars;
+      for (size_t i = 1; i < fixed; ++i) {
+        std::string_view arg = config.command[i];
+        size_t count         = 0;
+        for (size_t at = arg.find(rep); at != arg.npos;
+             at        = arg.find(rep, at + rep.size()))
+          ++count;
+        if (count == 0) continue;
+
+        size_t size = arg.size() + count * item.size() - count * rep.size();
+        total = total - arg.size() + size;
+        auto out = static_cast<char*>(batch_memory->allocate(size + 1, 1));
+        argv[i]  = out;
+        size_t last = 0;
+        for (size_t at = arg.find(rep); at != arg.npos;
+             at        = arg.find(rep, last)) {
+          out  = std::copy(arg.begin() + last, arg.begin() + at, out);
+          out  = std::copy(item.begin(), item.end(), out);
+          last = at + rep.size();
+        }
+        out  = std::copy(arg.begin() + last, arg.end(), out);
+        *out = '\0';
+      }
+      if (total > char_limit ||
+          total + fixed * sizeof(char*) > byte_limit) {
+        std::cerr << fmt::format("{}: argument line too long\n", argv0);
+        status  = std::max(status, 1);
+        stopped = true;
+        return;
+      }
+      execute();
+      for (size_t i = 1; i < fixed; ++i)
+        argv[i] = const_cast<char*>(config.command[i].data());
+    }
+
+    void execute() {
+      ran = true;
+      argv.push_back(nullptr);
+      if (config.trace) trace();
+      if (kind == builtin::none || !run_builtin()) spawn();
+
+      argv.resize(fixed);
+      batch_memory->release();
+      bytes = fixed_bytes;
+      chars = fixed_chars;
+      lines = 0;
+    }
+
+    // -t: the command line as a shell would take it back
+    void trace() {
+      std::string line;
+      for (size_t i = 0; argv[i]; ++i) {
+        if (i > 0) line.push_back(' ');
+        std::string_view arg = argv[i];
+        bool plain = !arg.empty() &&
+          std::all_of(arg.begin(), arg.end(), shell_safe);
+        if (plain) {
+          line.append(arg);
+          continue;
+        }
+        line.push_back('\'');
+        for (char c : arg) {
+          if (c == '\'')
+            line.append("'\\''"sv);
+          else
+            line.push_back(c);
+        }
+        line.push_back('\'');
+      }
+      line.push_back('\n');
+      coreutils::write_all(STDERR_FILENO, {std::string_view(line)});
+    }
+
+    // Runs the command line inside this process. Returns false if it has to
+    // be spawned after all (for --help, which prints the real usage).
+    bool run_builtin() {
+      views.clear();
+      for (size_t i = 1; argv[i]; ++i)
+        views.emplace_back(argv[i]);
+      std::span<const std::string_view> args = views;
+      if (!args.empty() && args[0] == "--help"sv) return false;
+
+      // anything the children wrote has to come out first
+      if (config.max_procs == 1) wait_all();
+      int res;
+      if (kind == builtin::echo) {
+        std::pmr::string out(&*batch_memory);
+        coreutils::echo_to(args, [&](std::string_view s) { out.append(s); });
+        res = coreutils::write_all(STDOUT_FILENO, {out}) ? 0 : 1;
+        if (res != 0) report(config.command[0], errno);
+      }
+      else {
+        res = evaluate_test(args);
+      }
+      exited(res);
+      return true;
+    }
+
+    int evaluate_test(std::span<const std::string_view> args) {
+      using namespace coreutils::test;
+      try {
+        if (kind == builtin::lbracket) {
+          if (args.empty() || args.back() != "]"sv)
+            throw coreutils::parse_error("Last argument of [ must be ]");
+          args = args.first(args.size() - 1);
+        }
+        if (args.empty()) return 1;
+        return int(!eval_logic(eval_conditions(args)));
+      }
+      catch (const coreutils::parse_error& e) {
+        std::cerr << fmt::format(
+          "{}: {}: parse error: {}\n", argv0, config.command[0], e.what());
+        return 2;
+      }
+      catch (const std::exception& e) {
+        std::cerr << fmt::format(
+          "{}: {}: internal error: {}\n", argv0, config.command[0], e.what());
+        return 3;
+      }
+    }
+
+    // PATH is searched once, rather than by posix_spawnp for every command
+    // line.
+    const char* resolve() {
+      if (resolved) return path.empty() ? nullptr : path.c_str();
+      resolved              = true;
+      std::string_view name = config.command[0];
+      if (name.find('/') != name.npos) {
+        path = name;
+        return path.c_str();
+      }
+      const char* env       = getenv("PATH");
+      std::string_view dirs = env ? env : "/bin:/usr/bin";
+      for (;;) {
+        auto sep             = dirs.find(':');
+        std::string_view dir = dirs.substr(0, sep);
+        path.assign(dir.empty() ? "."sv : dir);
+        path.push_back('/');
+        path.append(name);
+        struct stat st;
+        if (access(path.c_str(), X_OK) == 0 && stat(path.c_str(), &st) == 0 &&
+            S_ISREG(st.st_mode))
+          return path.c_str();
+        if (sep == dirs.npos) break;
+        dirs.remove_prefix(sep + 1);
+      }
+      path.clear();
+      return nullptr;
+    }
+
+    void spawn() {
+      const char* file = resolve();
+      if (!file) {
+        give_up(ENOENT);
+        return;
+      }
+      while (jobs.full())
+        jobs.reap([&](const siginfo_t& info) { finished(info); });
+      if (stopped) return;
+
+      pid_t pid;
+      int err;
+      for (;;) {
+        err = posix_spawn(&pid, file, &actions, nullptr, argv.data(), environ);
+        // out of processes: wait for one of ours, if there is one
+        if (err != EAGAIN || jobs.size() == 0) break;
+        jobs.reap([&](const siginfo_t& info) { finished(info); });
+      }
+      if (err != 0) {
+        give_up(err);
+        return;
+      }
+      jobs.add(pid);
+      if (config.max_procs == 1) wait_all();
+    }
+
+    void wait_all() {
+      while (jobs.size() > 0)
+        jobs.reap([&](const siginfo_t& info) { finished(info); });
+    }
+
+    void finished(const siginfo_t& info) {
+      if (info.si_code == CLD_EXITED) {
+        exited(info.si_status);
+        return;
+      }
+      std::cerr << fmt::format(
+        "{}: {}: terminated by signal {}\n", argv0, config.command[0],
+        info.si_status);
+      status  = std::max(status, 125);
+      stopped = true;
+    }
+
+    void exited(int code) {
+      if (code == 255) {
+        std::cerr << fmt::format(
+          "{}: {}: exited with status 255; aborting\n", argv0,
+          config.command[0]);
+        status  = std::max(status, 124);
+        stopped = true;
+      }
+      else if (code != 0) {
+        status = std::max(status, 123);
+      }
+    }
+
+    void give_up(int err) {
+      report(config.command[0], err);
+      status  = std::max(status, err == ENOENT ? 127 : 126);
+      stopped = true;
+    }
+
+    void report(std::string_view what, int err) {
+      std::cerr << fmt::format("{}: {}: {}\n", argv0, what, std::strerror(err));
+    }
+
+    const option_data& config;
+    const char* argv0;
+    job_set jobs;
+    builtin kind = builtin::none;
+    posix_spawn_file_actions_t actions;
+
+    // the command line being built: COMMAND and INITIAL-ARGS (the first
+    // `fixed` entries), then the items, which live in batch_memory
+    std::vector<char*> argv;
+    std::vector<std::string_view> views;
+    size_t fixed = 0;
+    std::unique_ptr<std::byte[]> arena_block;
+    size_t arena_size = 0;
+    std::optional<std::pmr::monotonic_buffer_resource> batch_memory;
+
+    size_t byte_limit   = 0;
+    size_t char_limit   = 0;
+    size_t string_limit = 0;
+    size_t fixed_bytes  = 0;
+    size_t fixed_chars  = 0;
+    size_t bytes        = 0;
+    size_t chars        = 0;
+    size_t lines        = 0;
+
+    std::string path;
+    bool resolved = false;
+    bool ran      = false;
+    bool stopped  = false;
+    int status    = 0;
+  };
+}  // namespace
+
+int main(const int argc, const char* argv[]) {
+  auto config = parse_options(argc, argv);
+  return xargs(config, argv[0]).run();
+}
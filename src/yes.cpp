@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std::literals::string_view_literals;
+
+using args_t = std::vector<std::string_view>;
+
+void usage(std::string_view argv0) {
+  std::cout << fmt::format(R"msg(
+usage: {0} [STRING]...
+   or: {0} --help
+Repeatedly prints a line containing all STRINGs separated by spaces, or 'y' if
+no STRINGs are specified, until killed.
+
+Options:
+  --help    print this help page and exit
+)msg"sv.substr(1), argv0);
+}
+
+namespace {
+  // Minimum amount of data handed to the kernel per call. Pipes are grown to
+  // this size where possible, so that one vmsplice fills the whole pipe.
+  constexpr size_t target_chunk = size_t(1) << 20;
+
+  struct free_deleter {
+    void operator()(char* p) const { std::free(p); }
+  };
+  using buffer_ptr = std::unique_ptr<char[], free_deleter>;
+
+  [[noreturn]] void die(std::string_view argv0, std::string_view what) {
+    std::cerr << fmt::format("{}: {}: {}\n", argv0, what, std::strerror(errno));
+    std::exit(EXIT_FAILURE);
+  }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  args_t args(argv, argv + argc);
+
+  // check for help option
+  if (args.size() == 2 && args[1] == "--help") {
+    usage(args[0]);
+    return 0;
+  }
+
+  // join arguments with a space between each, empty ones included
+  std::string line;
+  for (auto i = ++args.begin(); i != args.end(); ++i) {
+    if (i != ++args.begin()) line.push_back(' ');
+    line.append(*i);
+  }
+  if (args.size() < 2) line.push_back('y');
+  line.push_back('\n');
+
+  struct stat out_stat;
+  if (fstat(STDOUT_FILENO, &out_stat) != 0) die(args[0], "standard output");
+  bool use_vmsplice = S_ISFIFO(out_stat.st_mode);
+
+  // a bigger pipe means fewer round trips through the scheduler
+  size_t chunk = target_chunk;
+  if (use_vmsplice) {
+    int pipe_size = fcntl(STDOUT_FILENO, F_SETPIPE_SZ, int(target_chunk));
+    if (pipe_size < 0) pipe_size = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+    if (pipe_size > 0) chunk = size_t(pipe_size);
+  }
+
+  // Fill a page-aligned buffer with as many whole lines as fit. Output always
+  // resumes where the previous call stopped and wraps around at the last whole
+  // line, so the stream stays continuous even after partial writes.
+  const size_t page = size_t(sysconf(_SC_PAGESIZE));
+  size_t capacity   = std::max(chunk, line.size());
+  capacity          = (capacity + page - 1) / page * page;
+  buffer_ptr buffer(static_cast<char*>(std::aligned_alloc(page, capacity)));
+  if (!buffer) die(args[0], "allocating output buffer");
+
+  size_t used = 0;
+  while (used + line.size() <= capacity) {
+    std::memcpy(buffer.get() + used, line.data(), line.size());
+    used += line.size();
+  }
+
+  size_t offset = 0;
+  for (;;) {
+    ssize_t res;
+    if (use_vmsplice) {
+      // The buffer is never written again, so the pipe may safely reference
+      // its pages without copying them.
+      iovec iov {buffer.get() + offset, used - offset};
+      res = vmsplice(STDOUT_FILENO, &iov, 1, 0);
+      if (res < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+        use_vmsplice = false;
+        continue;
+      }
+    }
+    else {
+      res = write(STDOUT_FILENO, buffer.get() + offset, used - offset);
+    }
+
+    if (res < 0) {
+      if (errno == EINTR) continue;
+      die(args[0], "standard output");
+    }
+    offset += size_t(res);
+    if (offset == used) offset = 0;
+  }
+}